@@ -39,21 +39,13 @@ static char *about_lines[] = {
 };
 
 static int *linecd[ARRAY_SIZE(about_lines)], i, j;
+static int anim_timer = -1;
 
-void scr_about_init(void)
-{
-	w_about = newwin_title(0, WAV_HEIGHT, "About", false);
-
-	for (i = 0; i < ARRAY_SIZE(about_lines); i++) {
-		linecd[i] = malloc(strlen(about_lines[i]) * sizeof(int));
-		for (j = 0; j < strlen(about_lines[i]); j++)
-			linecd[i][j] = (rand() / (float)RAND_MAX) * 120 + 60;
-	}
-}
-
-int scr_about_loop(WINDOW *w_menu)
+/* Advance the animation by one step, stopping once all text has settled. */
+static void animate_about(int fd)
 {
 	char buf[0x100];
+	bool settled = true;
 
 	for (i = 0; i < ARRAY_SIZE(about_lines); i++) {
 		for (j = 0; j < strlen(about_lines[i]); j++) {
@@ -66,16 +58,41 @@ int scr_about_loop(WINDOW *w_menu)
 			} else {
 				buf[j] = about_lines[i][j];
 			}
+			settled &= !linecd[i][j];
 		}
 		buf[j] = '\0';
 		waddstr_center(w_about, (WAV_HEIGHT - ARRAY_SIZE(about_lines))/2 + i, buf);
 	}
 	wrefresh(w_about);
+
+	if (settled) {
+		timer_stop(anim_timer);
+		anim_timer = -1;
+	}
+}
+
+void scr_about_init(void)
+{
+	w_about = newwin_title(0, WAV_HEIGHT, "About", false);
+
+	for (i = 0; i < ARRAY_SIZE(about_lines); i++) {
+		linecd[i] = malloc(strlen(about_lines[i]) * sizeof(int));
+		for (j = 0; j < strlen(about_lines[i]); j++)
+			linecd[i][j] = (rand() / (float)RAND_MAX) * 120 + 60;
+	}
+	animate_about(-1);
+	anim_timer = timer_start(5, animate_about);
+}
+
+int scr_about_loop(WINDOW *w_menu)
+{
 	return wgetch(w_menu);
 }
 
 void scr_about_fini(void)
 {
+	timer_stop(anim_timer);
+	anim_timer = -1;
 	delwin(w_about);
 	for (i = 0; i < ARRAY_SIZE(about_lines); i++)
 		free(linecd[i]);
@@ -0,0 +1,466 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "iw_if.h"
+
+/*
+ * Persistent table of access points
+ *
+ * Each scan only reports the stations in range at that moment. The scan
+ * thread records every scan in a table keyed by BSSID, which keeps what is
+ * known about each station from one scan to the next: when it was first and
+ * last seen, how often, and how its signal level developed. Stations that a
+ * scan misses are carried over into its snapshot, as last seen, until they
+ * have not been seen for conf.scan_ageout seconds.
+ *
+ * The table uses open addressing with linear probing and is kept at most half
+ * full, so that recording an observation takes constant time. Removal shifts
+ * the following entries back into place, hence there are no tombstones.
+ *
+ * Many stations share an ESSID (e.g. the access points of one network), so
+ * ESSIDs are interned in reference-counted atoms.
+ *
+ * The latest AP_HIST_LEN signal levels of each station are kept in a ring
+ * buffer, for up to AP_HIST_MAX stations; further ones have none until others
+ * age out. All rings are allocated at once, as one array per member, so that
+ * recording a level never allocates and the memory used is fixed (about 650
+ * KiB).
+ */
+
+/* Weight of a new signal level in the smoothed level. */
+#define AP_EWMA_WEIGHT		0.25
+/* Change of signal level (dB) against the smoothed level counted as trend. */
+#define AP_TREND_DB		3
+#define AP_TABLE_MIN		64
+
+#define AP_HIST_MAX		2048
+#define AP_HIST_LEN		64
+#define AP_HIST_NONE		UINT16_MAX
+
+/**
+ * struct ap_hist_pool  -  ring buffers of timestamped signal levels
+ * @dbm:	signal levels in dBm
+ * @when_ms:	times of the levels, in ms since @ap_table.epoch_ms
+ * @head:	index of the oldest level of each ring
+ * @len:	number of levels in each ring
+ * @next_free:	next ring in the list of unused ones
+ * @free:	first unused ring, AP_HIST_NONE if all are in use
+ */
+struct ap_hist_pool {
+	int8_t		dbm[AP_HIST_MAX][AP_HIST_LEN];
+	uint32_t	when_ms[AP_HIST_MAX][AP_HIST_LEN];
+	uint8_t		head[AP_HIST_MAX],
+			len[AP_HIST_MAX];
+	uint16_t	next_free[AP_HIST_MAX];
+	uint16_t	free;
+};
+
+/**
+ * struct essid_atom  -  interned ESSID
+ * @next:	next atom in the same hash chain
+ * @refs:	number of slots using this atom
+ * @str:	the ESSID
+ */
+struct essid_atom {
+	struct essid_atom	*next;
+	unsigned int		refs;
+	char			str[];
+};
+
+/**
+ * struct ap_slot  -  everything known about one station
+ * @essid:	interned ESSID, NULL if the slot is free
+ * @ie:		Information Elements of the last observation not yet decoded
+ * @first_ms:	CLOCK_MONOTONIC time in ms of the first observation
+ * @last_ms:	CLOCK_MONOTONIC time in ms of the latest observation
+ * @stamp:	number of the scan that last saw (or carried over) the station
+ * @hist:	ring of the signal history in the pool, or AP_HIST_NONE
+ * @has_sig:	whether @stats contains signal levels
+ * The other members are those of the scan_entry of the latest observation.
+ */
+struct ap_slot {
+	struct essid_atom	*essid;
+	const uint8_t		*ie;
+	uint64_t		first_ms,
+				last_ms;
+	struct iw_levelstat	dbm;
+	struct iw_quality	qual;
+	struct bss_stats	stats;
+	uint32_t		flags;
+	uint32_t		stamp;
+	uint32_t		freq;
+	uint16_t		hist;
+	uint16_t		ie_len;
+	struct ether_addr	bssid;
+	uint8_t			chan,
+				mode;
+	bool			has_key,
+				has_sig;
+};
+
+/*
+ * ESSID atoms
+ */
+static unsigned int essid_hash(const char *essid)
+{
+	unsigned int h = 2166136261u;	/* FNV-1a */
+
+	while (*essid)
+		h = (h ^ (uint8_t)*essid++) * 16777619u;
+	return h % AP_ESSID_BUCKETS;
+}
+
+static struct essid_atom *essid_get(struct ap_table *t, const char *essid)
+{
+	struct essid_atom **chain = t->essid + essid_hash(essid), *a;
+
+	for (a = *chain; a; a = a->next)
+		if (strcmp(a->str, essid) == 0)
+			break;
+	if (!a) {
+		a = malloc(sizeof(*a) + strlen(essid) + 1);
+		if (!a)
+			err_sys("can not allocate ESSID");
+		strcpy(a->str, essid);
+		a->refs = 0;
+		a->next = *chain;
+		*chain  = a;
+	}
+	a->refs++;
+	return a;
+}
+
+static void essid_put(struct ap_table *t, struct essid_atom *atom)
+{
+	struct essid_atom **prev = t->essid + essid_hash(atom->str);
+
+	if (--atom->refs)
+		return;
+	while (*prev != atom)
+		prev = &(*prev)->next;
+	*prev = atom->next;
+	free(atom);
+}
+
+/*
+ * Signal history
+ */
+static void ap_hist_init(struct ap_table *t, uint64_t now_ms)
+{
+	struct ap_hist_pool *pool = calloc(1, sizeof(*pool));
+	int i;
+
+	if (!pool)
+		err_sys("can not allocate signal history");
+	for (i = 0; i < AP_HIST_MAX; i++)
+		pool->next_free[i] = i + 1 < AP_HIST_MAX ? i + 1 : AP_HIST_NONE;
+	pool->free  = 0;
+	t->hist	    = pool;
+	t->epoch_ms = now_ms;
+}
+
+static uint16_t ap_hist_get(struct ap_table *t)
+{
+	uint16_t h = t->hist->free;
+
+	if (h != AP_HIST_NONE) {
+		t->hist->free	= t->hist->next_free[h];
+		t->hist->len[h] = 0;
+	}
+	return h;
+}
+
+static void ap_hist_put(struct ap_table *t, uint16_t h)
+{
+	if (h == AP_HIST_NONE)
+		return;
+	t->hist->next_free[h] = t->hist->free;
+	t->hist->free	      = h;
+}
+
+static void ap_hist_add(struct ap_table *t, uint16_t h, int dbm, uint64_t when_ms)
+{
+	struct ap_hist_pool *pool = t->hist;
+	unsigned int pos;
+
+	if (h == AP_HIST_NONE)
+		return;
+	pos = (pool->head[h] + pool->len[h]) % AP_HIST_LEN;
+	if (pool->len[h] == AP_HIST_LEN)
+		pool->head[h] = (pool->head[h] + 1) % AP_HIST_LEN;
+	else
+		pool->len[h]++;
+
+	pool->dbm[h][pos]     = clamp(dbm, INT8_MIN + 1, INT8_MAX);
+	pool->when_ms[h][pos] = when_ms > t->epoch_ms ? when_ms - t->epoch_ms : 0;
+}
+
+/*
+ * Hash table
+ */
+static size_t bssid_hash(const struct ether_addr *bssid)
+{
+	uint64_t key = 0;
+
+	memcpy(&key, bssid, sizeof(*bssid));
+	return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/* Return the slot of @bssid, or the free slot where it belongs. */
+static struct ap_slot *ap_slot_find(const struct ap_table *t,
+				    const struct ether_addr *bssid)
+{
+	size_t i = bssid_hash(bssid) & (t->size - 1);
+
+	while (t->slot[i].essid && memcmp(&t->slot[i].bssid, bssid, sizeof(*bssid)))
+		i = (i + 1) & (t->size - 1);
+	return t->slot + i;
+}
+
+static void ap_table_grow(struct ap_table *t)
+{
+	struct ap_slot *old = t->slot;
+	size_t i, old_size = t->size;
+
+	t->size = old_size ? old_size * 2 : AP_TABLE_MIN;
+	t->slot = calloc(t->size, sizeof(*t->slot));
+	if (!t->slot)
+		err_sys("can not allocate access point table");
+
+	for (i = 0; i < old_size; i++)
+		if (old[i].essid)
+			*ap_slot_find(t, &old[i].bssid) = old[i];
+	free(old);
+}
+
+/* Free slot @i, moving later entries of the same probe sequence back. */
+static void ap_slot_remove(struct ap_table *t, size_t i)
+{
+	const size_t mask = t->size - 1;
+	size_t j = i, home;
+
+	essid_put(t, t->slot[i].essid);
+	ap_hist_put(t, t->slot[i].hist);
+	t->used--;
+	for (;;) {
+		t->slot[i].essid = NULL;
+		do {
+			j = (j + 1) & mask;
+			if (!t->slot[j].essid)
+				return;
+			home = bssid_hash(&t->slot[j].bssid) & mask;
+		} while (i <= j ? i < home && home <= j : i < home || home <= j);
+		t->slot[i] = t->slot[j];
+		i = j;
+	}
+}
+
+/* Fold the observation @cur, made at @when_ms, into @slot. */
+static void ap_slot_observe(struct ap_table *t, struct ap_slot *slot,
+			    const struct scan_entry *cur, uint64_t when_ms)
+{
+	const float sig = cur->dbm.signal;
+	const int dbm = lrintf(sig);
+	float delta;
+
+	slot->last_ms = when_ms;
+	slot->stats.seen++;
+	if (cur->qual.updated & IW_QUAL_LEVEL_INVALID)
+		return;
+	/* Rings freed by stations that aged out go to those without one */
+	if (slot->hist == AP_HIST_NONE)
+		slot->hist = ap_hist_get(t);
+	ap_hist_add(t, slot->hist, dbm, when_ms);
+
+	if (!slot->has_sig) {
+		slot->has_sig	     = true;
+		slot->stats.sig_avg  = sig;
+		slot->stats.sig_min  = dbm;
+		slot->stats.sig_max  = dbm;
+		return;
+	}
+	delta = sig - slot->stats.sig_avg;
+	slot->stats.sig_avg += AP_EWMA_WEIGHT * delta;
+	slot->stats.sig_min  = min(slot->stats.sig_min, dbm);
+	slot->stats.sig_max  = max(slot->stats.sig_max, dbm);
+	slot->stats.trend    = delta >= AP_TREND_DB ? 1 :
+			       delta <= -AP_TREND_DB ? -1 : 0;
+}
+
+/* Record @cur, seen by the scan that completed at @now_ms. */
+static void ap_table_record(struct ap_table *t, struct scan_entry *cur,
+			    uint64_t now_ms)
+{
+	const uint64_t when_ms = now_ms - (cur->age_ms > 0 ? cur->age_ms : 0);
+	struct ap_slot *slot;
+
+	if ((t->used + 1) * 2 > t->size)
+		ap_table_grow(t);
+
+	slot = ap_slot_find(t, &cur->ap_addr);
+	if (!slot->essid) {
+		memset(slot, 0, sizeof(*slot));
+		slot->bssid	= cur->ap_addr;
+		slot->essid	= essid_get(t, cur->essid);
+		slot->first_ms	= when_ms;
+		slot->hist	= AP_HIST_NONE;
+		t->used++;
+		ap_slot_observe(t, slot, cur, when_ms);
+	} else {
+		if (strcmp(slot->essid->str, cur->essid)) {
+			essid_put(t, slot->essid);
+			slot->essid = essid_get(t, cur->essid);
+		}
+		/* Cached results may report the same observation again */
+		if (when_ms > slot->last_ms)
+			ap_slot_observe(t, slot, cur, when_ms);
+	}
+
+	/* The IEs refer to the buffer of @cur's snapshot, see ap_table_carry() */
+	slot->ie	= cur->ie;
+	slot->ie_len	= cur->ie_len;
+	slot->flags	= cur->flags;
+	slot->dbm	= cur->dbm;
+	slot->qual	= cur->qual;
+	slot->freq	= cur->freq;
+	slot->chan	= cur->chan;
+	slot->mode	= cur->mode;
+	slot->has_key	= cur->has_key;
+	slot->stamp	= t->scans;
+
+	cur->stats	   = slot->stats;
+	cur->stats.known_s = (now_ms - slot->first_ms) / 1000;
+}
+
+/* Return a copy of the last observation of @slot, allocated from @arena. */
+static struct scan_entry *ap_table_carry(struct ap_slot *slot, uint64_t now_ms,
+					 struct scan_arena *arena)
+{
+	struct scan_entry *e = scan_arena_alloc(arena, sizeof(*e));
+
+	e->ap_addr	= slot->bssid;
+	e->ie		= slot->ie;
+	e->ie_len	= slot->ie_len;
+	e->flags	= slot->flags;
+	e->dbm		= slot->dbm;
+	e->qual		= slot->qual;
+	e->freq		= slot->freq;
+	e->chan		= slot->chan;
+	e->mode		= slot->mode;
+	e->has_key	= slot->has_key;
+	e->age_ms	= now_ms - slot->last_ms;
+	strcpy(e->essid, slot->essid->str);
+
+	/*
+	 * The first time that a station is missed, its IEs still refer to the
+	 * snapshot currently published, which is only retired once this one
+	 * replaces it. Decode them while they are valid.
+	 */
+	e->flags = slot->flags = scan_entry_flags(e);
+	e->ie	 = slot->ie	= NULL;
+
+	e->stats	 = slot->stats;
+	e->stats.known_s = (now_ms - slot->first_ms) / 1000;
+	e->stats.stale	 = true;
+	return e;
+}
+
+/**
+ * ap_table_update  -  record a scan, and carry over stations it missed
+ * @t:	table of stations seen so far
+ * @ss: snapshot of the scan, not yet published
+ * Fills in the statistics of the entries of @ss, drops stations that have aged
+ * out, and appends copies of the remaining ones which @ss did not contain.
+ */
+void ap_table_update(struct ap_table *t, struct scan_snapshot *ss)
+{
+	const uint64_t ageout_ms = conf.scan_ageout * 1000ULL;
+	struct scan_entry *cur, **tailp = &ss->head;
+	struct timespec now;
+	uint64_t now_ms;
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ms = now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+	t->scans++;
+	if (!t->hist)
+		ap_hist_init(t, now_ms);
+
+	for (cur = ss->head; cur; tailp = &cur->next, cur = cur->next)
+		ap_table_record(t, cur, now_ms);
+
+	/* Removal moves entries, but only within the current probe sequence */
+	for (i = 0; i < t->size; ) {
+		struct ap_slot *slot = t->slot + i;
+
+		if (!slot->essid || slot->stamp == t->scans) {
+			i++;
+		} else if (now_ms - slot->last_ms >= ageout_ms) {
+			ap_slot_remove(t, i);
+		} else {
+			slot->stamp = t->scans;
+			*tailp = ap_table_carry(slot, now_ms, &ss->arena);
+			tailp  = &(*tailp)->next;
+			i++;
+		}
+	}
+}
+
+/**
+ * ap_table_spark  -  copy the latest signal levels of the entries of @ss
+ * @t:	table that @ss was recorded in by ap_table_update()
+ * @ss: snapshot, not yet published, whose entry array has been filled in
+ * Fills @ss->spark, aligning the latest level of each entry to the right.
+ */
+void ap_table_spark(const struct ap_table *t, struct scan_snapshot *ss)
+{
+	const struct ap_hist_pool *pool = t->hist;
+	const struct ap_slot *slot;
+	int8_t *spark;
+	size_t i;
+	int k, n;
+
+	if (!ss->num.entries)
+		return;
+	ss->spark = scan_arena_alloc(&ss->arena, ss->num.entries * SPARK_LEN);
+
+	for (i = 0; i < ss->num.entries; i++) {
+		spark = ss->spark + i * SPARK_LEN;
+		slot  = ap_slot_find(t, &ss->entry[i]->ap_addr);
+		n     = 0;
+		if (slot->essid && slot->hist != AP_HIST_NONE)
+			n = min(pool->len[slot->hist], SPARK_LEN);
+
+		for (k = 0; k < SPARK_LEN - n; k++)
+			spark[k] = SPARK_NONE;
+		for (k = 0; k < n; k++)
+			spark[SPARK_LEN - n + k] = pool->dbm[slot->hist]
+				[(pool->head[slot->hist] + pool->len[slot->hist] - n + k) % AP_HIST_LEN];
+	}
+}
+
+void ap_table_fini(struct ap_table *t)
+{
+	size_t i;
+
+	for (i = 0; i < t->size; i++)
+		if (t->slot[i].essid)
+			essid_put(t, t->slot[i].essid);
+	free(t->slot);
+	free(t->hist);
+	memset(t, 0, sizeof(*t));
+}
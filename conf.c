@@ -42,6 +42,14 @@ static char *sort_order[] = {
 	[SO_OPEN]	= "Open",
 	[SO_CHAN_SIG]	= "Chan/Sig",
 	[SO_OPEN_SIG]	= "Open/Sig",
+	[SO_CUSTOM]	= "Custom",
+	NULL
+};
+
+static char *backend_names[] = {
+	[BE_AUTO]	= "Auto",
+	[BE_WEXT]	= "WEXT",
+	[BE_NL80211]	= "nl80211",
 	NULL
 };
 
@@ -57,6 +65,8 @@ struct wavemon_conf conf = {
 
 	.stat_iv		= 100,
 	.info_iv		= 10,
+	.scan_iv		= 2,
+	.scan_ageout		= 60,
 	.slotsize		= 4,
 	.meter_decay		= 0,
 
@@ -64,6 +74,7 @@ struct wavemon_conf conf = {
 	.cisco_mac		= false,
 	.override_bounds	= false,
 	.random			= false,
+	.realtime		= false,
 
 	.sig_min		= -102,
 	.sig_max		= 10,
@@ -72,12 +83,16 @@ struct wavemon_conf conf = {
 
 	.scan_sort_order	= SO_CHAN_SIG,
 	.scan_sort_asc		= false,
+	.scan_passive		= false,
+	.scan_watch		= "",
+	.scan_sort_spec		= "",
 	.lthreshold_action	= TA_DISABLED,
 	.lthreshold		= -80,
 	.hthreshold_action	= TA_DISABLED,
 	.hthreshold		= -10,
 
 	.startup_scr		= 0,
+	.backend		= BE_AUTO,
 };
 
 /** Populate interface list */
@@ -105,12 +120,34 @@ void conf_get_interface_list(bool init)
 	}
 }
 
+/**
+ * Re-read the interface list after a hotplug event, keeping the selection.
+ * Returns true if the selected interface has changed as a result.
+ */
+bool conf_update_interface_list(void)
+{
+	char *old_if = strdup(conf_ifname());
+	bool changed;
+
+	conf_get_interface_list(false);
+	changed = strcmp(old_if, conf_ifname()) != 0;
+	free(old_if);
+
+	return changed;
+}
+
 /** Return currently selected interface name */
 const char *conf_ifname(void)
 {
 	return if_list[0] && if_list[conf.if_idx] ? if_list[conf.if_idx] : "(none)";
 }
 
+/** Return the names of all wireless interfaces, terminated by NULL */
+const char *const *conf_iflist(void)
+{
+	return (const char *const *)if_list;
+}
+
 /* Return full path of rcfile. Allocates string which must bee free()-d. */
 static char *get_confname(void)
 {
@@ -131,7 +168,7 @@ static char *get_confname(void)
 
 static void read_cf(void)
 {
-	char tmp[0x100], lv[0x20], rv[0x20];
+	char tmp[0x100], lv[0x20], rv[0x80];
 	struct conf_item *ci = NULL;
 	FILE *fd;
 	size_t len;
@@ -177,7 +214,7 @@ static void read_cf(void)
 		lp += strspn(lp, " ");
 
 		len = strcspn(lp, " \n");
-		if (len > sizeof(rv))
+		if (len >= sizeof(rv))
 			err_quit("parse error in %s, line %d: argument too long", cfname, lnum);
 		else if (*lp == '\n')
 			err_quit("parse error in %s, line %d: argument expected", cfname, lnum);
@@ -207,6 +244,10 @@ static void read_cf(void)
 					 cfname, lnum, lv, rv);
 			else
 				*ci->v.i = v_int;
+			break;
+		case t_str:
+			*ci->v.s = strdup(rv);
+			break;
 		case t_sep:	/* These two cases are missing from the enum, they are not handled */
 		case t_func:	/* To pacify gcc -Wall, fall through here */
 			break;
@@ -219,7 +260,7 @@ done:
 
 static void write_cf(void)
 {
-	char tmp[0x100], rv[0x40];
+	char tmp[0x100], rv[0x80];
 	struct conf_item *ci = NULL;
 	char *lp, *cp;
 	int add, i;
@@ -247,6 +288,12 @@ static void write_cf(void)
 				sprintf(rv, "%s", ci->list[*ci->v.i]);
 				str_tolower(rv);
 				break;
+			case t_str:
+				/* An empty value would not parse again */
+				if (!**ci->v.s)
+					continue;
+				snprintf(rv, sizeof(rv), "%s", *ci->v.s);
+				break;
 				/* Fall through, the rest are dummy statements to pacify gcc -Wall */
 			case t_sep:
 			case t_func:
@@ -316,6 +363,14 @@ static void init_conf_items(void)
 	item->list	= if_list;
 	ll_push(conf_items, "*", item);
 
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Wireless information via");
+	item->cfname	= strdup("backend");
+	item->type	= t_list;
+	item->v.i	= &conf.backend;
+	item->list	= backend_names;
+	ll_push(conf_items, "*", item);
+
 	item = calloc(1, sizeof(*item));
 	item->name	= strdup("Cisco-style MAC addresses");
 	item->cfname	= strdup("cisco_mac");
@@ -340,6 +395,28 @@ static void init_conf_items(void)
 	item->list	= on_off_names;
 	ll_push(conf_items, "*", item);
 
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Custom scan sort order");
+	item->cfname	= strdup("sort_spec");
+	item->type	= t_str;
+	item->v.s	= &conf.scan_sort_spec;
+	ll_push(conf_items, "*", item);
+
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Passive scanning");
+	item->cfname	= strdup("passive_scan");
+	item->type	= t_list;
+	item->v.i	= &conf.scan_passive;
+	item->list	= on_off_names;
+	ll_push(conf_items, "*", item);
+
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Scan watch list");
+	item->cfname	= strdup("scan_watch");
+	item->type	= t_str;
+	item->v.s	= &conf.scan_watch;
+	ll_push(conf_items, "*", item);
+
 	item = calloc(1, sizeof(*item));
 	item->name	= strdup("Statistics updates");
 	item->cfname	= strdup("stat_updates");
@@ -351,6 +428,14 @@ static void init_conf_items(void)
 	item->unit	= strdup("ms");
 	ll_push(conf_items, "*", item);
 
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Real-time sampling");
+	item->cfname	= strdup("realtime_sampling");
+	item->type	= t_list;
+	item->v.i	= &conf.realtime;
+	item->list	= on_off_names;
+	ll_push(conf_items, "*", item);
+
 	item = calloc(1, sizeof(*item));
 	item->name	= strdup("Histogram update cycles");
 	item->cfname	= strdup("lhist_slot_size");
@@ -383,6 +468,28 @@ static void init_conf_items(void)
 	item->unit	= strdup("s");
 	ll_push(conf_items, "*", item);
 
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Scan interval");
+	item->cfname	= strdup("scan_interval");
+	item->type	= t_int;
+	item->v.i	= &conf.scan_iv;
+	item->min	= 1;
+	item->max	= 60;
+	item->inc	= 1;
+	item->unit	= strdup("s");
+	ll_push(conf_items, "*", item);
+
+	item = calloc(1, sizeof(*item));
+	item->name	= strdup("Scan result aging");
+	item->cfname	= strdup("scan_ageout");
+	item->type	= t_int;
+	item->v.i	= &conf.scan_ageout;
+	item->min	= 0;
+	item->max	= 600;
+	item->inc	= 10;
+	item->unit	= strdup("s");
+	ll_push(conf_items, "*", item);
+
 	/* level scale items */
 	item = calloc(1, sizeof(*item));
 	item->type = t_sep;
@@ -52,7 +52,13 @@ static void waddstr_item(WINDOW *w, int y, struct conf_item *item, char hilight)
 		case t_list:
 			assert(item->list && item->list[*item->v.i]);
 			strncpy(s, item->list[*item->v.i], sizeof(s));
-			/* Fall through, dummy statements to pacify gcc -Wall */
+			break;
+		case t_str:
+			/* Read-only here, truncated to fit next to the name */
+			snprintf(s, min(sizeof(s), CONF_SCREEN_WIDTH -
+					strlen(item->name) - 1), "%s",
+				 **item->v.s ? *item->v.s : "(none)");
+			break;
 		case t_sep:
 		case t_func:
 			break;
@@ -109,6 +115,7 @@ static void change_item(int inum, char sign)
 		else if (*item->v.i < 0)
 			*item->v.i = tmp - 1;
 		/* Fall through, dummy statements to pacify gcc -Wall */
+	case t_str:	/* can only be set in ~/.wavemonrc */
 	case t_sep:
 	case t_func:
 		break;
@@ -159,7 +166,8 @@ static int m_pref(WINDOW *w_conf, int list_offset, int active_item, int num_item
 void scr_conf_init(void)
 {
 	struct conf_item *item;
-	conf_get_interface_list(false);	/* may have changed in the meantime */
+	if (!rtnl_events_active())	/* else kept up to date by events */
+		conf_get_interface_list(false);
 
 	num_items = ll_size(conf_items);
 	w_conf    = newwin_title(0, WAV_HEIGHT, "Preferences", false);
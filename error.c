@@ -34,9 +34,14 @@ static bool has_capability(cap_value_t cap)
 	return cur_val == CAP_SET;
 }
 
+/* Checked once, capabilities do not change while running. */
 bool has_net_admin_capability(void)
 {
-	return has_capability(CAP_NET_ADMIN);
+	static int net_admin = -1;
+
+	if (net_admin < 0)
+		net_admin = has_capability(CAP_NET_ADMIN);
+	return net_admin;
 }
 #else	/* !HAVE_LIBCAP */
 bool has_net_admin_capability(void)
@@ -0,0 +1,428 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "iw_if.h"
+#include "nl_util.h"
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+
+/*
+ * Link and address information via rtnetlink(7)
+ *
+ * Flags, MTU, queue length, hardware address and the 64-bit packet counters
+ * come from a single RTM_GETLINK request, the IPv4 and IPv6 addresses from a
+ * single RTM_GETADDR dump. The counters are read by the statistics sampling,
+ * the remainder by the main loop; each has its own persistent socket so that
+ * neither needs to lock against the other.
+ */
+static struct nl_sock rtnl_info_sk = { .fd = -1 },
+		      rtnl_stat_sk = { .fd = -1 };
+
+static int rtnl_sock_open(struct nl_sock *sk)
+{
+	int ret, one = 1;
+
+	if (sk->fd >= 0)
+		return 0;
+	ret = nl_open(sk, NETLINK_ROUTE);
+	if (ret < 0)
+		return ret;
+	/* Let the kernel filter address dumps by interface index */
+	setsockopt(sk->fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &one, sizeof(one));
+	return 0;
+}
+
+/**
+ * struct rtnl_link_req  -  destination of RTM_NEWLINK decoding
+ * @info:	link information to fill in (may be NULL)
+ * @stat:	packet/byte counters to fill in (may be NULL)
+ */
+struct rtnl_link_req {
+	struct if_info	*info;
+	struct if_stat	*stat;
+};
+
+static int rtnl_link_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct rtnl_link_req *req = arg;
+	const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+	const struct nlattr *tb[IFLA_MAX + 1];
+
+	if (nlh->nlmsg_type != RTM_NEWLINK ||
+	    nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+		return 0;
+	nl_attr_parse(tb, IFLA_MAX, nl_msg_payload(nlh, sizeof(*ifi)),
+		      nl_msg_payload_len(nlh, sizeof(*ifi)));
+
+	if (req->info) {
+		struct if_info *info = req->info;
+
+		info->flags = ifi->ifi_flags;
+		if (tb[IFLA_MTU])
+			info->mtu = nl_attr_u32(tb[IFLA_MTU]);
+		if (tb[IFLA_TXQLEN])
+			info->txqlen = nl_attr_u32(tb[IFLA_TXQLEN]);
+		if (tb[IFLA_ADDRESS] && nl_attr_len(tb[IFLA_ADDRESS]) >= ETH_ALEN)
+			memcpy(&info->hwaddr, nl_attr_data(tb[IFLA_ADDRESS]), ETH_ALEN);
+	}
+
+	if (req->stat && tb[IFLA_STATS64]) {
+		struct rtnl_link_stats64 s64 = { 0 };
+
+		memcpy(&s64, nl_attr_data(tb[IFLA_STATS64]),
+		       min(nl_attr_len(tb[IFLA_STATS64]), sizeof(s64)));
+		req->stat->rx_packets = s64.rx_packets;
+		req->stat->tx_packets = s64.tx_packets;
+		req->stat->rx_bytes   = s64.rx_bytes;
+		req->stat->tx_bytes   = s64.tx_bytes;
+	} else if (req->stat && tb[IFLA_STATS]) {
+		struct rtnl_link_stats s32 = { 0 };
+
+		memcpy(&s32, nl_attr_data(tb[IFLA_STATS]),
+		       min(nl_attr_len(tb[IFLA_STATS]), sizeof(s32)));
+		req->stat->rx_packets = s32.rx_packets;
+		req->stat->tx_packets = s32.tx_packets;
+		req->stat->rx_bytes   = s32.rx_bytes;
+		req->stat->tx_bytes   = s32.tx_bytes;
+	}
+	return 0;
+}
+
+/* Address dump: @ifindex selects the interface whose addresses go into @info */
+struct rtnl_addr_req {
+	int		ifindex;
+	struct if_info	*info;
+};
+
+static int rtnl_addr_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct rtnl_addr_req *req = arg;
+	struct if_info *info = req->info;
+	const struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+	const struct nlattr *tb[IFA_MAX + 1], *addr;
+
+	if (nlh->nlmsg_type != RTM_NEWADDR ||
+	    nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)) ||
+	    ifa->ifa_index != req->ifindex)
+		return 0;
+	nl_attr_parse(tb, IFA_MAX, nl_msg_payload(nlh, sizeof(*ifa)),
+		      nl_msg_payload_len(nlh, sizeof(*ifa)));
+
+	/* IFA_ADDRESS is the peer address on point-to-point links */
+	addr = tb[IFA_LOCAL] ? : tb[IFA_ADDRESS];
+	if (addr == NULL)
+		return 0;
+
+	if (ifa->ifa_family == AF_INET && !info->addr.s_addr &&
+	    !(ifa->ifa_flags & IFA_F_SECONDARY) && nl_attr_len(addr) >= 4) {
+		memcpy(&info->addr, nl_attr_data(addr), 4);
+		info->netmask.s_addr = ifa->ifa_prefixlen ?
+				htonl(~0U << (32 - ifa->ifa_prefixlen)) : 0;
+		if (tb[IFA_BROADCAST] && nl_attr_len(tb[IFA_BROADCAST]) >= 4)
+			memcpy(&info->bcast, nl_attr_data(tb[IFA_BROADCAST]), 4);
+	} else if (ifa->ifa_family == AF_INET6 &&
+		   info->num_addr6 < IF_MAX_ADDR6 && nl_attr_len(addr) >= 16) {
+		struct if_addr6 *a6 = info->addr6 + info->num_addr6++;
+
+		memcpy(&a6->addr, nl_attr_data(addr), 16);
+		a6->prefix_len = ifa->ifa_prefixlen;
+		a6->scope      = ifa->ifa_scope;
+	}
+	return 0;
+}
+
+static int rtnl_getlink(struct nl_sock *sk, const char *ifname,
+			struct rtnl_link_req *req)
+{
+	char buf[NL_REQ_SIZE];
+	struct nlmsghdr *nlh = nl_msg_init(buf, RTM_GETLINK, 0);
+	struct ifinfomsg *ifi = nl_msg_reserve(nlh, sizeof(*ifi));
+	int ret = rtnl_sock_open(sk);
+
+	if (ret < 0)
+		return ret;
+
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index  = if_handle_get(ifname)->ifindex;
+	if (!ifi->ifi_index)
+		nl_attr_put(nlh, IFLA_IFNAME, ifname, strlen(ifname) + 1);
+
+	return nl_talk(sk, nlh, rtnl_link_cb, req);
+}
+
+/**
+ * rtnl_getinf  -  fill in @info for @ifname via rtnetlink
+ * Returns 0 if ok, negative errno value otherwise.
+ */
+int rtnl_getinf(const char *ifname, struct if_info *info)
+{
+	struct rtnl_link_req link = { .info = info };
+	struct rtnl_addr_req addr = {
+		.ifindex = if_handle_get(ifname)->ifindex,
+		.info	 = info
+	};
+	char buf[NL_REQ_SIZE];
+	struct nlmsghdr *nlh;
+	struct ifaddrmsg *ifa;
+	int ret;
+
+	memset(info, 0, sizeof(struct if_info));
+
+	ret = rtnl_getlink(&rtnl_info_sk, ifname, &link);
+	if (ret < 0 || !addr.ifindex)
+		return ret;
+
+	nlh = nl_msg_init(buf, RTM_GETADDR, NLM_F_DUMP);
+	ifa = nl_msg_reserve(nlh, sizeof(*ifa));
+	ifa->ifa_family = AF_UNSPEC;
+	ifa->ifa_index  = addr.ifindex;
+
+	return nl_talk(&rtnl_info_sk, nlh, rtnl_addr_cb, &addr);
+}
+
+/**
+ * rtnl_getstat  -  read the 64-bit packet/byte counters of @ifname
+ * Returns 0 if ok, negative errno value otherwise.
+ */
+int rtnl_getstat(const char *ifname, struct if_stat *stat)
+{
+	struct rtnl_link_req link = { .stat = stat };
+
+	memset(stat, 0, sizeof(*stat));
+	return rtnl_getlink(&rtnl_stat_sk, ifname, &link);
+}
+
+/*
+ * Link and address change notifications
+ *
+ * The main loop watches a socket subscribed to the link and address multicast
+ * groups, so that the network information is only re-read when it changed,
+ * and interfaces that appear or disappear are noticed without delay.
+ */
+static struct nl_sock rtnl_ev_sk = { .fd = -1 };
+
+/** Subscribe to notifications. Returns the socket to watch, or -1. */
+int rtnl_events_init(void)
+{
+	const uint32_t groups[] = {
+		RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR
+	};
+	int i;
+
+	if (nl_open(&rtnl_ev_sk, NETLINK_ROUTE) < 0)
+		return -1;
+	for (i = 0; i < ARRAY_SIZE(groups); i++)
+		if (nl_join_group(&rtnl_ev_sk, groups[i]) < 0) {
+			/* IPv6 may be disabled */
+			if (groups[i] != RTNLGRP_IPV6_IFADDR)
+				nl_close(&rtnl_ev_sk);
+			break;
+		}
+	return rtnl_ev_sk.fd;
+}
+
+/** Return true if changes are tracked by notifications rather than polling. */
+bool rtnl_events_active(void)
+{
+	return rtnl_ev_sk.fd >= 0;
+}
+
+static int rtnl_event_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	bool *list_changed = arg;
+
+	switch (nlh->nlmsg_type) {
+	case RTM_NEWLINK:
+	case RTM_DELLINK: {
+		const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+		const struct nlattr *tb[IFLA_MAX + 1];
+		const char *ifname = NULL;
+		bool removed = nlh->nlmsg_type == RTM_DELLINK;
+
+		if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+			return 0;
+		nl_attr_parse(tb, IFLA_MAX, nl_msg_payload(nlh, sizeof(*ifi)),
+			      nl_msg_payload_len(nlh, sizeof(*ifi)));
+
+		/* Wireless events do not change the link state */
+		if (tb[IFLA_WIRELESS])
+			return 0;
+		if (tb[IFLA_IFNAME])
+			ifname = nl_attr_data(tb[IFLA_IFNAME]);
+
+		/* A registering interface reports all of its flags as changed */
+		if (if_handle_notify(ifi->ifi_index, ifname, removed) || removed ||
+		    ifi->ifi_change == ~0U)
+			*list_changed = true;
+		break;
+	}
+	case RTM_NEWADDR:
+	case RTM_DELADDR: {
+		const struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+
+		if (nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(*ifa)))
+			if_handle_notify(ifa->ifa_index, NULL, false);
+		break;
+	}
+	}
+	return 0;
+}
+
+/**
+ * rtnl_events_poll  -  process pending notifications without blocking
+ * Returns true if the set of interfaces may have changed.
+ */
+bool rtnl_events_poll(void)
+{
+	bool list_changed = false;
+	int len;
+
+	if (rtnl_ev_sk.fd < 0)
+		return false;
+
+	while ((len = nl_recv(&rtnl_ev_sk, 0)) != 0) {
+		if (len == -ENOBUFS) {
+			/* Notifications were lost: assume that everything changed */
+			if_handle_notify(0, NULL, false);
+			list_changed = true;
+		} else if (len < 0) {
+			break;
+		} else {
+			nl_parse(rtnl_ev_sk.buf, len, 0, rtnl_event_cb, &list_changed);
+		}
+	}
+	return list_changed;
+}
+
+/** Return true if link or addresses of @ifname changed since *@gen. */
+bool if_net_changed(const char *ifname, unsigned long *gen)
+{
+	unsigned long cur = if_handle_get(ifname)->net_gen;
+
+	if (cur == *gen)
+		return false;
+	*gen = cur;
+	return true;
+}
+
+/*
+ * Wireless extensions scan completion
+ *
+ * Drivers announce the availability of scan results with a SIOCGIWSCAN
+ * wireless event, which reaches userspace as IFLA_WIRELESS attribute of an
+ * RTM_NEWLINK notification. The scan thread listens for it on a socket of its
+ * own, so that it neither competes with the main loop for notifications nor
+ * needs to poll for results.
+ */
+static struct nl_sock rtnl_scan_sk = { .fd = -1 };
+
+/**
+ * struct rtnl_scan_wait  -  state of waiting for scan completion
+ * @ifindex:	interface the scan was triggered on
+ * @done:	whether a SIOCGIWSCAN event was seen for @ifindex
+ */
+struct rtnl_scan_wait {
+	int	ifindex;
+	bool	done;
+};
+
+static int rtnl_scan_event_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct rtnl_scan_wait *sw = arg;
+	const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+	const struct nlattr *tb[IFLA_MAX + 1];
+	const uint8_t *pos, *end;
+	uint16_t len, cmd;
+
+	if (nlh->nlmsg_type != RTM_NEWLINK ||
+	    nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)) ||
+	    ifi->ifi_index != sw->ifindex)
+		return 0;
+	nl_attr_parse(tb, IFLA_MAX, nl_msg_payload(nlh, sizeof(*ifi)),
+		      nl_msg_payload_len(nlh, sizeof(*ifi)));
+	if (!tb[IFLA_WIRELESS])
+		return 0;
+
+	/* Sequence of events, each starting with u16 length and u16 command. */
+	pos = nl_attr_data(tb[IFLA_WIRELESS]);
+	end = pos + nl_attr_len(tb[IFLA_WIRELESS]);
+	while (pos + IW_EV_LCP_PK_LEN <= end) {
+		memcpy(&len, pos, sizeof(len));
+		memcpy(&cmd, pos + sizeof(len), sizeof(cmd));
+		if (cmd == SIOCGIWSCAN)
+			sw->done = true;
+		if (len < IW_EV_LCP_PK_LEN)
+			break;
+		pos += len;
+	}
+	return 0;
+}
+
+/**
+ * rtnl_scan_events_init  -  prepare to wait for WE scan completion events
+ * Must be called before triggering the scan, to discard stale events (e.g.
+ * from an earlier scan that timed out). Returns 0 if ok, negative errno
+ * value if events are not available.
+ */
+int rtnl_scan_events_init(void)
+{
+	int ret;
+
+	if (rtnl_scan_sk.fd < 0) {
+		ret = nl_open(&rtnl_scan_sk, NETLINK_ROUTE);
+		if (ret == 0 && (ret = nl_join_group(&rtnl_scan_sk, RTNLGRP_LINK)) < 0)
+			nl_close(&rtnl_scan_sk);
+		if (ret < 0)
+			return ret;
+	}
+	while ((ret = nl_recv(&rtnl_scan_sk, 0)) > 0 || ret == -ENOBUFS)
+		;
+	return 0;
+}
+
+/**
+ * rtnl_scan_events_wait  -  wait for scan results on @ifindex
+ * @ifindex:  interface the scan was triggered on
+ * @deadline: CLOCK_MONOTONIC time until which to wait at most
+ * Returns 1 if the driver reported the scan as complete, 0 on timeout, or a
+ * negative errno value. Lost notifications (ENOBUFS) count as completion,
+ * since the scan event may have been among them.
+ */
+int rtnl_scan_events_wait(int ifindex, const struct timespec *deadline)
+{
+	struct rtnl_scan_wait sw = { .ifindex = ifindex };
+	struct timespec now;
+	int len, wait;
+
+	while (!sw.done) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wait = (deadline->tv_sec - now.tv_sec) * 1000 +
+		       (deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if (wait <= 0)
+			return 0;
+
+		len = nl_recv(&rtnl_scan_sk, wait);
+		if (len == -ENOBUFS)
+			return 1;
+		if (len < 0)
+			return len;
+		if (len > 0)
+			nl_parse(rtnl_scan_sk.buf, len, 0, rtnl_scan_event_cb, &sw);
+	}
+	return 1;
+}
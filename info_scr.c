@@ -21,29 +21,10 @@
 
 /* GLOBALS */
 static WINDOW *w_levels, *w_stats, *w_if, *w_info, *w_net;
-static struct timer dyn_updates;
+static int dyn_updates = -1;
+static unsigned long net_gen;
 static struct iw_stat cur;
-
-void sampling_init(void (*sampling_handler)(int))
-{
-	struct itimerval i;
-	div_t d = div(conf.stat_iv, 1000);	/* conf.stat_iv in msec */
-
-	xsignal(SIGALRM, SIG_IGN);
-	iw_getinf_range(conf_ifname(), &cur.range);
-	i.it_interval.tv_sec  = i.it_value.tv_sec  = d.quot;
-	i.it_interval.tv_usec = i.it_value.tv_usec = d.rem * 1000;
-	xsignal(SIGALRM, sampling_handler);
-
-	(*sampling_handler)(0);
-	setitimer(ITIMER_REAL, &i, NULL);
-}
-
-void sampling_do_poll(void)
-{
-	iw_getstat(&cur);
-	iw_cache_update(&cur);
-}
+static struct if_stat nstat;
 
 static void display_levels(void)
 {
@@ -138,11 +119,8 @@ done_levels:
 
 static void display_stats(void)
 {
-	struct if_stat nstat;
 	char tmp[0x100];
 
-	if_getstat(conf_ifname(), &nstat);
-
 	/*
 	 * Interface RX stats
 	 */
@@ -189,6 +167,12 @@ static void display_stats(void)
 	sprintf(tmp, "%u", cur.stat.miss.beacon);
 	waddstr_b(w_stats, tmp);
 
+	if (sampling_dropped()) {
+		waddstr(w_stats, ", dropped samples: ");
+		sprintf(tmp, "%lu", sampling_dropped());
+		waddstr_b(w_stats, tmp);
+	}
+
 	wclrtoborder(w_stats);
 	wrefresh(w_stats);
 }
@@ -501,16 +485,56 @@ static void display_netinfo(WINDOW *w_net)
 		waddstr_b(w_net, tmp);
 	}
 
+	if (getmaxy(w_net) == WH_NET_MAX) {
+		struct if_addr6 *a6 = info.addr6;
+		char addr6[INET6_ADDRSTRLEN];
+		int i;
+
+		wmove(w_net, 4, 1);
+		wclrtoborder(w_net);
+		waddstr(w_net, "ipv6: ");
+
+		/* Prefer a global-scope (RT_SCOPE_UNIVERSE) over link-local */
+		for (i = 0; i < info.num_addr6; i++)
+			if (info.addr6[i].scope == 0) {
+				a6 = info.addr6 + i;
+				break;
+			}
+
+		if (!info.num_addr6) {
+			waddstr_b(w_net, "n/a");
+		} else {
+			inet_ntop(AF_INET6, &a6->addr, addr6, sizeof(addr6));
+			sprintf(tmp, "%s/%u", addr6, a6->prefix_len);
+			waddstr_b(w_net, tmp);
+			if (info.num_addr6 > 1) {
+				sprintf(tmp, " (+%u more)", info.num_addr6 - 1);
+				waddstr(w_net, tmp);
+			}
+		}
+	}
+
 	wrefresh(w_net);
 }
 
-static void redraw_stat_levels(int signum)
+static void redraw_stat_levels(void)
 {
-	sampling_do_poll();
+	const struct iw_sample *sample = sampling_latest();
+
+	cur.stat = sample->stat;
+	cur.dbm	 = sample->dbm;
+	nstat	 = sample->net;
 	display_levels();
 	display_stats();
 }
 
+static void redraw_info(int fd)
+{
+	display_info(w_if, w_info);
+	if (!rtnl_events_active())
+		display_netinfo(w_net);
+}
+
 void scr_info_init(void)
 {
 	int line = 0;
@@ -529,24 +553,25 @@ void scr_info_init(void)
 		w_net = newwin_title(line, WH_NET_MIN, "Network", false);
 
 	display_info(w_if, w_info);
+	if_net_changed(conf_ifname(), &net_gen);
 	display_netinfo(w_net);
-	start_timer(&dyn_updates, conf.info_iv * 1000000);
-	sampling_init(redraw_stat_levels);
+	dyn_updates = timer_start(conf.info_iv * 1000, redraw_info);
+	iw_getinf_range(conf_ifname(), &cur.range);
+	redraw_stat_levels();
+	sampling_set_view(redraw_stat_levels);
 }
 
 int scr_info_loop(WINDOW *w_menu)
 {
-	if (end_timer(&dyn_updates)) {
-		display_info(w_if, w_info);
+	if (if_net_changed(conf_ifname(), &net_gen))
 		display_netinfo(w_net);
-		start_timer(&dyn_updates, conf.info_iv * 1000000);
-	}
 	return wgetch(w_menu);
 }
 
 void scr_info_fini(void)
 {
-	sampling_stop();
+	sampling_set_view(NULL);
+	timer_stop(dyn_updates);
 
 	delwin(w_net);
 	delwin(w_info);
@@ -18,6 +18,8 @@
  * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include "iw_if.h"
+#include "iw_nl80211.h"
+#include <fcntl.h>
 
 /* Determine the artificial spreading of random samples (best: 1..10) */
 #define WAVE_RAND_SPREAD	1
@@ -25,79 +27,189 @@
 #define WAVE_RAND_QUAL_MAX	100
 
 /*
- * Obtain network device information
+ * Per-interface ioctl handles
+ *
+ * Each interface that is queried gets one handle, holding a control socket
+ * and requests with the interface name already filled in. Handles live until
+ * the program exits, so that periodic sampling does not need to open and
+ * close a socket each time. Callers keep pointers to their handles, hence
+ * only the table of pointers is resized, while the handles never move.
  */
-static int if_get_flags(int skfd, const char *ifname)
+static struct if_handle **if_handles;
+static int		  if_handles_num, if_handles_max;
+static pthread_mutex_t	  if_handles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Look up the handle for @ifname, creating it on first use. */
+struct if_handle *if_handle_get(const char *ifname)
 {
+	struct if_handle *h;
 	struct ifreq ifr;
+	int i;
 
-	memset(&ifr, 0, sizeof(struct ifreq));
-	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+	pthread_mutex_lock(&if_handles_mutex);
+	for (i = 0; i < if_handles_num; i++) {
+		h = if_handles[i];
+		if (strncmp(h->ifname, ifname, IFNAMSIZ) == 0)
+			goto done;
+	}
 
-	if (ioctl(skfd, SIOCGIFFLAGS, &ifr) < 0)
-		err_sys("can not get interface flags for %s", ifname);
-	return ifr.ifr_flags;
+	if (if_handles_num == if_handles_max) {
+		if_handles_max = if_handles_max ? 2 * if_handles_max : 4;
+		if_handles = realloc(if_handles, if_handles_max * sizeof(*if_handles));
+		if (if_handles == NULL)
+			err_sys("can not allocate interface handles");
+	}
+
+	h = calloc(1, sizeof(*h));
+	if (h == NULL)
+		err_sys("malloc(interface handle)");
+
+	h->skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (h->skfd < 0)
+		err_sys("%s: can not open socket", __func__);
+
+	strncpy(h->ifname, ifname, IFNAMSIZ - 1);
+	strncpy(h->ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	strncpy(h->iwr.ifr_name, ifname, IFNAMSIZ - 1);
+	h->nl80211 = -1;
+	pthread_mutex_init(&h->range_lock, NULL);
+	if_handles[if_handles_num++] = h;
+
+	ifr = h->ifr;
+	if (if_ioctl(h, SIOCGIFINDEX, &ifr) == 0)
+		h->ifindex = ifr.ifr_ifindex;
+done:
+	pthread_mutex_unlock(&if_handles_mutex);
+	return h;
 }
 
-/* Return true if @ifname is known to be up. */
-bool if_is_up(int skfd, const char *ifname)
+/**
+ * if_handle_notify  -  apply a link or address change notification
+ * @ifindex:	interface index the notification refers to (0 = all)
+ * @ifname:	current name of @ifindex, NULL for address-only changes
+ * @removed:	whether @ifindex has disappeared
+ * Updates the interface index of affected handles and bumps their @net_gen.
+ * Link changes also drop the cached ioctl probe results and range data.
+ * Returns true if @ifindex turned out to have been renamed.
+ */
+bool if_handle_notify(int ifindex, const char *ifname, bool removed)
 {
-	return if_get_flags(skfd, ifname) & IFF_UP;
+	struct if_handle *h;
+	bool renamed = false, same_name;
+	int i;
+
+	pthread_mutex_lock(&if_handles_mutex);
+	for (i = 0; i < if_handles_num; i++) {
+		h = if_handles[i];
+		same_name = ifname && strncmp(h->ifname, ifname, IFNAMSIZ) == 0;
+		if (ifindex && h->ifindex != ifindex && !same_name)
+			continue;
+
+		if (!ifindex) {
+			/* nothing known about what changed */
+		} else if (removed) {
+			if (h->ifindex == ifindex)
+				h->ifindex = 0;
+		} else if (ifname && !same_name) {
+			/* @ifindex now goes by another name */
+			h->ifindex = 0;
+			renamed	   = true;
+		} else if (h->ifindex != ifindex) {
+			/* interface re-created under the same name */
+			h->ifindex = ifindex;
+			h->nl80211 = -1;
+		}
+		h->net_gen++;
+
+		if (ifname || !ifindex) {
+			h->iw_unsupported = 0;
+			pthread_mutex_lock(&h->range_lock);
+			h->range_valid = false;
+			pthread_mutex_unlock(&h->range_lock);
+		}
+	}
+	pthread_mutex_unlock(&if_handles_mutex);
+	return renamed;
 }
 
-/** Bring @ifname up if not already up. Return 0 if ok, < 0 on error. */
-int if_set_up(const char *ifname)
+/**
+ * Issue @request on @h, counting system calls. @req is an ifreq or iwreq.
+ * Wireless-extensions requests that the driver does not implement fail with
+ * EOPNOTSUPP; these are remembered and not issued again.
+ */
+int if_ioctl(struct if_handle *h, unsigned long request, void *req)
 {
-	struct ifreq ifr;
-	int ret, skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	uint64_t bit = 0;
 
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
+	if (request >= SIOCIWFIRST && request - SIOCIWFIRST < 64) {
+		bit = 1ULL << (request - SIOCIWFIRST);
+		if (h->iw_unsupported & bit) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+	}
+
+	__sync_fetch_and_add(&h->ioctls, 1);
+	if (ioctl(h->skfd, request, req) == 0)
+		return 0;
+	if (bit && errno == EOPNOTSUPP)
+		__sync_fetch_and_or(&h->iw_unsupported, bit);
+	return -1;
+}
 
-	memset(&ifr, 0, sizeof(ifr));
-	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+/*
+ * Obtain network device information
+ */
+static int if_get_flags(struct if_handle *h)
+{
+	struct ifreq ifr = h->ifr;
+
+	if (if_ioctl(h, SIOCGIFFLAGS, &ifr) < 0)
+		err_sys("can not get interface flags for %s", h->ifname);
+	return ifr.ifr_flags;
+}
+
+/** Bring @ifname up if not already up. Return 0 if ok, < 0 on error. */
+int if_set_up(const char *ifname)
+{
+	struct if_handle *h = if_handle_get(ifname);
+	struct ifreq ifr = h->ifr;
 
-	ifr.ifr_flags = if_get_flags(skfd, ifname);
+	ifr.ifr_flags = if_get_flags(h);
 	if (ifr.ifr_flags & IFF_UP)
 		return 0;
 
 	ifr.ifr_flags |= IFF_UP;
-	ret = ioctl(skfd, SIOCSIFFLAGS, &ifr);
-	close(skfd);
-	return ret;
+	return if_ioctl(h, SIOCSIFFLAGS, &ifr);
 }
 
-/* Interface information */
+/* Interface information, via ioctls if rtnetlink is not available */
 void if_getinf(const char *ifname, struct if_info *info)
 {
-	struct ifreq ifr;
-	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct if_handle *h = if_handle_get(ifname);
+	struct ifreq ifr = h->ifr;
 
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
-
-	memset(&ifr, 0, sizeof(struct ifreq));
+	if (rtnl_getinf(ifname, info) == 0)
+		return;
 	memset(info, 0, sizeof(struct if_info));
 
-	info->flags = if_get_flags(skfd, ifname);
+	info->flags = if_get_flags(h);
 
-	strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
-	if (ioctl(skfd, SIOCGIFMTU, &ifr) == 0)
+	if (if_ioctl(h, SIOCGIFMTU, &ifr) == 0)
 		info->mtu = ifr.ifr_mtu;
 
-	if (ioctl(skfd, SIOCGIFTXQLEN, &ifr) >= 0)
+	if (if_ioctl(h, SIOCGIFTXQLEN, &ifr) >= 0)
 		info->txqlen = ifr.ifr_qlen;
 
 	/* Copy the 6 byte Ethernet address and the 4 byte struct in_addrs */
-	if (ioctl(skfd, SIOCGIFHWADDR, &ifr) >= 0)
+	if (if_ioctl(h, SIOCGIFHWADDR, &ifr) >= 0)
 		memcpy(&info->hwaddr, &ifr.ifr_hwaddr.sa_data, 6);
-	if (ioctl(skfd, SIOCGIFADDR, &ifr) >= 0)
+	if (if_ioctl(h, SIOCGIFADDR, &ifr) >= 0)
 		memcpy(&info->addr, &ifr.ifr_addr.sa_data[2], 4);
-	if (ioctl(skfd, SIOCGIFNETMASK, &ifr) >= 0)
+	if (if_ioctl(h, SIOCGIFNETMASK, &ifr) >= 0)
 		memcpy(&info->netmask, &ifr.ifr_netmask.sa_data[2], 4);
-	if (ioctl(skfd, SIOCGIFBRDADDR, &ifr) >= 0)
+	if (if_ioctl(h, SIOCGIFBRDADDR, &ifr) >= 0)
 		memcpy(&info->bcast, &ifr.ifr_broadaddr.sa_data[2], 4);
-	close(skfd);
 }
 
 /**
@@ -106,15 +218,22 @@ void if_getinf(const char *ifname, struct if_info *info)
  * Use the safe route of checking /proc/net/dev/ for wireless interfaces:
  * - SIOCGIFCONF only returns running interfaces that have an IP address;
  * - /proc/net/wireless may exist, but may not list all wireless interfaces.
+ * Interfaces known to nl80211 count as wireless, even without wireless
+ * extensions support.
  */
 void iw_get_interface_list(char** if_list, size_t max_entries)
 {
 	char *p, tmp[BUFSIZ];
 	int  nifs = 1;		/* if_list[nifs-1] = NULL */
+	char nl_ifs[max_entries][IFNAMSIZ];
+	size_t i, num_nl_ifs = 0;
 	struct iwreq wrq;
 	FILE *fp;
 	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
 
+	if (conf.backend != BE_WEXT)
+		num_nl_ifs = iw_nl80211_get_interface_list(nl_ifs, max_entries);
+
 	if (skfd < 0)
 		err_sys("%s: can not open socket", __func__);
 
@@ -130,8 +249,11 @@ void iw_get_interface_list(char** if_list, size_t max_entries)
 			 * Use SIOCGIWNAME as indicator: if interface does not
 			 * support this ioctl, it has no wireless extensions.
 			 */
+			for (i = 0; i < num_nl_ifs; i++)
+				if (strncmp(nl_ifs[i], p, IFNAMSIZ) == 0)
+					break;
 			snprintf(wrq.ifr_name, IFNAMSIZ, "%s", p);
-			if (ioctl(skfd, SIOCGIWNAME, &wrq) < 0)
+			if (i == num_nl_ifs && ioctl(skfd, SIOCGIWNAME, &wrq) < 0)
 				continue;
 			if(nifs >= max_entries) break;
 			if_list[nifs-1] = strdup(p);
@@ -149,8 +271,12 @@ void if_getstat(const char *ifname, struct if_stat *stat)
 	char *lp;
 	size_t l = strlen(ifname);
 	const char path[] = "/proc/net/dev";
-	FILE *fp = fopen(path, "r");
+	FILE *fp;
 
+	if (rtnl_getstat(ifname, stat) == 0)
+		return;
+
+	fp = fopen(path, "r");
 	if (fp == NULL)
 		err_sys("can not open %s", path);
 	/*
@@ -180,30 +306,32 @@ void if_getstat(const char *ifname, struct if_stat *stat)
 void dyn_info_get(struct iw_dyn_info *info,
 		  const char *ifname, struct iw_range *ir)
 {
-	struct iwreq iwr;
-	int i, skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct if_handle *h = if_handle_get(ifname);
+	struct iwreq iwr = h->iwr;
+	int i;
 
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
+	if (iw_nl80211_active(ifname)) {
+		iw_nl80211_get_dyn_info(info, ifname);
+		return;
+	}
 
 	memset(info, 0, sizeof(struct iw_dyn_info));
-	strncpy(iwr.ifr_name, ifname, IFNAMSIZ);
 
-	if (ioctl(skfd, SIOCGIWNAME, &iwr) < 0)
+	if (if_ioctl(h, SIOCGIWNAME, &iwr) < 0)
 		err_sys("can not open device '%s'", ifname);
 	strncpy(info->name, iwr.u.name, IFNAMSIZ);
 
 	iwr.u.essid.pointer = (caddr_t) info->essid;
 	iwr.u.essid.length  = sizeof(info->essid);
 	iwr.u.essid.flags   = 0;
-	if (ioctl(skfd, SIOCGIWESSID, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWESSID, &iwr) >= 0) {
 		info->cap_essid = 1;
 		/* Convert potential ESSID index to count > 0 */
 		info->essid_ct  = iwr.u.essid.flags & IW_ENCODE_INDEX ?  : 1;
 		info->essid[iwr.u.essid.length] = '\0';
 	}
 
-	if (ioctl(skfd, SIOCGIWNWID, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWNWID, &iwr) >= 0) {
 		info->cap_nwid = 1;
 		memcpy(&info->nwid, &iwr.u.nwid, sizeof(info->nwid));
 	}
@@ -211,49 +339,49 @@ void dyn_info_get(struct iw_dyn_info *info,
 	iwr.u.essid.pointer = (caddr_t) info->nickname;
 	iwr.u.essid.length  = sizeof(info->nickname);
 	iwr.u.essid.flags   = 0;
-	if (ioctl(skfd, SIOCGIWNICKN, &iwr) >= 0 &&
+	if (if_ioctl(h, SIOCGIWNICKN, &iwr) >= 0 &&
 	    iwr.u.data.length > 1)
 		info->cap_nickname = 1;
 
-	if (ioctl(skfd, SIOCGIWFREQ, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWFREQ, &iwr) >= 0) {
 		info->cap_freq = 1;
 		info->freq     = freq_to_hz(&iwr.u.freq);
 	}
 
-	if (ioctl(skfd, SIOCGIWSENS, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWSENS, &iwr) >= 0) {
 		info->cap_sens = 1;
 		info->sens     = iwr.u.sens.value;
 	}
 
-	if (ioctl(skfd, SIOCGIWRATE, &iwr) >= 0)
+	if (if_ioctl(h, SIOCGIWRATE, &iwr) >= 0)
 		info->bitrate = iwr.u.bitrate.value;
 
-	if (ioctl(skfd, SIOCGIWTXPOW, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWTXPOW, &iwr) >= 0) {
 		info->cap_txpower = 1;
 		memcpy(&info->txpower, &iwr.u.txpower, sizeof(info->txpower));
 	}
 
-	if (ioctl(skfd, SIOCGIWPOWER, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWPOWER, &iwr) >= 0) {
 		info->cap_power = 1;
 		memcpy(&info->power, &iwr.u.power, sizeof(info->power));
 	}
 
-	if (ioctl(skfd, SIOCGIWRETRY, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWRETRY, &iwr) >= 0) {
 		info->cap_retry = 1;
 		memcpy(&info->retry, &iwr.u.retry, sizeof(info->retry));
 	}
 
-	if (ioctl(skfd, SIOCGIWRTS, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWRTS, &iwr) >= 0) {
 		info->cap_rts = 1;
 		memcpy(&info->rts, &iwr.u.rts, sizeof(info->rts));
 	}
 
-	if (ioctl(skfd, SIOCGIWFRAG, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWFRAG, &iwr) >= 0) {
 		info->cap_frag = 1;
 		memcpy(&info->frag, &iwr.u.frag, sizeof(info->frag));
 	}
 
-	if (ioctl(skfd, SIOCGIWMODE, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWMODE, &iwr) >= 0) {
 		info->cap_mode = 1;
 		info->mode     = iwr.u.mode;
 	}
@@ -268,7 +396,7 @@ void dyn_info_get(struct iw_dyn_info *info,
 		iwr.u.data.pointer = info->keys[0].key;
 		iwr.u.data.length  = sizeof(info->keys[0].key);
 		iwr.u.data.flags   = 0;
-		if (ioctl(skfd, SIOCGIWENCODE, &iwr) < 0) {
+		if (if_ioctl(h, SIOCGIWENCODE, &iwr) < 0) {
 			free(info->keys);
 			info->keys  = NULL;
 			info->nkeys = 0;
@@ -281,7 +409,7 @@ void dyn_info_get(struct iw_dyn_info *info,
 		iwr.u.data.pointer = info->keys[i].key;
 		iwr.u.data.length  = sizeof(info->keys->key);
 		iwr.u.data.flags   = i + 1;	/* counts 1..n instead of 0..n-1 */
-		if (ioctl(skfd, SIOCGIWENCODE, &iwr) < 0) {
+		if (if_ioctl(h, SIOCGIWENCODE, &iwr) < 0) {
 			free(info->keys);
 			info->nkeys = 0;
 			break;
@@ -295,11 +423,10 @@ void dyn_info_get(struct iw_dyn_info *info,
 			info->active_key = 0;
 	}
 
-	if (ioctl(skfd, SIOCGIWAP, &iwr) >= 0) {
+	if (if_ioctl(h, SIOCGIWAP, &iwr) >= 0) {
 		info->cap_ap = 1;
 		memcpy(&info->ap_addr, &iwr.u.ap_addr, sizeof(struct sockaddr));
 	}
-	close(skfd);
 }
 
 void dyn_info_cleanup(struct iw_dyn_info *info)
@@ -311,26 +438,33 @@ void dyn_info_cleanup(struct iw_dyn_info *info)
 
 /*
  * Request range information for a given wireless interface.
+ * The result is cached in the interface handle until the next link change.
  * @ifname: name of the wireless argument
  * @range:  storage location to populate with range information.
  */
 void iw_getinf_range(const char *ifname, struct iw_range *range)
 {
-	struct iwreq iwr;
-	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct if_handle *h = if_handle_get(ifname);
+	struct iwreq iwr = h->iwr;
 
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
+	if (iw_nl80211_active(ifname)) {
+		iw_nl80211_getinf_range(range);
+		return;
+	}
 
-	memset(range, 0, sizeof(struct iw_range));
-	strncpy(iwr.ifr_name, ifname, IFNAMSIZ);
+	pthread_mutex_lock(&h->range_lock);
+	if (!h->range_valid) {
+		memset(&h->range, 0, sizeof(struct iw_range));
 
-	iwr.u.data.pointer = (caddr_t) range;
-	iwr.u.data.length  = sizeof(struct iw_range);
-	iwr.u.data.flags   = 0;
-	if (ioctl(skfd, SIOCGIWRANGE, &iwr) < 0)
-		err_sys("can not get range information");
-	close(skfd);
+		iwr.u.data.pointer = (caddr_t) &h->range;
+		iwr.u.data.length  = sizeof(struct iw_range);
+		iwr.u.data.flags   = 0;
+		if (if_ioctl(h, SIOCGIWRANGE, &iwr) < 0)
+			err_sys("can not get range information");
+		h->range_valid = true;
+	}
+	memcpy(range, &h->range, sizeof(struct iw_range));
+	pthread_mutex_unlock(&h->range_lock);
 }
 
 /*
@@ -377,20 +511,16 @@ static void iw_getstat_random(struct iw_stat *iw)
 					    0, iw->range.max_qual.qual);
 }
 
-static void iw_getstat_real(struct iw_statistics *stat)
+static void iw_getstat_real(const char *ifname, struct iw_statistics *stat)
 {
-	struct iwreq wrq;
-	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
-
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
+	struct if_handle *h = if_handle_get(ifname);
+	struct iwreq wrq = h->iwr;
 
 	wrq.u.data.pointer = (caddr_t) stat;
 	wrq.u.data.length  = sizeof(*stat);
 	wrq.u.data.flags   = 0;
-	strncpy(wrq.ifr_name, conf_ifname(), IFNAMSIZ);
 
-	if (ioctl(skfd, SIOCGIWSTATS, &wrq) < 0) {
+	if (if_ioctl(h, SIOCGIWSTATS, &wrq) < 0) {
 		/*
 		 * iw_handler_get_iwstats() returns EOPNOTSUPP if
 		 * there are no statistics. Bail out in this case.
@@ -400,7 +530,183 @@ static void iw_getstat_real(struct iw_statistics *stat)
 		errno = 0;
 		memset(&wrq, 0, sizeof(wrq));
 	}
-	close(skfd);
+}
+
+/*
+ * Batch sampling via /proc/net/wireless
+ *
+ * The file lists the statistics of all wireless-extensions interfaces, so
+ * that a single pread(2) samples any number of interfaces. The descriptor is
+ * kept open; procfs regenerates the contents when reading from offset 0.
+ *
+ * Inter-| sta-|   Quality        |   Discarded packets               | Missed | WE
+ *  face | tus | link level noise |  nwid  crypt   frag  retry   misc | beacon | 22
+ *  wlan0: 0000   54.  -56.  -256        0      0      0      0      0        0
+ *
+ * A '.' after a quality value means that the value has been updated. Level
+ * and noise are printed as negative numbers (value - 0x100) if the driver
+ * reports dBm values (IW_QUAL_DBM).
+ */
+#define PROC_NET_WIRELESS	"/proc/net/wireless"
+
+static int proc_wireless_fd = -1;
+
+/* Parse a decimal integer at @p, return pointer after it or NULL. */
+static const char *parse_int(const char *p, const char *end, long *val)
+{
+	bool neg = false;
+
+	while (p < end && *p == ' ')
+		p++;
+	if (p < end && *p == '-') {
+		neg = true;
+		p++;
+	}
+	if (p >= end || !isdigit(*p))
+		return NULL;
+	for (*val = 0; p < end && isdigit(*p); p++)
+		*val = *val * 10 + *p - '0';
+	if (neg)
+		*val = -*val;
+	return p;
+}
+
+/**
+ * iw_proc_parse_line  -  parse the statistics of one line of /proc/net/wireless
+ * @p:	    start of the statistics, after the colon that ends the name
+ * @end:    end of line (excluding '\n')
+ * @range:  range information of the interface, for the units of the levels
+ * @stat:   statistics to fill in
+ * Returns false if the line is incomplete.
+ */
+static bool iw_proc_parse_line(const char *p, const char *end,
+			       const struct iw_range *range,
+			       struct iw_statistics *stat)
+{
+	struct iw_quality *qual = &stat->qual;
+	long val, level, noise;
+
+	/* Status is in hex */
+	for (; p < end && *p == ' '; p++)
+		;
+	for (stat->status = 0; p < end && isxdigit(*p); p++)
+		stat->status = stat->status << 4 |
+			       (isdigit(*p) ? *p - '0' : (tolower(*p) - 'a' + 10));
+
+	memset(qual, 0, sizeof(*qual));
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	qual->qual = val;
+	if (p < end && *p == '.')
+		p++, qual->updated |= IW_QUAL_QUAL_UPDATED;
+
+	if (!(p = parse_int(p, end, &level)))
+		return false;
+	if (p < end && *p == '.')
+		p++, qual->updated |= IW_QUAL_LEVEL_UPDATED;
+
+	if (!(p = parse_int(p, end, &noise)))
+		return false;
+	if (p < end && *p == '.')
+		p++, qual->updated |= IW_QUAL_NOISE_UPDATED;
+
+	/*
+	 * The unit flags are not listed. Drivers declare them in the range,
+	 * with the same IW_QUAL_DBM/IW_QUAL_RCPI flags as in their statistics.
+	 * For drivers that do not, negative values still mean dBm, since the
+	 * kernel lists dBm values (u8) less 0x100.
+	 */
+	qual->updated |= range->max_qual.updated & (IW_QUAL_DBM | IW_QUAL_RCPI);
+	if (level < 0 || noise < 0)
+		qual->updated |= IW_QUAL_DBM;
+
+	if (qual->updated & IW_QUAL_DBM) {
+		/* A zero u8 value in dBm mode means 'not available' */
+		if (level == -0x100)
+			qual->updated |= IW_QUAL_LEVEL_INVALID;
+		if (noise == -0x100)
+			qual->updated |= IW_QUAL_NOISE_INVALID;
+		if (level < 0)
+			level += 0x100;
+		if (noise < 0)
+			noise += 0x100;
+	}
+	qual->level = level;
+	qual->noise = noise;
+
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->discard.nwid = val;
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->discard.code = val;
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->discard.fragment = val;
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->discard.retries = val;
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->discard.misc = val;
+	if (!(p = parse_int(p, end, &val)))
+		return false;
+	stat->miss.beacon = val;
+	return true;
+}
+
+/**
+ * iw_proc_getstat  -  read statistics of @n interfaces in one pass
+ * @ifnames: names of the interfaces
+ * @iw:	     statistics of @ifnames[i] are stored in @iw[i].stat, using the
+ *	     range information in @iw[i].range
+ * @found:   @found[i] is set if @ifnames[i] is listed, interfaces whose entry
+ *	     is already set are skipped
+ * @n:	     number of entries in @ifnames, @iw and @found
+ * Costs a single system call, the file is kept open between samples.
+ * Returns the number of interfaces found.
+ */
+static size_t iw_proc_getstat(const char *const *ifnames, struct iw_stat *iw,
+			      bool *found, size_t n)
+{
+	char buf[8192];
+	const char *line, *eol, *end, *colon;
+	struct iw_statistics tmp;
+	size_t i, len, num_found = 0;
+	ssize_t bytes;
+
+	if (proc_wireless_fd < 0) {
+		proc_wireless_fd = open(PROC_NET_WIRELESS, O_RDONLY | O_CLOEXEC);
+		if (proc_wireless_fd < 0)
+			return 0;
+	}
+
+	bytes = pread(proc_wireless_fd, buf, sizeof(buf), 0);
+	if (bytes <= 0)
+		return 0;
+	end = buf + bytes;
+
+	/* The last line may be incomplete if the buffer was too small */
+	for (line = buf; (eol = memchr(line, '\n', end - line)); line = eol + 1) {
+		while (line < eol && *line == ' ')
+			line++;
+		colon = memchr(line, ':', eol - line);
+		if (colon == NULL)
+			continue;
+		len = colon - line;
+
+		for (i = 0; i < n; i++)
+			if (!found[i] && strlen(ifnames[i]) == len &&
+			    strncmp(ifnames[i], line, len) == 0)
+				break;
+		if (i == n || !iw_proc_parse_line(colon + 1, eol, &iw[i].range, &tmp))
+			continue;
+
+		iw[i].stat = tmp;
+		found[i]   = true;
+		num_found++;
+	}
+	return num_found;
 }
 
 /*
@@ -464,16 +770,50 @@ void iw_sanitize(struct iw_range *range, struct iw_quality *qual,
 		qual->updated |= IW_QUAL_NOISE_INVALID;
 }
 
-void iw_getstat(struct iw_stat *iw)
+/**
+ * iw_getstat_batch  -  sample wireless statistics of several interfaces
+ * @ifnames: names of the interfaces
+ * @iw:	     @iw[i].stat receives the statistics of @ifnames[i], using the
+ *	     range information in @iw[i].range
+ * @n:	     number of entries in @ifnames and @iw
+ * Interfaces handled by nl80211 are queried individually. All others that are
+ * listed in /proc/net/wireless are read with a single system call, and only the
+ * remaining ones (e.g. without WEXT compatibility) use SIOCGIWSTATS.
+ */
+void iw_getstat_batch(const char *const *ifnames, struct iw_stat *iw, size_t n)
 {
-	memset(&iw->stat, 0, sizeof(iw->stat));
+	bool found[n];
+	bool wext = false;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		memset(&iw[i].stat, 0, sizeof(iw[i].stat));
+		found[i] = iw_nl80211_active(ifnames[i]);
+		if (found[i])
+			iw_nl80211_getstat(ifnames[i], &iw[i].stat);
+		else
+			wext = true;
+	}
 
-	if (conf.random)
-		iw_getstat_random(iw);
-	else
-		iw_getstat_real(&iw->stat);
+	if (wext)
+		iw_proc_getstat(ifnames, iw, found, n);
 
-	iw_sanitize(&iw->range, &iw->stat.qual, &iw->dbm);
+	for (i = 0; i < n; i++) {
+		if (!found[i])
+			iw_getstat_real(ifnames[i], &iw[i].stat);
+		iw_sanitize(&iw[i].range, &iw[i].stat.qual, &iw[i].dbm);
+	}
+}
+
+void iw_getstat(const char *ifname, struct iw_stat *iw)
+{
+	if (conf.random) {
+		memset(&iw->stat, 0, sizeof(iw->stat));
+		iw_getstat_random(iw);
+		iw_sanitize(&iw->range, &iw->stat.qual, &iw->dbm);
+	} else {
+		iw_getstat_batch(&ifname, iw, 1);
+	}
 }
 
 const char *we_version(void)
@@ -481,12 +821,46 @@ const char *we_version(void)
 	static char buf[BUFSIZ];
 	struct iw_stat iw;
 
+	if (iw_nl80211_active(conf_ifname()))
+		return "nl80211";
+
 	iw_getinf_range(conf_ifname(), &iw.range);
 	sprintf(buf, "wireless extensions v%d (source v%d)",
 	       iw.range.we_version_compiled, iw.range.we_version_source);
 	return buf;
 }
 
+/* Levels of all wireless interfaces, sampled together by iw_getstat_batch(). */
+static void dump_all_levels(void)
+{
+	const char *const *ifnames = conf_iflist();
+	struct iw_stat *iw;
+	size_t i, n;
+
+	for (n = 0; ifnames[n]; n++)
+		;
+	if (n < 2 || conf.random)
+		return;
+
+	iw = calloc(n, sizeof(*iw));
+	if (!iw)
+		err_sys("can not allocate statistics");
+	for (i = 0; i < n; i++)
+		iw_getinf_range(ifnames[i], &iw[i].range);
+	iw_getstat_batch(ifnames, iw, n);
+
+	printf("\n");
+	for (i = 0; i < n; i++) {
+		printf("%17s: %d/%d", ifnames[i], iw[i].stat.qual.qual,
+		       iw[i].range.max_qual.qual);
+		if (iw[i].stat.qual.updated & IW_QUAL_LEVEL_INVALID)
+			printf(", signal n/a\n");
+		else
+			printf(", signal %.0f dBm\n", iw[i].dbm.signal);
+	}
+	free(iw);
+}
+
 void dump_parameters(void)
 {
 	struct iw_dyn_info info;
@@ -496,7 +870,7 @@ void dump_parameters(void)
 
 	iw_getinf_range(conf_ifname(), &iw.range);
 	dyn_info_get(&info, conf_ifname(), &iw.range);
-	iw_getstat(&iw);
+	iw_getstat(conf_ifname(), &iw);
 	if_getstat(conf_ifname(), &nstat);
 
 	printf("\n");
@@ -657,6 +1031,12 @@ void dump_parameters(void)
 	       byte_units(nstat.tx_bytes));
 	printf(" exc. MAC retries: %'u\n", iw.stat.discard.retries);
 
+	dump_all_levels();
+
+	/* Cost of obtaining all of the above */
+	printf("\n");
+	printf("   ioctl requests: %'lu\n", if_handle_get(conf_ifname())->ioctls);
+
 	printf("\n");
 	dyn_info_cleanup(&info);
 }
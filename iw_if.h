@@ -50,6 +50,41 @@
  */
 #define NOISE_DBM_SANE_MIN	-127
 
+/**
+ * struct if_handle  -  long-lived ioctl context of a network interface
+ * @ifname:	name of the interface
+ * @skfd:	control socket, kept open for the lifetime of the handle
+ * @ifr:	netdevice(7) request with @ifname already filled in
+ * @iwr:	wireless-extensions request with @ifname already filled in
+ * @ifindex:	interface index (0 if the interface does not exist)
+ * @nl80211:	whether nl80211 supports the interface (-1 = not yet known)
+ * @ioctls:	number of ioctl(2) system calls issued through this handle
+ * @net_gen:	incremented on each link/address change notification
+ * @iw_unsupported: bitmask of wireless-extensions ioctls (indexed relative to
+ *		SIOCIWFIRST) that the driver has reported as not supported
+ * @range_lock:	serializes access to @range and @range_valid
+ * @range:	cached result of SIOCGIWRANGE
+ * @range_valid: whether @range holds current data
+ * The probe results and @range are kept until the next link notification.
+ */
+struct if_handle {
+	char		ifname[IFNAMSIZ];
+	int		skfd;
+	struct ifreq	ifr;
+	struct iwreq	iwr;
+	int		ifindex;
+	int8_t		nl80211;
+	unsigned long	ioctls;
+	unsigned long	net_gen;
+	uint64_t	iw_unsupported;
+	pthread_mutex_t	range_lock;
+	struct iw_range	range;
+	bool		range_valid;
+};
+extern struct if_handle *if_handle_get(const char *ifname);
+extern bool if_handle_notify(int ifindex, const char *ifname, bool removed);
+extern int if_ioctl(struct if_handle *h, unsigned long request, void *req);
+
 /**
  * struct if_info  -  wireless interface network information
  * @hwaddr:		MAC address
@@ -59,6 +94,8 @@
  * @mtu:		interface MTU
  * @txqlen:		tx queue length
  * @flags:		interface flags
+ * @addr6:		IPv6 interface addresses (only available via rtnetlink)
+ * @num_addr6:		number of valid entries in @addr6
  * See also netdevice(7)
  */
 struct if_info {
@@ -66,12 +103,21 @@ struct if_info {
 	struct in_addr		addr,
 				netmask,
 				bcast;
-	uint16_t		mtu;
-	uint16_t		txqlen;
-	uint16_t		flags;
+	uint32_t		mtu;
+	uint32_t		txqlen;
+	uint32_t		flags;
+#define IF_MAX_ADDR6	4
+	struct if_addr6 {
+		struct in6_addr	addr;
+		uint8_t		prefix_len;
+		uint8_t		scope;
+	}			addr6[IF_MAX_ADDR6];
+	uint8_t			num_addr6;
 };
 extern int  if_set_up(const char *ifname);
 extern void if_getinf(const char *ifname, struct if_info *info);
+extern int  rtnl_getinf(const char *ifname, struct if_info *info);
+extern bool if_net_changed(const char *ifname, unsigned long *gen);
 
 /**
  * struct iw_key  -  Encoding information
@@ -190,6 +236,7 @@ struct if_stat {
 };
 
 extern void if_getstat(const char *ifname, struct if_stat *stat);
+extern int  rtnl_getstat(const char *ifname, struct if_stat *stat);
 
 /*
  *	 Structs to communicate WiFi statistics
@@ -218,92 +265,438 @@ struct iw_stat {
 	struct iw_levelstat	dbm;
 };
 
+/**
+ * struct iw_sample  -  one acquisition of the sampler thread
+ * @ts:		CLOCK_MONOTONIC time at which the sample was taken
+ * @stat:	wireless statistics, sanitized against the range information
+ * @dbm:	the noise/signal of @stat in dBm
+ * @net:	packet/byte counters of the interface
+ */
+struct iw_sample {
+	struct timespec		ts;
+	struct iw_statistics	stat;
+	struct iw_levelstat	dbm;
+	struct if_stat		net;
+};
+
 /*
- * 	Periodic sampling of wireless statistics via timer alarm
+ * 	Periodic sampling of wireless statistics by a separate thread
  */
-extern void iw_getstat(struct iw_stat *stat);
-extern void iw_cache_update(struct iw_stat *stat);
+extern void iw_getstat(const char *ifname, struct iw_stat *stat);
+extern void iw_getstat_batch(const char *const *ifnames, struct iw_stat *iw,
+			     size_t n);
+extern void iw_cache_update(const struct iw_sample *sample);
+extern void iw_cache_reset(void);
 
-extern void sampling_init(void (*sampling_handler)(int));
-extern void sampling_do_poll(void);
-static inline void sampling_stop(void)	{ alarm(0); }
+/* Lateness histogram: bucket i counts wake-ups < SAMPLE_LATE_MIN_US << i */
+#define SAMPLE_LATE_BUCKETS	12
+#define SAMPLE_LATE_MIN_US	32
+
+/**
+ * struct sampling_stats  -  timing quality of the sampler thread
+ * @late:	histogram of how long after its deadline each sample was taken
+ * @late_max_us: largest lateness observed, in microseconds
+ * @missed:	deadlines skipped since the sampler was more than a period late
+ * @dropped:	samples lost because the consumer fell behind
+ * @realtime:	whether the sampler runs with SCHED_FIFO priority
+ */
+struct sampling_stats {
+	unsigned long	late[SAMPLE_LATE_BUCKETS];
+	unsigned long	late_max_us;
+	unsigned long	missed;
+	unsigned long	dropped;
+	bool		realtime;
+};
+
+extern void sampling_init(void);
+extern void sampling_set_view(void (*handler)(void));
+extern const struct iw_sample *sampling_latest(void);
+extern unsigned long sampling_dropped(void);
+extern void sampling_get_stats(struct sampling_stats *stats);
+extern unsigned long sampling_late_percentile(const struct sampling_stats *stats,
+					      unsigned int pct);
+extern void sampling_stop(void);
 
 /*
  *	Organization of scan results
  */
+/**
+ * struct bss_stats  -  what earlier scans have shown about a station
+ * @sig_avg:	smoothed signal level in dBm
+ * @seen:	number of distinct observations
+ * @known_s:	seconds since the station was first seen
+ * @sig_min:	lowest signal level seen in dBm
+ * @sig_max:	highest signal level seen in dBm
+ * @trend:	direction of the last change of signal level (-1, 0, 1)
+ * @stale:	missed by the latest scan, shown as last seen by an earlier one
+ * The signal statistics are 0 if no valid signal level was reported.
+ */
+struct bss_stats {
+	float		sig_avg;
+	uint32_t	seen;
+	uint32_t	known_s;
+	int8_t		sig_min,
+			sig_max,
+			trend;
+	bool		stale;
+};
+
 /**
  * struct scan_entry  -  Representation of a single scan result.
+ * @next:	next entry in list
+ * @ie:		Information Elements not yet decoded into @flags (or NULL)
+ * @dbm:	signal and noise levels in dBm
+ * @flags:	properties gathered from Information Elements
+ * @freq:	frequency in MHz (0 if the driver only reported a channel),
+ *		60 GHz (802.11ad/ay) channels go beyond 16 bits
+ * @age_ms:	milliseconds since the station was last seen (-1 = unknown)
+ * @qual:	signal quality information
+ * @stats:	history of the station across scans
+ * @ie_len:	length of @ie
  * @ap_addr:	MAC address
- * @essid:	station SSID (may be empty)
+ * @chan:	channel number (0 = unknown)
  * @mode:	operation mode (type of station)
- * @freq:	frequency/channel information
- * @chan:       channel corresponding to @freq (where applicable)
- * @qual:	signal quality information
  * @has_key:	whether using encryption or not
- * @flags:	properties gathered from Information Elements
- * @next:	next entry in list
+ * @essid:	station SSID (may be empty)
+ * Members are ordered by alignment, so that the entry has no holes.
  */
 struct scan_entry {
+	struct scan_entry	*next;
+	const uint8_t		*ie;
+	struct iw_levelstat	dbm;
+	uint32_t		flags;
+	uint32_t		freq;
+	int32_t			age_ms;
+	struct iw_quality	qual;
+	struct bss_stats	stats;
+	uint16_t		ie_len;
 	struct ether_addr	ap_addr;
+	uint8_t			chan;
+	uint8_t			mode;
+	bool			has_key;
 	char			essid[IW_ESSID_MAX_SIZE + 2];
-	int			mode;
-	double			freq;
-	int			chan;
-	struct iw_quality	qual;
-	struct iw_levelstat	dbm;
+};
 
-	int 			has_key:1;
-	uint32_t		flags;
+/**
+ * struct scan_target  -  restrictions of a directed scan
+ * @essid:	ESSIDs to probe for (num_essid == 0: broadcast probes only)
+ * @freq:	frequencies in MHz to scan on (num_freq == 0: all channels)
+ */
+#define MAX_SCAN_TARGETS	8
+struct scan_target {
+	char		essid[MAX_SCAN_TARGETS][IW_ESSID_MAX_SIZE + 1];
+	int		num_essid;
+	uint32_t	freq[IW_MAX_FREQUENCIES];
+	int		num_freq;
+};
+extern uint32_t iw_extract_ie(const uint8_t *buffer, int len);
 
-	struct scan_entry	*next;
+/*
+ * Return the IE-derived properties of @e. Entries are shared by the threads
+ * once published, hence the IEs are decoded each time rather than cached.
+ */
+static inline uint32_t scan_entry_flags(const struct scan_entry *e)
+{
+	return e->ie ? e->flags | iw_extract_ie(e->ie, e->ie_len) : e->flags;
+}
+
+/**
+ * struct scan_arena  -  region allocator for the entries of one scan
+ * @chunk:	most recently allocated chunk, chained to the earlier ones
+ * @allocs:	number of chunks allocated so far
+ * @used:	number of bytes handed out so far
+ * All entries of a snapshot are carved out of a few large chunks, which are
+ * released together by scan_arena_reset() when the snapshot is freed.
+ */
+struct scan_arena {
+	struct scan_arena_chunk	*chunk;
+	unsigned int		allocs;
+	size_t			used;
 };
-extern void sort_scan_list(struct scan_entry **headp);
+extern void scan_arena_reserve(struct scan_arena *arena, size_t size);
+extern void *scan_arena_alloc(struct scan_arena *arena, size_t size);
+extern void scan_arena_reset(struct scan_arena *arena);
+
+#define MAX_SCAN_WAIT	15000	/* maximum milliseconds spent waiting */
+/*MAX_SCAN_WAIT to 15000 (runs ok with ath9k driver with "firmware libre") */
+extern int rtnl_scan_events_init(void);
+extern int rtnl_scan_events_wait(int ifindex, const struct timespec *deadline);
+
+/*
+ * Channel histogram: one slot per channel number of each band, so that a
+ * station is accounted for by direct indexing. 4.9 GHz channels (183..196)
+ * are counted with 5 GHz, whose channel numbers they share.
+ */
+enum chan_band {
+	BAND_2GHZ,
+	BAND_5GHZ,
+	BAND_6GHZ,
+	NUM_BANDS
+};
+#define CH_SLOT_2GHZ		0	/* channels 1..14 */
+#define CH_SLOT_5GHZ		15	/* channels 1..196 */
+#define CH_SLOT_6GHZ		212	/* channels 1..233 */
+#define CHAN_HIST_SLOTS		446
+
+/* Histogram slot of frequency @freq MHz, or of channel @chan if @freq is 0. */
+static inline int chan_hist_slot(int freq, int chan)
+{
+	if (chan <= 0 || freq > 7125)
+		return -1;
+	if (freq ? freq < 3000 : chan <= 14)
+		return chan <= 14 ? CH_SLOT_2GHZ + chan : -1;
+	if (!freq || freq < 5935)
+		return chan <= 196 ? CH_SLOT_5GHZ + chan : -1;
+	return chan <= 233 ? CH_SLOT_6GHZ + chan : -1;
+}
+
+static inline enum chan_band chan_hist_band(int slot)
+{
+	return slot >= CH_SLOT_6GHZ ? BAND_6GHZ :
+	       slot >= CH_SLOT_5GHZ ? BAND_5GHZ : BAND_2GHZ;
+}
+
+static inline int chan_hist_chan(int slot)
+{
+	static const int base[NUM_BANDS] = {
+		[BAND_2GHZ] = CH_SLOT_2GHZ,
+		[BAND_5GHZ] = CH_SLOT_5GHZ,
+		[BAND_6GHZ] = CH_SLOT_6GHZ
+	};
+
+	return slot - base[chan_hist_band(slot)];
+}
 
 /**
- * struct cnt - count frequency of integer numbers
- * @val:	value to count
- * @count:	how often @val occurs
+ * struct chan_hist - distribution of stations over channels
+ * @ch.count:	number of stations on the channel
+ * @ch.load:	signal-weighted occupancy: the sum of the weights of these
+ *		stations, from 0 (weak signal) to 1 (strong or unknown signal)
+ * @used:	number of slots with a non-zero @ch.count
+ * @top:	slots of the most crowded channels (the least crowded ones when
+ *		sorting by descending channel), in order
+ * @num_top:	number of valid entries in @top
  */
-struct cnt {
-	int	val;
-	int	count;
+#define MAX_CH_STATS		3
+struct chan_hist {
+	struct chan_stat {
+		uint16_t	count;
+		float		load;
+	}		ch[CHAN_HIST_SLOTS];
+	uint16_t	used;
+	uint16_t	top[MAX_CH_STATS];
+	uint16_t	num_top;
 };
 
 /**
- * struct scan_result - Structure to aggregate all collected scan data.
+ * struct scan_snapshot - One complete set of scan results.
  * @head:	   begin of scan_entry list (may be NULL)
  * @msg:	   error message, if any
  * @max_essid_len: maximum ESSID-string length (for formatting)
- * @channel_stats: array of channel statistics entries
+ * @chan:	   distribution of the entries over channels
  * @num.total:     number of entries in list starting at @head
  * @num.open:      number of open entries among @num.total
  * @num.two_gig:   number of 2.4GHz stations among @num.total
  * @num.five_gig:  number of 5 GHz stations among @num.total
- * @num.ch_stats:  length of @channel_stats array
- * @range:         range data associated with scan interface
- * @mutex:         protects against concurrent consumer/producer access
+ * @num.filtered:  number of entries left out by the filter
+ * @filter_gen:	   generation of the filter applied (see scan_result_set_filter())
+ * @gen:	   sequence number, incremented with each new scan
+ * @triggered:	   CLOCK_MONOTONIC time at which the scan was started
+ * @cached:	   whether results were taken from the kernel cache only
+ * @directed:	   whether the scan was restricted to the watch list
+ * @raw:	   buffer holding undecoded parts of the entries (may be NULL)
+ * @entry:	   the entries of the list at @head, as an array (may be NULL)
+ * @rank:	   sort ranks of the entries in @entry (see scan_order_sort())
+ * @spark:	   latest SPARK_LEN signal levels (dBm) of each entry in @entry,
+ *		   oldest first, SPARK_NONE where unknown (see ap_table_spark())
+ * @arena:	   storage of the entries at @head
+ * @sched.interval_ms: current interval between scans, as set by the scheduler
+ * @sched.period_ms:   average achieved time between scans (0 = unknown)
+ * @sched.offchan_pct: percentage of time spent scanning (off channel)
+ * @retire_epoch:  reader epoch at the time this snapshot was replaced
+ * @next_retired:  list of replaced snapshots waiting to be freed
+ * A snapshot is built privately by the scan thread, and not modified by it
+ * once published.
  */
-struct scan_result {
+struct scan_snapshot {
 	struct scan_entry *head;
 	char		  msg[128];
 	uint16_t	  max_essid_len;
-	struct cnt	  *channel_stats;
+	struct chan_hist  chan;
 	struct assorted_numbers {
 		uint16_t	entries,
 				open,
 				two_gig,
-				five_gig;
-/* Maximum number of 'top' statistics entries. */
-#define MAX_CH_STATS		3
-		size_t		ch_stats;
+				five_gig,
+				filtered;
 	}		  num;
+	unsigned long	  filter_gen;
+	unsigned long	  gen;
+	struct timespec	  triggered;
+	bool		  cached,
+			  directed;
+	uint8_t		  *raw;
+	struct scan_entry **entry;
+	struct scan_rank  *rank;
+	int8_t		  *spark;
+	struct scan_arena arena;
+	struct scan_sched_stats {
+		unsigned int	interval_ms,
+				period_ms;
+		float		offchan_pct;
+	}		  sched;
+
+	unsigned long	  retire_epoch;
+	struct scan_snapshot *next_retired;
+};
+
+/**
+ * struct ap_table  -  stations seen by successive scans, keyed by BSSID
+ * @slot:	open-addressing hash table of @size slots (a power of 2)
+ * @size:	number of slots
+ * @used:	number of occupied slots
+ * @scans:	number of scans recorded so far
+ * @essid:	hash chains of interned ESSIDs
+ * @hist:	pool of signal histories, allocated by the first update
+ * @epoch_ms:	CLOCK_MONOTONIC time in ms at which @hist was allocated
+ */
+#define AP_ESSID_BUCKETS	64
+#define SPARK_LEN		8
+#define SPARK_NONE		INT8_MIN
+struct ap_table {
+	struct ap_slot		*slot;
+	size_t			size,
+				used;
+	uint32_t		scans;
+	struct essid_atom	*essid[AP_ESSID_BUCKETS];
+	struct ap_hist_pool	*hist;
+	uint64_t		epoch_ms;
+};
+extern void ap_table_update(struct ap_table *t, struct scan_snapshot *ss);
+extern void ap_table_spark(const struct ap_table *t, struct scan_snapshot *ss);
+extern void ap_table_fini(struct ap_table *t);
+
+/**
+ * struct scan_result - Structure to aggregate all collected scan data.
+ * @current:	   most recently published snapshot (NULL before first scan)
+ * @retired:	   replaced snapshots that the reader may still be using
+ * @reader_epoch:  odd while the reader is using a snapshot
+ * @notify_fd:	   eventfd signalled whenever a new snapshot is published
+ * @aps:	   stations seen so far (only used by the scan thread)
+ * @filter:	   filter applied to the entries (only used by the scan thread)
+ * @filter_next:   filter to apply from the next scan on, handed over by the reader
+ * @filter_gen:	   number of filters handed over so far (only used by the reader)
+ * @range:         range data associated with scan interface
+ */
+struct scan_result {
+	struct scan_snapshot *current;
+	struct scan_snapshot *retired;
+	unsigned long	  reader_epoch;
+	int		  notify_fd;
+	struct ap_table	  aps;
+	struct scan_filter *filter,
+			   *filter_next;
+	unsigned long	  filter_gen;
 	struct iw_range	  range;
-	pthread_mutex_t   mutex;
 };
 
 extern void scan_result_init(struct scan_result *sr);
 extern void scan_result_fini(struct scan_result *sr);
+extern void scan_result_set_filter(struct scan_result *sr,
+				   struct scan_filter *f);
 extern void *do_scan(void *sr_ptr);
+extern const struct scan_snapshot *scan_snapshot_get(struct scan_result *sr);
+extern void scan_snapshot_put(struct scan_result *sr);
+
+/*
+ *	Filtering of scan results
+ */
+/**
+ * struct scan_filter  -  compiled filter expression (see scan_filter.c)
+ * @op:		the operations, evaluated in sequence
+ * @num_ops:	number of operations in @op
+ * @max_ops:	capacity of @op
+ * @gen:	set by scan_result_set_filter()
+ */
+struct scan_filter {
+	struct filter_op	*op;
+	size_t			num_ops,
+				max_ops;
+	unsigned long		gen;
+};
+extern struct scan_filter *scan_filter_compile(const char *expr, char *err,
+					       size_t errlen);
+extern bool scan_filter_match(const struct scan_filter *f,
+			      const struct scan_entry *e);
+extern void scan_filter_free(struct scan_filter *f);
+
+/*
+ *	Ordering of scan results
+ */
+/**
+ * struct scan_rank  -  position of an entry among those of its snapshot
+ * @essid:	rank of the ESSID in alphabetical order
+ * @bssid:	rank of the BSSID in numerical order
+ * Equal values have equal ranks.
+ */
+struct scan_rank {
+	uint16_t	essid,
+			bssid;
+};
+
+/**
+ * struct scan_sort_spec  -  compiled compound sort order
+ * @num_keys:	number of fields in @key, the most significant one first
+ * @key.get:	extract the value of the field from an entry
+ * @key.shift:	position of the field within the 64-bit sort key
+ * @key.width:	number of bits of the field
+ * @key.desc:	whether to sort the field in descending order
+ */
+#define MAX_SORT_KEYS	8
+struct scan_sort_spec {
+	int	num_keys;
+	struct scan_sort_key {
+		uint64_t	(*get)(const struct scan_entry *e,
+				       const struct scan_rank *r);
+		uint8_t		shift,
+				width;
+		bool		desc;
+	} key[MAX_SORT_KEYS];
+};
+extern int scan_sort_compile(struct scan_sort_spec *spec, const char *str);
+
+/**
+ * struct scan_order  -  entries of a snapshot sorted by a given order
+ * @gen:	generation of the snapshot that @idx refers to (0 = none)
+ * @sort_order:	SO_xxx that @spec was compiled for (-1 = none)
+ * @spec:	compiled form of @sort_order
+ * @spec_err:	the custom order could not be compiled, using the default
+ * @asc:	whether @idx is in ascending order
+ * @idx:	indices into the entry array of the snapshot, in display order
+ * @sorted:	number of leading elements of @idx which are valid
+ * @item:	sort keys, and scratch space of the radix sort
+ * @max:	capacity of @idx and @item
+ */
+struct scan_order {
+	unsigned long		gen;
+	int			sort_order;
+	struct scan_sort_spec	spec;
+	bool			spec_err;
+	bool			asc;
+	uint16_t		*idx;
+	size_t			sorted;
+	struct sort_item	*item;
+	size_t			max;
+};
+extern const uint16_t *scan_order_sort(struct scan_order *o,
+				       const struct scan_snapshot *ss,
+				       size_t end);
+extern int scan_order_find(const struct scan_order *o,
+			   const struct scan_snapshot *ss,
+			   bool (*match)(const struct scan_entry *e,
+					 const void *arg),
+			   const void *arg);
+extern void scan_order_fini(struct scan_order *o);
 
 /*
  *	General helper routines
@@ -515,6 +908,38 @@ static inline double channel_to_freq(uint8_t chan, const struct iw_range *range)
 	return 0.0;
 }
 
+/* Channel number of centre frequency @mhz, as in ieee80211_frequency_to_channel() */
+static inline int ieee80211_freq_to_channel(int mhz)
+{
+	if (mhz == 2484)
+		return 14;
+	else if (mhz >= 2412 && mhz < 2484)
+		return (mhz - 2407) / 5;
+	else if (mhz >= 4910 && mhz <= 4980)
+		return (mhz - 4000) / 5;
+	else if (mhz >= 5000 && mhz < 5925)
+		return (mhz - 5000) / 5;
+	else if (mhz == 5935)
+		return 2;
+	else if (mhz > 5935 && mhz <= 45000)
+		return (mhz - 5950) / 5;
+	else if (mhz >= 58320 && mhz <= 70200)
+		return (mhz - 56160) / 2160;
+	return -1;
+}
+
+/* Centre frequency in MHz of channel @chan, 0 if unknown (6GHz: ambiguous). */
+static inline int ieee80211_channel_to_freq(int chan)
+{
+	if (chan == 14)
+		return 2484;
+	else if (chan > 0 && chan < 14)
+		return 2407 + chan * 5;
+	else if (chan >= 32 && chan <= 177)
+		return 5000 + chan * 5;
+	return 0;
+}
+
 /* Return channel number or -1 on error. Based on iw_freq_to_channel() */
 static inline int freq_to_channel(double freq, const struct iw_range *range)
 {
@@ -526,7 +951,8 @@ static inline int freq_to_channel(double freq, const struct iw_range *range)
 	for (i = 0; i < range->num_frequency; i++)
 		if (freq_to_hz(&range->freq[i]) == freq)
 			return range->freq[i].i;
-	return -1;
+	/* Range may have no frequency list (nl80211), use standard channels */
+	return ieee80211_freq_to_channel(freq / 1e6);
 }
 
 /* print @key in cleartext if it is in ASCII format, use hex format otherwise */
@@ -0,0 +1,635 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "iw_if.h"
+#include "iw_nl80211.h"
+#include "nl_util.h"
+
+/* 802.11 capability field bits (IEEE 802.11-2012, 8.4.1.4) */
+#define WLAN_CAPABILITY_ESS		(1 << 0)
+#define WLAN_CAPABILITY_IBSS		(1 << 1)
+#define WLAN_CAPABILITY_PRIVACY		(1 << 4)
+
+/* Information Element IDs */
+#define WLAN_EID_SSID			0
+
+/*
+ * Global nl80211 state: the family id and scan multicast group are resolved
+ * once. The request socket is shared by the sampling and the info code, the
+ * scan thread uses its own sockets so that a long scan dump does not delay
+ * the sampling of statistics.
+ */
+static pthread_once_t	nl80211_once  = PTHREAD_ONCE_INIT;
+static pthread_mutex_t	nl80211_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct nl_sock	nl80211_sk    = { .fd = -1 };
+static uint16_t		nl80211_id;
+static uint32_t		nl80211_scan_grp;
+
+static void nl80211_init(void)
+{
+	if (nl_open(&nl80211_sk, NETLINK_GENERIC) < 0)
+		return;
+	if (genl_resolve(&nl80211_sk, NL80211_GENL_NAME, &nl80211_id,
+			 NL80211_MULTICAST_GROUP_SCAN, &nl80211_scan_grp) < 0) {
+		nl80211_id = 0;
+		nl_close(&nl80211_sk);
+	}
+}
+
+/**
+ * nl80211_talk  -  send nl80211 command @cmd on @sk
+ * @sk:	     socket to use, NULL for the shared request socket
+ * @cmd:     NL80211_CMD_xxx
+ * @ifindex: interface index to pass as NL80211_ATTR_IFINDEX (0 = none)
+ * @flags:   additional netlink flags, e.g. NLM_F_DUMP
+ * Returns 0 if ok, negative errno value otherwise.
+ */
+static int nl80211_talk(struct nl_sock *sk, uint8_t cmd, int ifindex,
+			uint16_t flags, nl_msg_cb cb, void *arg)
+{
+	char req[NL_REQ_SIZE];
+	struct nlmsghdr *nlh = genl_msg_init(req, nl80211_id, cmd, flags);
+	int ret, cancel_state;
+
+	if (ifindex)
+		nl_attr_put_u32(nlh, NL80211_ATTR_IFINDEX, ifindex);
+
+	if (sk)
+		return nl_talk(sk, nlh, cb, arg);
+
+	/* Do not leave the shared socket locked if the caller is cancelled */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+	pthread_mutex_lock(&nl80211_mutex);
+	ret = nl_talk(&nl80211_sk, nlh, cb, arg);
+	pthread_mutex_unlock(&nl80211_mutex);
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return ret;
+}
+
+/*
+ *	Conversion helpers
+ */
+static const uint8_t iftype_to_mode[NUM_NL80211_IFTYPES] = {
+	[NL80211_IFTYPE_UNSPECIFIED]	= IW_MODE_AUTO,
+	[NL80211_IFTYPE_ADHOC]		= IW_MODE_ADHOC,
+	[NL80211_IFTYPE_STATION]	= IW_MODE_INFRA,
+	[NL80211_IFTYPE_AP]		= IW_MODE_MASTER,
+	[NL80211_IFTYPE_AP_VLAN]	= IW_MODE_MASTER,
+	[NL80211_IFTYPE_WDS]		= IW_MODE_REPEAT,
+	[NL80211_IFTYPE_MONITOR]	= IW_MODE_MONITOR,
+	[NL80211_IFTYPE_MESH_POINT]	= IW_MODE_MESH,
+	[NL80211_IFTYPE_P2P_CLIENT]	= IW_MODE_INFRA,
+	[NL80211_IFTYPE_P2P_GO]		= IW_MODE_MASTER,
+};
+
+/* Fill in @qual from a signal level in dBm, see NL80211_QUAL_MAX. */
+static void nl80211_dbm_to_qual(int dbm, struct iw_quality *qual)
+{
+	qual->level   = dbm_to_u8(dbm);
+	qual->qual    = clamp(dbm, -110, NL80211_QUAL_MAX - 110) + 110;
+	qual->noise   = 0;
+	qual->updated = IW_QUAL_QUAL_UPDATED | IW_QUAL_LEVEL_UPDATED |
+			IW_QUAL_DBM | IW_QUAL_NOISE_INVALID;
+}
+
+/* Bitrate in units of 100 kbit/s from a nested NL80211_RATE_INFO attribute */
+static uint32_t nl80211_bitrate(const struct nlattr *rate_info)
+{
+	const struct nlattr *ri[NL80211_RATE_INFO_MAX + 1];
+
+	nl_attr_parse(ri, NL80211_RATE_INFO_MAX,
+		      nl_attr_data(rate_info), nl_attr_len(rate_info));
+	if (ri[NL80211_RATE_INFO_BITRATE32])
+		return nl_attr_u32(ri[NL80211_RATE_INFO_BITRATE32]);
+	if (ri[NL80211_RATE_INFO_BITRATE])
+		return nl_attr_u16(ri[NL80211_RATE_INFO_BITRATE]);
+	return 0;
+}
+
+/*
+ *	Message decoders
+ *
+ * These only look at the message passed in, so that they can equally be
+ * fed from a live socket or from a buffer of previously recorded messages.
+ */
+
+/**
+ * struct nl80211_iface  -  result of NL80211_CMD_GET_INTERFACE
+ * @ifname:	interface name
+ * @iftype:	NL80211_IFTYPE_xxx
+ * @freq:	operating frequency in MHz, 0 if unknown
+ * @txpower:	transmit power in mBm
+ * @ssid:	current SSID, valid if @ssid_len >= 0
+ * @ssid_len:	length of @ssid, -1 if not reported
+ * @has_txpower: whether @txpower is valid
+ */
+struct nl80211_iface {
+	char		ifname[IFNAMSIZ];
+	uint32_t	iftype;
+	uint32_t	freq;
+	int32_t		txpower;
+	char		ssid[IW_ESSID_MAX_SIZE + 2];
+	int		ssid_len;
+	bool		has_txpower;
+};
+
+static int nl80211_iface_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct nl80211_iface *ifc = arg;
+	const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+	genl_attr_parse(tb, NL80211_ATTR_MAX, nlh);
+
+	if (tb[NL80211_ATTR_IFNAME])
+		snprintf(ifc->ifname, sizeof(ifc->ifname), "%.*s",
+			 nl_attr_len(tb[NL80211_ATTR_IFNAME]),
+			 (const char *)nl_attr_data(tb[NL80211_ATTR_IFNAME]));
+	if (tb[NL80211_ATTR_IFTYPE])
+		ifc->iftype = nl_attr_u32(tb[NL80211_ATTR_IFTYPE]);
+	if (tb[NL80211_ATTR_WIPHY_FREQ])
+		ifc->freq = nl_attr_u32(tb[NL80211_ATTR_WIPHY_FREQ]);
+	if (tb[NL80211_ATTR_WIPHY_TX_POWER_LEVEL]) {
+		ifc->has_txpower = true;
+		ifc->txpower = nl_attr_u32(tb[NL80211_ATTR_WIPHY_TX_POWER_LEVEL]);
+	}
+	if (tb[NL80211_ATTR_SSID]) {
+		ifc->ssid_len = min(nl_attr_len(tb[NL80211_ATTR_SSID]),
+				    IW_ESSID_MAX_SIZE);
+		memcpy(ifc->ssid, nl_attr_data(tb[NL80211_ATTR_SSID]),
+		       ifc->ssid_len);
+		ifc->ssid[ifc->ssid_len] = '\0';
+	}
+	return 0;
+}
+
+/**
+ * struct nl80211_station  -  first entry of NL80211_CMD_GET_STATION dump
+ * @found:	whether a station entry was present
+ * @addr:	MAC address of the station (the access point in managed mode)
+ * @has_signal:	whether @signal is valid
+ * @signal:	signal level in dBm (average if available)
+ * @bitrate:	transmit bitrate in units of 100 kbit/s
+ * @tx_failed:	number of failed transmissions
+ * @rx_drop:	number of received packets dropped for unspecified reasons
+ * @beacon_loss: number of times a beacon loss was detected
+ */
+struct nl80211_station {
+	bool			found,
+				has_signal;
+	struct ether_addr	addr;
+	int8_t			signal;
+	uint32_t		bitrate;
+	uint32_t		tx_failed;
+	uint64_t		rx_drop;
+	uint32_t		beacon_loss;
+};
+
+static int nl80211_station_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct nl80211_station *sta = arg;
+	const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+	const struct nlattr *si[NL80211_STA_INFO_MAX + 1];
+
+	genl_attr_parse(tb, NL80211_ATTR_MAX, nlh);
+	if (sta->found || !tb[NL80211_ATTR_STA_INFO])
+		return 0;
+	sta->found = true;
+
+	if (tb[NL80211_ATTR_MAC] && nl_attr_len(tb[NL80211_ATTR_MAC]) >= ETH_ALEN)
+		memcpy(&sta->addr, nl_attr_data(tb[NL80211_ATTR_MAC]), ETH_ALEN);
+
+	nl_attr_parse(si, NL80211_STA_INFO_MAX,
+		      nl_attr_data(tb[NL80211_ATTR_STA_INFO]),
+		      nl_attr_len(tb[NL80211_ATTR_STA_INFO]));
+
+	if (si[NL80211_STA_INFO_SIGNAL_AVG]) {
+		sta->has_signal = true;
+		sta->signal = nl_attr_u8(si[NL80211_STA_INFO_SIGNAL_AVG]);
+	} else if (si[NL80211_STA_INFO_SIGNAL]) {
+		sta->has_signal = true;
+		sta->signal = nl_attr_u8(si[NL80211_STA_INFO_SIGNAL]);
+	}
+	if (si[NL80211_STA_INFO_TX_BITRATE])
+		sta->bitrate = nl80211_bitrate(si[NL80211_STA_INFO_TX_BITRATE]);
+	if (si[NL80211_STA_INFO_TX_FAILED])
+		sta->tx_failed = nl_attr_u32(si[NL80211_STA_INFO_TX_FAILED]);
+	if (si[NL80211_STA_INFO_RX_DROP_MISC])
+		sta->rx_drop = nl_attr_u64(si[NL80211_STA_INFO_RX_DROP_MISC]);
+	if (si[NL80211_STA_INFO_BEACON_LOSS])
+		sta->beacon_loss = nl_attr_u32(si[NL80211_STA_INFO_BEACON_LOSS]);
+	return 0;
+}
+
+/* Build list of scan_entry structs from NL80211_CMD_GET_SCAN dump messages. */
+struct nl80211_scan_list {
+	struct scan_entry	*head,
+				**tailp;
+	struct scan_arena	*arena;
+};
+
+static int nl80211_scan_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct nl80211_scan_list *sl = arg;
+	const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+	const struct nlattr *bss[NL80211_BSS_MAX + 1], *ies;
+	struct scan_entry *new;
+	uint16_t capa = 0;
+
+	genl_attr_parse(tb, NL80211_ATTR_MAX, nlh);
+	if (!tb[NL80211_ATTR_BSS])
+		return 0;
+	nl_attr_parse(bss, NL80211_BSS_MAX, nl_attr_data(tb[NL80211_ATTR_BSS]),
+		      nl_attr_len(tb[NL80211_ATTR_BSS]));
+	if (!bss[NL80211_BSS_BSSID] || nl_attr_len(bss[NL80211_BSS_BSSID]) < ETH_ALEN)
+		return 0;
+
+	new = scan_arena_alloc(sl->arena, sizeof(*new));
+
+	memcpy(&new->ap_addr, nl_attr_data(bss[NL80211_BSS_BSSID]), ETH_ALEN);
+
+	if (bss[NL80211_BSS_FREQUENCY])
+		new->freq = nl_attr_u32(bss[NL80211_BSS_FREQUENCY]);
+
+	if (bss[NL80211_BSS_CAPABILITY])
+		capa = nl_attr_u16(bss[NL80211_BSS_CAPABILITY]);
+	if (capa & WLAN_CAPABILITY_ESS)
+		new->mode = IW_MODE_MASTER;
+	else if (capa & WLAN_CAPABILITY_IBSS)
+		new->mode = IW_MODE_ADHOC;
+	else
+		new->mode = IW_MODE_AUTO;
+	new->has_key = !!(capa & WLAN_CAPABILITY_PRIVACY);
+
+	if (bss[NL80211_BSS_SEEN_MS_AGO])
+		new->age_ms = nl_attr_u32(bss[NL80211_BSS_SEEN_MS_AGO]);
+	else
+		new->age_ms = -1;
+
+	if (bss[NL80211_BSS_SIGNAL_MBM]) {
+		nl80211_dbm_to_qual((int32_t)nl_attr_u32(bss[NL80211_BSS_SIGNAL_MBM]) / 100,
+				    &new->qual);
+	} else if (bss[NL80211_BSS_SIGNAL_UNSPEC]) {
+		new->qual.qual	  = nl_attr_u8(bss[NL80211_BSS_SIGNAL_UNSPEC]) *
+				    NL80211_QUAL_MAX / 100;
+		new->qual.updated = IW_QUAL_QUAL_UPDATED | IW_QUAL_LEVEL_INVALID |
+				    IW_QUAL_NOISE_INVALID;
+	}
+
+	/* Probe response IEs are more complete than those from beacons */
+	ies = bss[NL80211_BSS_INFORMATION_ELEMENTS] ? : bss[NL80211_BSS_BEACON_IES];
+	if (ies) {
+		const uint8_t *ie = nl_attr_data(ies);
+		int i, len = nl_attr_len(ies);
+
+		for (i = 0; i + 2 <= len && i + 2 + ie[i + 1] <= len; i += ie[i + 1] + 2)
+			if (ie[i] == WLAN_EID_SSID) {
+				memcpy(new->essid, ie + i + 2,
+				       min(ie[i + 1], IW_ESSID_MAX_SIZE));
+				break;
+			}
+		new->flags |= iw_extract_ie(ie, len);
+	}
+
+	*sl->tailp = new;
+	sl->tailp  = &new->next;
+	return 0;
+}
+
+/* Collect interface names from a NL80211_CMD_GET_INTERFACE dump. */
+struct nl80211_if_names {
+	char	(*names)[IFNAMSIZ];
+	size_t	count,
+		max_entries;
+};
+
+static int nl80211_if_names_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct nl80211_if_names *ifn = arg;
+	struct nl80211_iface ifc = { .ssid_len = -1 };
+
+	nl80211_iface_cb(nlh, &ifc);
+	if (*ifc.ifname && ifn->count < ifn->max_entries)
+		memcpy(ifn->names[ifn->count++], ifc.ifname, IFNAMSIZ);
+	return 0;
+}
+
+/*
+ *	Requests
+ */
+static int nl80211_get_interface(struct if_handle *h, struct nl80211_iface *ifc)
+{
+	memset(ifc, 0, sizeof(*ifc));
+	ifc->ssid_len = -1;
+
+	if (!h->ifindex)
+		return -ENODEV;
+	return nl80211_talk(NULL, NL80211_CMD_GET_INTERFACE, h->ifindex, 0,
+			    nl80211_iface_cb, ifc);
+}
+
+static int nl80211_get_station(struct if_handle *h, struct nl80211_station *sta)
+{
+	memset(sta, 0, sizeof(*sta));
+
+	if (!h->ifindex)
+		return -ENODEV;
+	return nl80211_talk(NULL, NL80211_CMD_GET_STATION, h->ifindex,
+			    NLM_F_DUMP, nl80211_station_cb, sta);
+}
+
+/**
+ * iw_nl80211_active  -  whether to use nl80211 instead of wireless extensions
+ * The 'backend' configuration setting forces either method. In 'auto' mode,
+ * nl80211 is used for all interfaces that are known to nl80211 (cfg80211
+ * drivers), the result of this test is cached per interface.
+ */
+bool iw_nl80211_active(const char *ifname)
+{
+	if (conf.backend == BE_WEXT)
+		return false;
+
+	pthread_once(&nl80211_once, nl80211_init);
+	if (nl80211_id == 0) {
+		if (conf.backend == BE_NL80211)
+			err_quit("nl80211 is not supported by this kernel");
+		return false;
+	}
+	if (conf.backend == BE_NL80211)
+		return true;
+	return iw_nl80211_supported(ifname);
+}
+
+/** Return true if @ifname is driven by cfg80211, whatever the backend setting. */
+bool iw_nl80211_supported(const char *ifname)
+{
+	struct nl80211_iface ifc;
+	struct if_handle *h;
+
+	pthread_once(&nl80211_once, nl80211_init);
+	if (nl80211_id == 0)
+		return false;
+
+	h = if_handle_get(ifname);
+	if (h->nl80211 < 0)
+		h->nl80211 = nl80211_get_interface(h, &ifc) == 0;
+	return h->nl80211;
+}
+
+/**
+ * Fill @names with up to @max_entries names of interfaces known to nl80211.
+ * Returns the number of entries, 0 if nl80211 is not available.
+ */
+size_t iw_nl80211_get_interface_list(char (*names)[IFNAMSIZ], size_t max_entries)
+{
+	struct nl80211_if_names ifn = {
+		.names = names,
+		.max_entries = max_entries
+	};
+
+	pthread_once(&nl80211_once, nl80211_init);
+	if (nl80211_id == 0 ||
+	    nl80211_talk(NULL, NL80211_CMD_GET_INTERFACE, 0, NLM_F_DUMP,
+			 nl80211_if_names_cb, &ifn) < 0)
+		return 0;
+	return ifn.count;
+}
+
+/*
+ * nl80211 has no equivalent of SIOCGIWRANGE. Provide the range data that the
+ * screens depend on, consistent with the values produced by this backend.
+ */
+void iw_nl80211_getinf_range(struct iw_range *range)
+{
+	memset(range, 0, sizeof(*range));
+
+	range->max_qual.qual	= NL80211_QUAL_MAX;
+	range->max_qual.updated	= IW_QUAL_DBM | IW_QUAL_NOISE_INVALID;
+	range->avg_qual.qual	= NL80211_QUAL_MAX / 2;
+	range->avg_qual.updated	= range->max_qual.updated;
+}
+
+void iw_nl80211_get_dyn_info(struct iw_dyn_info *info, const char *ifname)
+{
+	struct if_handle *h = if_handle_get(ifname);
+	struct nl80211_iface ifc;
+	struct nl80211_station sta;
+	int ret;
+
+	memset(info, 0, sizeof(struct iw_dyn_info));
+
+	ret = nl80211_get_interface(h, &ifc);
+	if (ret < 0) {
+		errno = -ret;
+		err_sys("can not open device '%s'", ifname);
+	}
+	snprintf(info->name, sizeof(info->name), "IEEE 802.11");
+
+	info->cap_mode = 1;
+	info->mode     = ifc.iftype < NUM_NL80211_IFTYPES ?
+			 iftype_to_mode[ifc.iftype] : IW_MODE_AUTO;
+
+	if (ifc.ssid_len >= 0) {
+		info->cap_essid = 1;
+		info->essid_ct  = ifc.ssid_len > 0;
+		memcpy(info->essid, ifc.ssid, sizeof(info->essid));
+	}
+
+	if (ifc.freq) {
+		info->cap_freq = 1;
+		info->freq     = ifc.freq * 1e6;
+	}
+
+	if (ifc.has_txpower) {
+		info->cap_txpower    = 1;
+		info->txpower.value  = ifc.txpower / 100;
+		info->txpower.flags  = IW_TXPOW_DBM;
+	}
+
+	/* In managed mode, the only station entry is the access point */
+	if (nl80211_get_station(h, &sta) == 0 && sta.found) {
+		info->bitrate = sta.bitrate * 100000UL;
+		if (info->mode == IW_MODE_INFRA)
+			memcpy(info->ap_addr.sa_data, &sta.addr, ETH_ALEN);
+	}
+	if (info->mode == IW_MODE_INFRA) {
+		info->cap_ap = 1;
+		info->ap_addr.sa_family = ARPHRD_ETHER;
+	}
+}
+
+void iw_nl80211_getstat(const char *ifname, struct iw_statistics *stat)
+{
+	struct nl80211_station sta;
+
+	if (nl80211_get_station(if_handle_get(ifname), &sta) < 0 || !sta.found) {
+		stat->qual.updated = IW_QUAL_ALL_INVALID;
+		return;
+	}
+
+	if (sta.has_signal)
+		nl80211_dbm_to_qual(sta.signal, &stat->qual);
+	else
+		stat->qual.updated = IW_QUAL_ALL_INVALID;
+
+	stat->discard.retries = sta.tx_failed;
+	stat->discard.misc    = sta.rx_drop;
+	stat->miss.beacon     = sta.beacon_loss;
+}
+
+/*
+ *	Scanning
+ */
+struct nl80211_scan_wait {
+	int	ifindex;
+	bool	done;
+};
+
+static int nl80211_scan_event_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct nl80211_scan_wait *sw = arg;
+	const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+	uint8_t cmd = genl_cmd(nlh);
+
+	if (cmd != NL80211_CMD_NEW_SCAN_RESULTS &&
+	    cmd != NL80211_CMD_SCAN_ABORTED)
+		return 0;
+
+	genl_attr_parse(tb, NL80211_ATTR_MAX, nlh);
+	if (tb[NL80211_ATTR_IFINDEX] &&
+	    nl_attr_u32(tb[NL80211_ATTR_IFINDEX]) == sw->ifindex)
+		sw->done = true;
+	return 0;
+}
+
+/**
+ * nl80211_trigger_scan  -  start an active scan on @ifindex
+ * @target: channels and ESSIDs to restrict the scan to (NULL: full sweep)
+ * Without ESSIDs, the wildcard SSID is probed for, as 'iw scan' does; an
+ * empty NL80211_ATTR_SCAN_SSIDS would result in a (slower) passive scan.
+ */
+static int nl80211_trigger_scan(struct nl_sock *sk, int ifindex,
+				const struct scan_target *target)
+{
+	char req[NL_REQ_SIZE];
+	struct nlmsghdr *nlh = genl_msg_init(req, nl80211_id,
+					     NL80211_CMD_TRIGGER_SCAN, 0);
+	struct nlattr *nest;
+	int i;
+
+	nl_attr_put_u32(nlh, NL80211_ATTR_IFINDEX, ifindex);
+
+	nest = nl_attr_nest_start(nlh, NL80211_ATTR_SCAN_SSIDS);
+	if (target && target->num_essid)
+		for (i = 0; i < target->num_essid; i++)
+			nl_attr_put(nlh, i + 1, target->essid[i],
+				    strlen(target->essid[i]));
+	else
+		nl_attr_put(nlh, 1, "", 0);
+	nl_attr_nest_end(nlh, nest);
+
+	if (target && target->num_freq) {
+		nest = nl_attr_nest_start(nlh, NL80211_ATTR_SCAN_FREQUENCIES);
+		for (i = 0; i < target->num_freq; i++)
+			nl_attr_put_u32(nlh, i + 1, target->freq[i]);
+		nl_attr_nest_end(nlh, nest);
+	}
+	return nl_talk(sk, nlh, NULL, NULL);
+}
+
+/**
+ * iw_nl80211_get_scan_list  -  trigger a scan and return the list of results
+ * @ifname:  interface to scan on
+ * @trigger: whether to scan, or only to return what the kernel has cached
+ * @target:  restrictions of a triggered scan (NULL: full sweep)
+ * @arena:   where to allocate the entries, which remain there on error
+ * Waits for the completion event instead of polling. Must only be called from
+ * the scan thread. Returns NULL with errno set on error, errno = 0 if the scan
+ * did not find anything.
+ */
+struct scan_entry *iw_nl80211_get_scan_list(const char *ifname, bool trigger,
+					    const struct scan_target *target,
+					    struct scan_arena *arena)
+{
+	static struct nl_sock req_sk = { .fd = -1 }, ev_sk = { .fd = -1 };
+	struct nl80211_scan_list sl = {
+		.head = NULL, .tailp = &sl.head, .arena = arena
+	};
+	struct nl80211_scan_wait sw = { .ifindex = if_handle_get(ifname)->ifindex };
+	struct timespec now, end;
+	int ret, len, wait;
+
+	errno = 0;
+	if (!sw.ifindex) {
+		errno = ENODEV;
+		return NULL;
+	}
+
+	if (req_sk.fd < 0 && (ret = nl_open(&req_sk, NETLINK_GENERIC)) < 0)
+		goto fail;
+	if (!trigger)
+		goto dump;
+	if (ev_sk.fd < 0) {
+		ret = nl_open(&ev_sk, NETLINK_GENERIC);
+		if (ret == 0 && (ret = nl_join_group(&ev_sk, nl80211_scan_grp)) < 0)
+			nl_close(&ev_sk);
+		if (ret < 0)
+			goto fail;
+	}
+
+	/* Discard stale events from an earlier, possibly interrupted scan */
+	while (nl_recv(&ev_sk, 0) > 0)
+		;
+
+	/* EBUSY: someone else is scanning already - just wait for the result */
+	ret = nl80211_trigger_scan(&req_sk, sw.ifindex, target);
+	/* E.g. more ESSIDs than the hardware can probe for at once */
+	if (ret == -EINVAL && target)
+		ret = nl80211_trigger_scan(&req_sk, sw.ifindex, NULL);
+	if (ret < 0 && ret != -EBUSY)
+		goto fail;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec  += MAX_SCAN_WAIT / 1000;
+	end.tv_nsec += (MAX_SCAN_WAIT % 1000) * 1000000;
+
+	while (!sw.done) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wait = (end.tv_sec - now.tv_sec) * 1000 +
+		       (end.tv_nsec - now.tv_nsec) / 1000000;
+		if (wait <= 0)
+			break;
+		len = nl_recv(&ev_sk, wait);
+		if (len < 0 && len != -ENOBUFS) {
+			ret = len;
+			goto fail;
+		}
+		if (len > 0)
+			nl_parse(ev_sk.buf, len, 0, nl80211_scan_event_cb, &sw);
+	}
+
+	/* Even after a timeout, the dump returns whatever is cached */
+dump:
+	ret = nl80211_talk(&req_sk, NL80211_CMD_GET_SCAN, sw.ifindex, NLM_F_DUMP,
+			   nl80211_scan_cb, &sl);
+	if (ret < 0)
+		goto fail;
+	return sl.head;
+fail:
+	errno = -ret;
+	return NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/nl80211.h>
+
+/*
+ * nl80211 acquisition backend
+ *
+ * Used instead of wireless extensions for interfaces whose driver is based on
+ * cfg80211. The selection is made at runtime, see iw_nl80211_active().
+ */
+
+/*
+ * nl80211 reports signal levels in dBm only. Derive the 'link quality' value
+ * the same way as the cfg80211 wireless-extensions compatibility layer does,
+ * by mapping -110..-40 dBm onto 0..70.
+ */
+#define NL80211_QUAL_MAX	70
+
+extern bool iw_nl80211_active(const char *ifname);
+extern bool iw_nl80211_supported(const char *ifname);
+extern size_t iw_nl80211_get_interface_list(char (*names)[IFNAMSIZ],
+					    size_t max_entries);
+
+extern void iw_nl80211_getinf_range(struct iw_range *range);
+extern void iw_nl80211_get_dyn_info(struct iw_dyn_info *info,
+				    const char *ifname);
+extern void iw_nl80211_getstat(const char *ifname, struct iw_statistics *stat);
+extern struct scan_entry *iw_nl80211_get_scan_list(const char *ifname,
+						   bool trigger,
+						   const struct scan_target *target,
+						   struct scan_arena *arena);
@@ -1,796 +1,1064 @@
 /*
- * Auxiliary declarations and functions imported from iwlib in order to
- * process and parse scan events. This code is copied with little change
- * from wireless tools 30. It remains here until the wext code will be
- * replaced by corresponding netlink calls.
+ * Acquisition, parsing, ordering, and publication of scan results.
  */
 #include "iw_if.h"
-#include <search.h>		/* lsearch(3) */
-
-#define MAX_SCAN_WAIT	15000	/* maximum milliseconds spent waiting */
-/*MAX_SCAN_WAIT to 15000 (runs ok with ath9k driver with "firmware libre") */
+#include "iw_nl80211.h"
+#include <sys/eventfd.h>
 
 /*
- * Meta-data about all the additional standard Wireless Extension events
- * we know about.
+ *	Parsing of wireless-extensions scan results
+ *
+ * SIOCGIWSCAN returns a stream of packed, unaligned events. Rather than
+ * copying each event into a struct iw_event, the stream is indexed in place:
+ * for each cell, struct we_cell records where its events are in the buffer.
+ * Fields are then decoded straight from the buffer when filling in the
+ * scan_entry, except for the Information Elements. Those are only decoded
+ * when needed (see scan_entry_flags()), for which the buffer is kept along
+ * with the scan results.
+ *
+ * WE-19 removed the user-space pointer from iw_point events in the stream.
+ * Instead of testing the version for each event, the indexer is specialised
+ * for either layout, and the variant is selected once per scan.
  */
-/* Type of headers we know about (basically union iwreq_data) */
-#define IW_HEADER_TYPE_NULL	0	/* Not available */
-#define IW_HEADER_TYPE_CHAR	2	/* char [IFNAMSIZ] */
-#define IW_HEADER_TYPE_UINT	4	/* __u32 */
-#define IW_HEADER_TYPE_FREQ	5	/* struct iw_freq */
-#define IW_HEADER_TYPE_ADDR	6	/* struct sockaddr */
-#define IW_HEADER_TYPE_POINT	8	/* struct iw_point */
-#define IW_HEADER_TYPE_PARAM	9	/* struct iw_param */
-#define IW_HEADER_TYPE_QUAL	10	/* struct iw_quality */
-
-/* Size (in bytes) of various events */
-static const int event_type_size[] = {
-	[IW_HEADER_TYPE_NULL]  = IW_EV_LCP_PK_LEN,
-	[IW_HEADER_TYPE_CHAR]  = IW_EV_CHAR_PK_LEN,
-	[IW_HEADER_TYPE_UINT]  = IW_EV_UINT_PK_LEN,
-	[IW_HEADER_TYPE_FREQ]  = IW_EV_FREQ_PK_LEN,
-	[IW_HEADER_TYPE_ADDR]  = IW_EV_ADDR_PK_LEN,
-	/*
-	 * Fix IW_EV_POINT_PK_LEN: some wireless.h versions define this
-	 * erroneously as IW_EV_LCP_LEN + 4 (e.g. ESSID will disappear).
-	 * The value below is from wireless tools 30.
-	 */
-	[IW_HEADER_TYPE_POINT] = IW_EV_LCP_PK_LEN + 4,
-	[IW_HEADER_TYPE_PARAM] = IW_EV_PARAM_PK_LEN,
-	[IW_HEADER_TYPE_QUAL]  = IW_EV_QUAL_PK_LEN
+enum we_cell_event {
+	WE_ADDR,
+	WE_ESSID,
+	WE_MODE,
+	WE_FREQ,
+	WE_ENCODE,
+	WE_QUAL,
+	WE_GENIE,
+	WE_CELL_EVENTS
 };
 
-/* Handling flags */
-#define IW_DESCR_FLAG_NONE	0x0000	/* Obvious */
-/* Wrapper level flags */
-#define IW_DESCR_FLAG_DUMP	0x0001	/* Not part of the dump command */
-#define IW_DESCR_FLAG_EVENT	0x0002	/* Generate an event on SET */
-#define IW_DESCR_FLAG_RESTRICT	0x0004	/* GET : request is ROOT only */
-				/* SET : Omit payload from generated iwevent */
-#define IW_DESCR_FLAG_NOMAX	0x0008	/* GET : no limit on request size */
-/* Driver level flags */
-#define IW_DESCR_FLAG_WAIT	0x0100	/* Wait for driver event */
-
-struct iw_ioctl_description {
-	__u8 header_type;	/* NULL, iw_point or other */
-	__u8 token_type;	/* Future */
-	__u16 token_size;	/* Granularity of payload */
-	__u16 min_tokens;	/* Min acceptable token number */
-	__u16 max_tokens;	/* Max acceptable token number */
-	__u32 flags;		/* Special handling of the request */
-};
-
-/*
- * Meta-data about all the standard Wireless Extension request we
- * know about.
+/**
+ * struct we_cell  -  location of the events describing one cell
+ * @ev:	for each event, offset + 1 of its payload in the buffer (0: missing).
+ *	For iw_point events, the payload starts with the u16 length and flags,
+ *	followed by the data.
  */
-static const struct iw_ioctl_description standard_ioctl_descr[] = {
-	[SIOCSIWCOMMIT	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_NULL,
-	},
-	[SIOCGIWNAME	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_CHAR,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWNWID	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-		.flags		= IW_DESCR_FLAG_EVENT,
-	},
-	[SIOCGIWNWID	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWFREQ	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_FREQ,
-		.flags		= IW_DESCR_FLAG_EVENT,
-	},
-	[SIOCGIWFREQ	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_FREQ,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWMODE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_UINT,
-		.flags		= IW_DESCR_FLAG_EVENT,
-	},
-	[SIOCGIWMODE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_UINT,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWSENS	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWSENS	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWRANGE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_NULL,
-	},
-	[SIOCGIWRANGE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= sizeof(struct iw_range),
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWPRIV	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_NULL,
-	},
-	[SIOCGIWPRIV	- SIOCIWFIRST] = { /* (handled directly by us) */
-		.header_type	= IW_HEADER_TYPE_NULL,
-	},
-	[SIOCSIWSTATS	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_NULL,
-	},
-	[SIOCGIWSTATS	- SIOCIWFIRST] = { /* (handled directly by us) */
-		.header_type	= IW_HEADER_TYPE_NULL,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWSPY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= sizeof(struct sockaddr),
-		.max_tokens	= IW_MAX_SPY,
-	},
-	[SIOCGIWSPY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= sizeof(struct sockaddr) +
-				  sizeof(struct iw_quality),
-		.max_tokens	= IW_MAX_SPY,
-	},
-	[SIOCSIWTHRSPY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= sizeof(struct iw_thrspy),
-		.min_tokens	= 1,
-		.max_tokens	= 1,
-	},
-	[SIOCGIWTHRSPY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= sizeof(struct iw_thrspy),
-		.min_tokens	= 1,
-		.max_tokens	= 1,
-	},
-	[SIOCSIWAP	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_ADDR,
-	},
-	[SIOCGIWAP	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_ADDR,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWMLME	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.min_tokens	= sizeof(struct iw_mlme),
-		.max_tokens	= sizeof(struct iw_mlme),
-	},
-	[SIOCGIWAPLIST	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= sizeof(struct sockaddr) +
-				  sizeof(struct iw_quality),
-		.max_tokens	= IW_MAX_AP,
-		.flags		= IW_DESCR_FLAG_NOMAX,
-	},
-	[SIOCSIWSCAN	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.min_tokens	= 0,
-		.max_tokens	= sizeof(struct iw_scan_req),
-	},
-	[SIOCGIWSCAN	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_SCAN_MAX_DATA,
-		.flags		= IW_DESCR_FLAG_NOMAX,
-	},
-	[SIOCSIWESSID	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ESSID_MAX_SIZE + 1,
-		.flags		= IW_DESCR_FLAG_EVENT,
-	},
-	[SIOCGIWESSID	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ESSID_MAX_SIZE + 1,
-		.flags		= IW_DESCR_FLAG_DUMP,
-	},
-	[SIOCSIWNICKN	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ESSID_MAX_SIZE + 1,
-	},
-	[SIOCGIWNICKN	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ESSID_MAX_SIZE + 1,
-	},
-	[SIOCSIWRATE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWRATE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWRTS	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWRTS	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWFRAG	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWFRAG	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWTXPOW	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWTXPOW	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWRETRY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWRETRY	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWENCODE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ENCODING_TOKEN_MAX,
-		.flags		= IW_DESCR_FLAG_EVENT | IW_DESCR_FLAG_RESTRICT,
-	},
-	[SIOCGIWENCODE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_ENCODING_TOKEN_MAX,
-		.flags		= IW_DESCR_FLAG_DUMP | IW_DESCR_FLAG_RESTRICT,
-	},
-	[SIOCSIWPOWER	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWPOWER	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-#ifdef SIOCSIWMODUL
-	[SIOCSIWMODUL	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-#endif
-#ifdef SIOCGIWMODUL
-	[SIOCGIWMODUL	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-#endif
-	[SIOCSIWGENIE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_GENERIC_IE_MAX,
-	},
-	[SIOCGIWGENIE	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_GENERIC_IE_MAX,
-	},
-	[SIOCSIWAUTH	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCGIWAUTH	- SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_PARAM,
-	},
-	[SIOCSIWENCODEEXT - SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.min_tokens	= sizeof(struct iw_encode_ext),
-		.max_tokens	= sizeof(struct iw_encode_ext) +
-				  IW_ENCODING_TOKEN_MAX,
-	},
-	[SIOCGIWENCODEEXT - SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.min_tokens	= sizeof(struct iw_encode_ext),
-		.max_tokens	= sizeof(struct iw_encode_ext) +
-				  IW_ENCODING_TOKEN_MAX,
-	},
-	[SIOCSIWPMKSA - SIOCIWFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.min_tokens	= sizeof(struct iw_pmksa),
-		.max_tokens	= sizeof(struct iw_pmksa),
-	},
-};
-
-static const struct iw_ioctl_description standard_event_descr[] = {
-	[IWEVTXDROP - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_ADDR,
-	},
-	[IWEVQUAL - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_QUAL,
-	},
-	[IWEVCUSTOM - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_CUSTOM_MAX,
-	},
-	[IWEVREGISTERED - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_ADDR,
-	},
-	[IWEVEXPIRED - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_ADDR,
-	},
-	[IWEVGENIE - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_GENERIC_IE_MAX,
-	},
-	[IWEVMICHAELMICFAILURE - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= sizeof(struct iw_michaelmicfailure),
-	},
-	[IWEVASSOCREQIE - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_GENERIC_IE_MAX,
-	},
-	[IWEVASSOCRESPIE - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= IW_GENERIC_IE_MAX,
-	},
-	[IWEVPMKIDCAND - IWEVFIRST] = {
-		.header_type	= IW_HEADER_TYPE_POINT,
-		.token_size	= 1,
-		.max_tokens	= sizeof(struct iw_pmkid_cand),
-	},
+struct we_cell {
+	uint32_t	ev[WE_CELL_EVENTS];
 };
 
-struct stream_descr {
-	char *current;		/* Current event in stream of events */
-	char *value;		/* Current value in event */
-	char *end;		/* End of the stream */
-};
+/* Offset of the payload of a fixed-size event of @ev_len, 0 if malformed. */
+static inline unsigned int we_fixed_off(uint16_t ev_len, size_t size)
+{
+	/* 64-bit kernel and 32-bit user space: 4 bytes of padding */
+	if (ev_len == IW_EV_LCP_PK_LEN + 4 + size)
+		return IW_EV_LCP_PK_LEN + 4;
+	return ev_len >= IW_EV_LCP_PK_LEN + size ? IW_EV_LCP_PK_LEN : 0;
+}
 
-/*
- * Extract the next event from the event stream.
- */
-static int iw_extract_event_stream(struct stream_descr *stream,
-				   struct iw_event *iwe, int we_version)
+/* Offset of the length/flags of the iw_point event at @ev, 0 if malformed. */
+static inline unsigned int we_point_off(const uint8_t *ev, uint16_t ev_len,
+					const bool v19)
 {
-	const struct iw_ioctl_description *descr = NULL;
-	int event_type;
-	unsigned int event_len = 1;	/* Invalid */
-	unsigned cmd_index;	/* *MUST* be unsigned */
-	char *pointer;
+	unsigned int off = IW_EV_LCP_PK_LEN + (v19 ? 0 : IW_EV_POINT_OFF);
+	uint16_t dlen, alt;
 
-	if (stream->current + IW_EV_LCP_PK_LEN > stream->end)
+	if (ev_len < off + 4)
 		return 0;
+	memcpy(&dlen, ev + off, sizeof(dlen));
 
-	/* Extract the event header to get the event id.
-	 * Note : the event may be unaligned, therefore copy... */
-	memcpy((char *)iwe, stream->current, IW_EV_LCP_PK_LEN);
-
-	if (iwe->len <= IW_EV_LCP_PK_LEN)
-		return -1;
-
-	/* Get the type and length of that event */
-	if (iwe->cmd <= SIOCIWLAST) {
-		cmd_index = iwe->cmd - SIOCIWFIRST;
-		if (cmd_index < ARRAY_SIZE(standard_ioctl_descr))
-			descr = standard_ioctl_descr + cmd_index;
-	} else {
-		cmd_index = iwe->cmd - IWEVFIRST;
-		if (cmd_index < ARRAY_SIZE(standard_event_descr))
-			descr = standard_event_descr + cmd_index;
+	/* 64-bit kernel and 32-bit user space, see iwlib */
+	if (v19 && off + 4 + dlen != ev_len && ev_len >= off + 8) {
+		memcpy(&alt, ev + off + 4, sizeof(alt));
+		if (off + 8 + alt == ev_len)
+			return off + 4;
 	}
+	return off + 4 + dlen <= ev_len ? off : 0;
+}
 
-	/* Unknown events -> event_type = 0  =>  IW_EV_LCP_PK_LEN */
-	event_type = descr ? descr->header_type : 0;
-	event_len  = event_type_size[event_type];
+static inline size_t we_index(const uint8_t *buf, size_t len,
+			      struct we_cell **cellsp, const bool v19)
+{
+	struct we_cell *cells = NULL, *cell = NULL;
+	size_t pos, n = 0, max = 0;
+	uint16_t ev_len, cmd;
+	unsigned int off;
+	int i;
+
+	for (pos = 0; pos + IW_EV_LCP_PK_LEN <= len; pos += ev_len) {
+		memcpy(&ev_len, buf + pos, sizeof(ev_len));
+		memcpy(&cmd, buf + pos + sizeof(ev_len), sizeof(cmd));
+		if (ev_len <= IW_EV_LCP_PK_LEN || pos + ev_len > len)
+			break;
 
-	/* Check if we know about this event */
-	if (event_len <= IW_EV_LCP_PK_LEN) {
-		stream->current += iwe->len;			/* Skip to next event */
-		return 2;
+		switch (cmd) {
+		case SIOCGIWAP:
+			if (n == max) {
+				max   = max ? max * 2 : 32;
+				cells = realloc(cells, max * sizeof(*cells));
+				if (!cells)
+					err_sys("can not allocate scan index");
+			}
+			cell = memset(cells + n++, 0, sizeof(*cell));
+			i    = WE_ADDR;
+			off  = we_fixed_off(ev_len, sizeof(struct sockaddr));
+			break;
+		case SIOCGIWESSID:
+			i   = WE_ESSID;
+			off = we_point_off(buf + pos, ev_len, v19);
+			break;
+		case SIOCGIWMODE:
+			i   = WE_MODE;
+			off = we_fixed_off(ev_len, sizeof(__u32));
+			break;
+		case SIOCGIWFREQ:
+			i   = WE_FREQ;
+			off = we_fixed_off(ev_len, sizeof(struct iw_freq));
+			break;
+		case SIOCGIWENCODE:
+			i   = WE_ENCODE;
+			off = we_point_off(buf + pos, ev_len, v19);
+			break;
+		case IWEVQUAL:
+			i   = WE_QUAL;
+			off = we_fixed_off(ev_len, sizeof(struct iw_quality));
+			break;
+		case IWEVGENIE:
+			i   = WE_GENIE;
+			off = we_point_off(buf + pos, ev_len, v19);
+			break;
+		default:
+			continue;
+		}
+		/* Only the first event of each kind in a cell counts */
+		if (cell && off && !cell->ev[i])
+			cell->ev[i] = pos + off + 1;
 	}
-	event_len -= IW_EV_LCP_PK_LEN;
-
-	/* Fixup for earlier version of WE */
-	if (we_version <= 18 && event_type == IW_HEADER_TYPE_POINT)
-		event_len += IW_EV_POINT_OFF;
+	*cellsp = cells;
+	return n;
+}
 
-	if (stream->value != NULL)
-		pointer = stream->value;			/* Next value in event */
-	else
-		pointer = stream->current + IW_EV_LCP_PK_LEN;	/* First value in event */
+static size_t we_index_v19(const uint8_t *buf, size_t len, struct we_cell **cellsp)
+{
+	return we_index(buf, len, cellsp, true);
+}
 
-	/* Copy the rest of the event (at least, fixed part) */
-	if (pointer + event_len > stream->end) {
-		stream->current += iwe->len;			/* Skip to next event */
-		return -2;
-	}
+static size_t we_index_v18(const uint8_t *buf, size_t len, struct we_cell **cellsp)
+{
+	return we_index(buf, len, cellsp, false);
+}
 
-	/* Fixup for WE-19 and later: pointer no longer in the stream */
-	/* Beware of alignment. Dest has local alignment, not packed */
-	if (we_version > 18 && event_type == IW_HEADER_TYPE_POINT)
-		memcpy((char *)iwe + IW_EV_LCP_LEN + IW_EV_POINT_OFF, pointer, event_len);
+/* Fill in a new scan_entry from @cell, NULL if the cell is incomplete. */
+static struct scan_entry *we_cell_entry(const uint8_t *buf,
+					const struct we_cell *cell,
+					struct scan_arena *arena)
+{
+	struct scan_entry *new;
+	struct iw_freq freq;
+	double hz;
+	uint16_t dlen, flags;
+	const uint8_t *p;
+	__u32 mode;
+	int i;
+
+	for (i = 0; i < WE_CELL_EVENTS; i++)
+		if (!cell->ev[i])
+			return NULL;
+#define WE_EV(i)	(buf + cell->ev[i] - 1)
+
+	new = scan_arena_alloc(arena, sizeof(*new));
+
+	p = WE_EV(WE_ADDR) + offsetof(struct sockaddr, sa_data);
+	memcpy(&new->ap_addr, p, sizeof(new->ap_addr));
+
+	p = WE_EV(WE_ESSID);
+	memcpy(&dlen, p, sizeof(dlen));
+	memcpy(&flags, p + 2, sizeof(flags));
+	if (flags && dlen && dlen <= IW_ESSID_MAX_SIZE)
+		memcpy(new->essid, p + 4, dlen);
+
+	memcpy(&mode, WE_EV(WE_MODE), sizeof(mode));
+	new->mode = mode;
+
+	memcpy(&freq, WE_EV(WE_FREQ), sizeof(freq));
+	hz = freq_to_hz(&freq);
+	if (hz < 1e3)			/* Channel number rather than frequency */
+		new->chan = hz;
 	else
-		memcpy((char *)iwe + IW_EV_LCP_LEN, pointer, event_len);
-
-	/* Skip event in the stream */
-	pointer += event_len;
-
-	/* Special processing for iw_point events */
-	if (event_type == IW_HEADER_TYPE_POINT) {
-		unsigned int extra_len = iwe->len - (event_len + IW_EV_LCP_PK_LEN);
-
-		if (extra_len > 0) {
-			/* Set pointer on variable part (warning : non aligned) */
-			iwe->u.data.pointer = pointer;
-
-			/* Check that we have a descriptor for the command */
-			if (descr == NULL) {
-				/* Can't check payload -> unsafe... */
-				iwe->u.data.pointer = NULL;	/* Discard paylod */
-			} else {
-				unsigned int token_len = iwe->u.data.length * descr->token_size;
-				/*
-				 * Ugly fixup for alignment issues.
-				 * If the kernel is 64 bits and userspace 32 bits, we have an extra 4 + 4
-				 * bytes. Fixing that in the kernel would break 64 bits userspace.
-				 */
-				if (token_len != extra_len && extra_len >= 4) {
-					union iw_align_u16 {
-						__u16 value;
-						unsigned char byte[2];
-					} alt_dlen;
-					unsigned int alt_token_len;
-
-					/* Userspace seems to not always like unaligned access,
-					 * so be careful and make sure to align value.
-					 * I hope gcc won't play any of its aliasing tricks... */
-					alt_dlen.byte[0] = *(pointer);
-					alt_dlen.byte[1] = *(pointer + 1);
-					alt_token_len = alt_dlen.value * descr->token_size;
-
-					/* Verify that data is consistent if assuming 64 bit alignment... */
-					if (alt_token_len + 8 == extra_len) {
-
-						/* Ok, let's redo everything */
-						pointer -= event_len;
-						pointer += 4;
-
-						/* Dest has local alignment, not packed */
-						memcpy((char *)iwe + IW_EV_LCP_LEN + IW_EV_POINT_OFF, pointer, event_len);
-						pointer += event_len + 4;
-						token_len = alt_token_len;
-
-						/* We may have no payload */
-						if (alt_token_len)
-							iwe->u.data.pointer = pointer;
-						else
-							iwe->u.data.pointer = NULL;
-					}
-				}
-
-				/* Discard bogus events which advertise more tokens than they carry ... */
-				if (token_len > extra_len)
-					iwe->u.data.pointer = NULL;	/* Discard paylod */
-
-				/* Check that the advertised token size is not going to
-				 * produce buffer overflow to our caller... */
-				if (iwe->u.data.length > descr->max_tokens
-				    && !(descr->flags & IW_DESCR_FLAG_NOMAX))
-					iwe->u.data.pointer = NULL;	/* Discard payload */
-
-				/* Same for underflows... */
-				if (iwe->u.data.length < descr->min_tokens)
-					iwe->u.data.pointer = NULL;	/* Discard paylod */
-			}
-		} else {
-			/* No data */
-			iwe->u.data.pointer = NULL;
-		}
-
-		stream->current += iwe->len;			/* Go to next event */
-	} else {
-		/*
-		 * Ugly fixup for alignment issues.
-		 * If the kernel is 64 bits and userspace 32 bits, we have an extra 4 bytes.
-		 * Fixing that in the kernel would break 64 bits userspace.
-		 */
-		if (stream->value == NULL &&
-		    ((iwe->len - IW_EV_LCP_PK_LEN) % event_len == 4 ||
-		     (iwe->len == 12 && (event_type == IW_HEADER_TYPE_UINT ||
-					 event_type == IW_HEADER_TYPE_QUAL)))) {
+		new->freq = lrint(hz / 1e6);	/* freq_to_hz() is only float */
 
-			pointer -= event_len;
-			pointer += 4;
+	memcpy(&flags, WE_EV(WE_ENCODE) + 2, sizeof(flags));
+	new->has_key = !(flags & IW_ENCODE_DISABLED);
 
-			/* Beware of alignment. Dest has local alignment, not packed */
-			memcpy((char *)iwe + IW_EV_LCP_LEN, pointer, event_len);
-			pointer += event_len;
-		}
+	memcpy(&new->qual, WE_EV(WE_QUAL), sizeof(new->qual));
 
-		if (pointer + event_len <= stream->current + iwe->len) {
-			stream->value = pointer;		/* Go to next value */
-		} else {
-			stream->value = NULL;
-			stream->current += iwe->len;		/* Go to next event */
-		}
+	/* Decoded on demand, see scan_entry_flags() */
+	p = WE_EV(WE_GENIE);
+	memcpy(&dlen, p, sizeof(dlen));
+	if (dlen <= IW_GENERIC_IE_MAX) {
+		new->ie	    = p + 4;
+		new->ie_len = dlen;
 	}
-	return 1;
+	new->age_ms = -1;
+#undef WE_EV
+	return new;
 }
 
-static void iw_extract_ie(struct iw_event *iwe, struct scan_entry *sr)
+/* Return the IW_ENC_CAPA_xxx flags advertised by the IEs in @buffer. */
+uint32_t iw_extract_ie(const uint8_t *buffer, int len)
 {
 	const uint8_t wpa1_oui[3] = { 0x00, 0x50, 0xf2 };
-	uint8_t *buffer = iwe->u.data.pointer;
 	int ielen = 0, ietype, i;
+	uint32_t flags = 0;
 
 	/* Loop on each IE, each is min. 2 bytes TLV: IE-ID - Length - Value */
-	for (i = 0; i <= iwe->u.data.length - 2;  i += ielen + 2) {
+	for (i = 0; i <= len - 2;  i += ielen + 2) {
 		ietype = buffer[i];
 		ielen  = buffer[i + 1];
+		if (i + 2 + ielen > len)	/* truncated */
+			break;
 
 		switch (ietype) {
 		case 0x30:
 			if (ielen < 4)	/* make sure we have enough data */
 				continue;
-			sr->flags |= IW_ENC_CAPA_WPA2;
+			flags |= IW_ENC_CAPA_WPA2;
 			break;
 		case 0xdd:
 			/* Not all IEs that start with 0xdd are WPA1 */
 			if (ielen < 8 || memcmp(buffer + i + 2, wpa1_oui, 3) ||
 			    buffer[i + 5] != 1)
 				continue;
-			sr->flags |= IW_ENC_CAPA_WPA;
+			flags |= IW_ENC_CAPA_WPA;
 			break;
 		}
 	}
+	return flags;
 }
-/*----------------- End of code copied from iwlib -----------------------*/
 
 /*
- * Ordering functions for scan results: all return true for a < b.
+ *	Ordering of scan results
+ *
+ * An order is a comma-separated list of fields, each optionally prefixed by
+ * '-' to sort it in descending order, e.g. "chan,-sig,essid". It is compiled
+ * into a list of key extractors, which pack the fields of an entry into one
+ * 64-bit integer, the first field in the most significant bits. Entries are
+ * then ordered by a radix sort of their keys. Strings and addresses do not fit
+ * into such a key, so the scan thread ranks the ESSIDs and BSSIDs of each
+ * snapshot, and keys contain ranks instead.
+ *
+ * The screen usually shows only the first few of many entries. As long as the
+ * entries asked for are few compared to all, they are picked by a partial
+ * selection, and only they are sorted.
  */
+static uint64_t key_chan(const struct scan_entry *e, const struct scan_rank *r)
+{
+	/*
+	 * Entries with only a channel number have freq == 0. Above 16 bits,
+	 * there are only 60 GHz channels, numbered in order of frequency.
+	 */
+	return (uint64_t)(e->freq < 0xffff ? e->freq : 0xffff) << 8 | e->chan;
+}
 
-/* Order by frequency. */
-static bool cmp_freq(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t key_sig(const struct scan_entry *e, const struct scan_rank *r)
 {
-	return a->freq < b->freq;
+	return e->qual.level;
 }
 
-/* Order by signal strength. */
-static bool cmp_sig(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t key_essid(const struct scan_entry *e, const struct scan_rank *r)
 {
-	return a->qual.level < b->qual.level;
+	return r->essid;
 }
 
-/* Order by ESSID, organize entries with same ESSID by frequency and signal. */
-static bool cmp_essid(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t key_bssid(const struct scan_entry *e, const struct scan_rank *r)
 {
-	int res = strncmp(a->essid, b->essid, IW_ESSID_MAX_SIZE);
+	return r->bssid;
+}
 
-	return res == 0 ? (a->freq == b->freq ? cmp_sig(a, b) : cmp_freq(a, b))
-			: res < 0;
+static uint64_t key_open(const struct scan_entry *e, const struct scan_rank *r)
+{
+	return !e->has_key;
 }
 
-/* Order by frequency, grouping channels by ESSID. */
-static bool cmp_chan(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t key_seen(const struct scan_entry *e, const struct scan_rank *r)
 {
-	return a->freq == b->freq ? cmp_essid(a, b) : cmp_freq(a, b);
+	return e->stats.seen < 0xffff ? e->stats.seen : 0xffff;
 }
 
-/* Order by frequency first, then by signal strength. */
-static bool cmp_chan_sig(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t key_age(const struct scan_entry *e, const struct scan_rank *r)
 {
-	return a->freq == b->freq ? cmp_sig(a, b) : cmp_chan(a, b);
+	if (e->age_ms < 0)
+		return 0;
+	return e->age_ms / 1000 < 0xffff ? e->age_ms / 1000 : 0xffff;
 }
 
-/* Order by openness (open access points frist). */
-static bool cmp_open(const struct scan_entry *a, const struct scan_entry *b)
+static const struct sort_field {
+	const char	*name;
+	uint8_t		width;
+	uint64_t	(*get)(const struct scan_entry *e, const struct scan_rank *r);
+} sort_fields[] = {
+	{ "chan",	24,	key_chan  },
+	{ "sig",	 8,	key_sig   },
+	{ "essid",	16,	key_essid },
+	{ "bssid",	16,	key_bssid },
+	{ "open",	 1,	key_open  },
+	{ "seen",	16,	key_seen  },
+	{ "age",	16,	key_age   },
+};
+
+/* The predefined orders. In ascending order, SO_OPEN lists open ones first. */
+static const char *sort_specs[] = {
+	[SO_CHAN]	= "chan,essid,sig",
+	[SO_SIGNAL]	= "sig",
+	[SO_ESSID]	= "essid,chan,sig",
+	[SO_OPEN]	= "-open",
+	[SO_CHAN_SIG]	= "chan,sig",
+	[SO_OPEN_SIG]	= "-open,sig",
+	[SO_CUSTOM]	= NULL
+};
+
+/**
+ * scan_sort_compile  -  translate an order such as "chan,-sig" into @spec
+ * Returns 0 if successful, -1 with errno set to EINVAL for an unknown field,
+ * or to E2BIG if the fields do not fit into 64 bits.
+ */
+int scan_sort_compile(struct scan_sort_spec *spec, const char *str)
 {
-	return a->has_key < b->has_key;
+	const char *tok = str;
+	unsigned int bits = 0;
+	size_t len, i;
+	bool desc;
+
+	spec->num_keys = 0;
+	do {
+		desc = *tok == '-';
+		tok += desc || *tok == '+';
+		len  = strcspn(tok, ",");
+
+		for (i = 0; i < ARRAY_SIZE(sort_fields); i++)
+			if (strlen(sort_fields[i].name) == len &&
+			    strncasecmp(sort_fields[i].name, tok, len) == 0)
+				break;
+		if (i == ARRAY_SIZE(sort_fields)) {
+			errno = EINVAL;
+			return -1;
+		}
+		bits += sort_fields[i].width;
+		if (bits > 64 || spec->num_keys == MAX_SORT_KEYS) {
+			errno = E2BIG;
+			return -1;
+		}
+		spec->key[spec->num_keys].get	= sort_fields[i].get;
+		spec->key[spec->num_keys].width = sort_fields[i].width;
+		spec->key[spec->num_keys].desc	= desc;
+		spec->num_keys++;
+
+		tok += len;
+	} while (*tok++ == ',');
+
+	/* The first field goes into the most significant bits. */
+	for (i = 0; i < spec->num_keys; i++) {
+		bits -= spec->key[i].width;
+		spec->key[i].shift = bits;
+	}
+	return 0;
 }
 
-/* Sort (open) access points by signal strength. */
-static bool cmp_open_sig(const struct scan_entry *a, const struct scan_entry *b)
+static uint64_t sort_key(const struct scan_sort_spec *spec,
+			 const struct scan_entry *e, const struct scan_rank *r)
 {
-	return a->has_key == b->has_key ? cmp_sig(a, b) : cmp_open(a, b);
+	uint64_t key = 0, val, mask;
+	int i;
+
+	for (i = 0; i < spec->num_keys; i++) {
+		mask = (1ULL << spec->key[i].width) - 1;
+		val  = spec->key[i].get(e, r) & mask;
+		if (spec->key[i].desc)
+			val = mask - val;
+		key |= val << spec->key[i].shift;
+	}
+	return key;
 }
 
-static bool (*scan_cmp[])(const struct scan_entry *, const struct scan_entry *) = {
-	[SO_CHAN]	= cmp_chan,
-	[SO_SIGNAL]	= cmp_sig,
-	[SO_ESSID]	= cmp_essid,
-	[SO_OPEN]	= cmp_open,
-	[SO_CHAN_SIG]	= cmp_chan_sig,
-	[SO_OPEN_SIG]	= cmp_open_sig
+/*
+ * Entries that compare equal keep the order of the entry array, or the reverse
+ * order when sorting in descending order. @tie is the rank of @idx in that
+ * order, which makes (@key, @tie) unique.
+ */
+struct sort_item {
+	uint64_t	key;
+	uint16_t	idx,
+			tie;
 };
 
+/* Up to 1/SORT_PARTIAL of all entries are selected rather than sorted. */
+#define SORT_PARTIAL	8
+
+static bool item_less(const struct sort_item *a, const struct sort_item *b)
+{
+	return a->key < b->key || (a->key == b->key && a->tie < b->tie);
+}
+
+static int item_cmp(const void *a, const void *b)
+{
+	return item_less(a, b) ? -1 : item_less(b, a);
+}
+
+static void item_swap(struct sort_item *a, struct sort_item *b)
+{
+	struct sort_item tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+/* Partition @item so that its first @k elements are the @k smallest (quickselect). */
+static void select_first(struct sort_item *item, size_t n, size_t k)
+{
+	size_t lo = 0, hi = n, mid, pos, i;
+
+	while (hi - lo > 1) {
+		/* Median of three as pivot, moved to the end */
+		mid = lo + (hi - lo) / 2;
+		if (item_less(item + mid, item + lo))
+			item_swap(item + mid, item + lo);
+		if (item_less(item + hi - 1, item + lo))
+			item_swap(item + hi - 1, item + lo);
+		if (item_less(item + mid, item + hi - 1))
+			item_swap(item + mid, item + hi - 1);
+
+		for (i = pos = lo; i < hi - 1; i++)
+			if (item_less(item + i, item + hi - 1))
+				item_swap(item + i, item + pos++);
+		item_swap(item + pos, item + hi - 1);
+
+		if (pos == k || pos + 1 == k)
+			break;
+		if (pos > k)
+			hi = pos;
+		else
+			lo = pos + 1;
+	}
+}
+
+/* Stable LSD radix sort by bytes, skipping those which are the same in all keys. */
+static void radix_sort(struct sort_item *item, struct sort_item *tmp, size_t n)
+{
+	uint64_t any = 0, all = ~0ULL;
+	struct sort_item *src = item, *dst = tmp, *swap;
+	size_t count[256], i, pos, sum;
+	int shift;
+
+	for (i = 0; i < n; i++) {
+		any |= item[i].key;
+		all &= item[i].key;
+	}
+
+	for (shift = 0; shift < 64; shift += 8) {
+		if (!((any ^ all) >> shift & 0xff))
+			continue;
+
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++)
+			count[src[i].key >> shift & 0xff]++;
+		for (i = sum = 0; i < 256; i++) {
+			pos	 = count[i];
+			count[i] = sum;
+			sum	+= pos;
+		}
+		for (i = 0; i < n; i++)
+			dst[count[src[i].key >> shift & 0xff]++] = src[i];
+
+		swap = src, src = dst, dst = swap;
+	}
+	if (src != item)
+		memcpy(item, src, n * sizeof(*item));
+}
+
+/* Select the order to use, compiling it if it has changed. */
+static void scan_order_spec(struct scan_order *o)
+{
+	if (o->sort_order == conf.scan_sort_order)
+		return;
+	o->sort_order = conf.scan_sort_order;
+	o->gen	      = 0;
+	o->spec_err   = false;
+
+	if (o->sort_order == SO_CUSTOM) {
+		if (scan_sort_compile(&o->spec, conf.scan_sort_spec) == 0)
+			return;
+		o->spec_err = true;
+		scan_sort_compile(&o->spec, sort_specs[SO_CHAN_SIG]);
+	} else {
+		scan_sort_compile(&o->spec, sort_specs[o->sort_order]);
+	}
+}
+
+/* Compute the sort keys of @ss, with nothing sorted yet. */
+static void scan_order_keys(struct scan_order *o, const struct scan_snapshot *ss)
+{
+	size_t i, t, n = ss->num.entries;
+
+	if (n > o->max) {
+		o->max	= n;
+		o->idx	= realloc(o->idx, n * sizeof(*o->idx));
+		o->item = realloc(o->item, 2 * n * sizeof(*o->item));
+		if (!o->idx || !o->item)
+			err_sys("can not allocate scan order");
+	}
+
+	/* Descending order inverts the keys, the order of ties is reversed */
+	for (t = 0; t < n; t++) {
+		i = o->asc ? t : n - 1 - t;
+		o->item[t].key = sort_key(&o->spec, ss->entry[i], ss->rank + i);
+		o->item[t].idx = i;
+		o->item[t].tie = t;
+		if (!o->asc)
+			o->item[t].key = ~o->item[t].key;
+	}
+	o->gen	  = ss->gen;
+	o->sorted = 0;
+}
+
+/**
+ * scan_order_sort  -  sort the entries of @ss by the configured order
+ * @o:	 cached state of the order
+ * @ss:	 snapshot to sort
+ * @end: number of entries needed, counting from the first one shown
+ * Returns indices into @ss->entry in the order in which to show the entries,
+ * taking conf.scan_sort_asc into account. Only the first @end of them are
+ * guaranteed to be valid. The result is cached until @ss or the sort order
+ * changes, and extended if later calls ask for more entries.
+ */
+const uint16_t *scan_order_sort(struct scan_order *o,
+				const struct scan_snapshot *ss, size_t end)
+{
+	struct sort_item *tmp;
+	size_t i, n = ss->num.entries;
+
+	scan_order_spec(o);
+	if (o->gen != ss->gen || o->asc != conf.scan_sort_asc) {
+		o->asc = conf.scan_sort_asc;
+		scan_order_keys(o, ss);
+	}
+
+	if (end > n)
+		end = n;
+	if (end <= o->sorted)
+		return o->idx;
+
+	if (end * SORT_PARTIAL < n) {
+		select_first(o->item + o->sorted, n - o->sorted, end - o->sorted);
+		qsort(o->item + o->sorted, end - o->sorted, sizeof(*o->item),
+		      item_cmp);
+	} else {
+		/* The radix sort is stable: put the items back into @tie order */
+		tmp = o->item + o->max;
+		for (i = 0; i < n; i++)
+			tmp[o->item[i].tie] = o->item[i];
+		radix_sort(tmp, o->item, n);
+		memcpy(o->item, tmp, n * sizeof(*o->item));
+		end = n;
+	}
+
+	for (i = o->sorted; i < end; i++)
+		o->idx[i] = o->item[i].idx;
+	o->sorted = end;
+	return o->idx;
+}
+
+/**
+ * scan_order_find  -  position of the first entry of @ss matching @match
+ * @o:	   order last computed for @ss by scan_order_sort()
+ * @ss:	   snapshot to search
+ * @match: predicate on entries
+ * @arg:   argument passed to @match
+ * Returns the position at which the entry is shown, or -1 if none matches.
+ * Does not need the entries to be sorted.
+ */
+int scan_order_find(const struct scan_order *o, const struct scan_snapshot *ss,
+		    bool (*match)(const struct scan_entry *e, const void *arg),
+		    const void *arg)
+{
+	const struct sort_item *best = NULL;
+	size_t i, n = ss->num.entries;
+	int pos = 0;
+
+	for (i = 0; i < n; i++)
+		if ((!best || item_less(o->item + i, best)) &&
+		    match(ss->entry[o->item[i].idx], arg))
+			best = o->item + i;
+	if (!best)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		pos += item_less(o->item + i, best);
+	return pos;
+}
+
+void scan_order_fini(struct scan_order *o)
+{
+	free(o->idx);
+	free(o->item);
+	memset(o, 0, sizeof(*o));
+	o->sort_order = -1;
+}
+
+/*
+ * Buffer for SIOCGIWSCAN, only used by the scan thread. It is kept across
+ * scans and grows on demand, up to the 64KiB that wrq.u.data.length allows.
+ */
+#define SCAN_BUF_MAX	0xffff
+static struct {
+	uint8_t	*data;
+	size_t	size;
+} scan_buf;
+
+static void scan_buf_grow(size_t size)
+{
+	size = min(size, SCAN_BUF_MAX);
+	if (size <= scan_buf.size)
+		return;
+	scan_buf.data = realloc(scan_buf.data, size);
+	if (!scan_buf.data)
+		err_sys("can not allocate %zu bytes for scan results", size);
+	scan_buf.size = size;
+}
+
+/*
+ * Read available results into scan_buf. Returns false (errno set) if none
+ * are available yet, or if they do not fit even into the largest buffer.
+ */
+static bool get_scan_results(struct if_handle *h, struct iwreq *wrq)
+{
+	scan_buf_grow(IW_SCAN_MAX_DATA);
+
+	for (;;) {
+		wrq->u.data.pointer = scan_buf.data;
+		wrq->u.data.length  = scan_buf.size;
+		wrq->u.data.flags   = 0;
+
+		if (if_ioctl(h, SIOCGIWSCAN, wrq) == 0)
+			return true;
+		if (errno != E2BIG || scan_buf.size >= SCAN_BUF_MAX)
+			return false;
+
+		/* Some drivers tell how much space they need */
+		if (wrq->u.data.length > scan_buf.size)
+			scan_buf_grow(wrq->u.data.length);
+		else
+			scan_buf_grow(scan_buf.size * 2);
+	}
+}
+
+/**
+ * Restrict the SIOCSIWSCAN request @wrq to @target, as far as the driver
+ * supports it. Wireless extensions allow only one ESSID per request, hence
+ * successive directed scans rotate through the ESSIDs of @target.
+ */
+static void set_scan_req(struct iwreq *wrq, struct iw_scan_req *sreq,
+			 const struct iw_range *range,
+			 const struct scan_target *target)
+{
+	static unsigned int essid_idx;
+	const char *essid;
+	int i;
+
+	memset(sreq, 0, sizeof(*sreq));
+	sreq->scan_type		= IW_SCAN_TYPE_ACTIVE;
+	sreq->bssid.sa_family	= ARPHRD_ETHER;
+	memset(sreq->bssid.sa_data, 0xff, ETH_ALEN);
+	wrq->u.data.flags	= 0;
+
+	if (target->num_essid && range->scan_capa & IW_SCAN_CAPA_ESSID) {
+		essid = target->essid[essid_idx++ % target->num_essid];
+		sreq->essid_len = strlen(essid);
+		memcpy(sreq->essid, essid, sreq->essid_len);
+		wrq->u.data.flags |= IW_SCAN_THIS_ESSID;
+	}
+	if (target->num_freq && range->scan_capa & IW_SCAN_CAPA_CHANNEL) {
+		for (i = 0; i < target->num_freq && i < IW_MAX_FREQUENCIES; i++) {
+			/* Frequency in MHz, as m * 10^e Hz */
+			sreq->channel_list[i].m = target->freq[i];
+			sreq->channel_list[i].e = 6;
+		}
+		sreq->num_channels = i;
+		wrq->u.data.flags |= IW_SCAN_THIS_FREQ;
+	}
+	if (wrq->u.data.flags) {
+		wrq->u.data.pointer = sreq;
+		wrq->u.data.length  = sizeof(*sreq);
+	}
+}
+
 /**
  * Produce ranked list of scan results.
  * @ifname:     interface name to run scan on
- * @we_version: version of the WE extensions (needed internally)
+ * @range:      range data of @ifname (WE version, scan capabilities)
+ * @trigger:    whether to scan, or only to read what the kernel has cached
+ * @target:     restrictions of a triggered scan (NULL: full sweep)
+ * @raw:        set to the buffer that the entries refer to (may be NULL),
+ *              which must be freed along with the entries
+ * @arena:      where to allocate the entries
  */
-static struct scan_entry *get_scan_list(const char *ifname, int we_version)
+static struct scan_entry *get_scan_list(const char *ifname,
+					const struct iw_range *range,
+					bool trigger,
+					const struct scan_target *target,
+					uint8_t **raw,
+					struct scan_arena *arena)
 {
 	struct scan_entry *head = NULL, **tailp = &head;
-	struct iwreq wrq;
+	struct if_handle *h = if_handle_get(ifname);
+	struct iwreq wrq = h->iwr;
+	struct iw_scan_req sreq;
+	struct timespec deadline;
+	struct we_cell *cells;
+	bool events, ready = false;
 	int wait, waited = 0;
-	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	size_t i, n;
+	uint8_t *buf;
 
-	if (skfd < 0)
-		err_sys("%s: can not open socket", __func__);
-	/*
-	 * Some drivers may return very large scan results, either because there
-	 * are many cells, or there are many large elements. Do not bother to
-	 * guess buffer size, use maximum u16 wrq.u.data.length size.
-	 */
-	char scan_buf[0xffff];
+	*raw = NULL;
+	if (iw_nl80211_active(ifname))
+		return iw_nl80211_get_scan_list(ifname, trigger, target, arena);
 
 	/* We are checking errno when returning NULL, so reset it here */
 	errno = 0;
 
-	memset(&wrq, 0, sizeof(wrq));
-	strncpy(wrq.ifr_ifrn.ifrn_name, ifname, IFNAMSIZ);
-	if (ioctl(skfd, SIOCSIWSCAN, &wrq) < 0)
+	if (!trigger) {
+		/* Leftover results of earlier scans, EAGAIN if there are none */
+		ready = get_scan_results(h, &wrq);
 		goto done;
+	}
 
-	/* Larger initial timeout of 250ms between set and first get */
-	for (wait = 250; (waited += wait) < MAX_SCAN_WAIT; wait = 100) {
-		struct timeval tv = { 0, wait * 1000 };
-
-		while (select(0, NULL, NULL, NULL, &tv) < 0)
-			if (errno != EINTR && errno != EAGAIN)
-				return NULL;
+	/* Subscribe before triggering, so that the completion event is not missed */
+	events = h->ifindex && rtnl_scan_events_init() == 0;
+	errno  = 0;
 
-		wrq.u.data.pointer = scan_buf;
-		wrq.u.data.length  = sizeof(scan_buf);
-		wrq.u.data.flags   = 0;
+	if (target && range->we_version_compiled >= 21)
+		set_scan_req(&wrq, &sreq, range, target);
 
-		if (ioctl(skfd, SIOCGIWSCAN, &wrq) == 0)
-			break;
-	}
+	if (if_ioctl(h, SIOCSIWSCAN, &wrq) < 0)
+		goto done;
 
-	if (wrq.u.data.length) {
-		struct iw_event iwe;
-		struct stream_descr stream;
-		struct scan_entry *new = NULL;
-		int f = 0;		/* Idea taken from waproamd */
+	if (events) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec  += MAX_SCAN_WAIT / 1000;
+		deadline.tv_nsec += (MAX_SCAN_WAIT % 1000) * 1000000;
 
-		memset(&stream, 0, sizeof(stream));
-		stream.current = scan_buf;
-		stream.end     = scan_buf + wrq.u.data.length;
+		/*
+		 * Fetch results exactly when the driver reports them as ready.
+		 * Only EAGAIN means that they are not complete yet: after any
+		 * other error (e.g. E2BIG) no further event is going to come.
+		 */
+		while (!ready && rtnl_scan_events_wait(h->ifindex, &deadline) > 0) {
+			ready = get_scan_results(h, &wrq);
+			if (!ready && errno != EAGAIN)
+				goto done;
+		}
+		/* Some drivers do not send the event: try once more after timeout. */
+		if (!ready)
+			ready = get_scan_results(h, &wrq);
+	} else {
+		/* Fallback: larger initial timeout of 250ms between set and first get */
+		for (wait = 250; (waited += wait) < MAX_SCAN_WAIT; wait = 100) {
+			struct timeval tv = { 0, wait * 1000 };
 
-		while (iw_extract_event_stream(&stream, &iwe, we_version) > 0) {
-        		if (!new)
-				new = calloc(1, sizeof(*new));
+			while (select(0, NULL, NULL, NULL, &tv) < 0)
+				if (errno != EINTR && errno != EAGAIN)
+					goto done;
 
-			switch (iwe.cmd) {
-			case SIOCGIWAP:
-                		f = 1;
-				memcpy(&new->ap_addr, &iwe.u.ap_addr.sa_data, sizeof(new->ap_addr));
+			ready = get_scan_results(h, &wrq);
+			if (ready || errno != EAGAIN)
 				break;
-			case SIOCGIWESSID:
-                		f |= 2;
-				memset(new->essid, 0, sizeof(new->essid));
-
-				if (iwe.u.essid.flags && iwe.u.essid.pointer && iwe.u.essid.length)
-					memcpy(new->essid, iwe.u.essid.pointer, iwe.u.essid.length);
-				break;
-			case SIOCGIWMODE:
-				new->mode = iwe.u.mode;
-                    		f |= 4;
-				break;
-			case SIOCGIWFREQ:
-                		f |= 8;
-				new->freq = freq_to_hz(&iwe.u.freq);
-				break;
-			case SIOCGIWENCODE:
-                		f |= 16;
-				new->has_key = !(iwe.u.data.flags & IW_ENCODE_DISABLED);
-				break;
-			case IWEVQUAL:
-				f |= 32;
-				memcpy(&new->qual, &iwe.u.qual, sizeof(struct iw_quality));
-				break;
-			case IWEVGENIE:
-				f |= 64;
-				iw_extract_ie(&iwe, new);
-				break;
-			}
-			if (f == 127) {
-				f      = 0;
-				*tailp = new;
-				tailp  = &new->next;
-				new    = NULL;
-			}
 		}
-		free(new);	/* may have been allocated, but not filled in */
 	}
 done:
-	close(skfd);
+	/* Too much for wireless extensions - netlink dumps have no such limit */
+	if (!ready && errno == E2BIG && iw_nl80211_supported(ifname))
+		return iw_nl80211_get_scan_list(ifname, false, NULL, arena);
+	if (!ready)
+		return NULL;
+	if (!wrq.u.data.length)
+		return NULL;		/* errno = 0: no results */
+
+	/* Entries point into the results: keep a copy of the exact size. */
+	buf = malloc(wrq.u.data.length);
+	if (!buf)
+		err_sys("can not allocate scan results");
+	memcpy(buf, scan_buf.data, wrq.u.data.length);
+
+	if (range->we_version_compiled > 18)
+		n = we_index_v19(buf, wrq.u.data.length, &cells);
+	else
+		n = we_index_v18(buf, wrq.u.data.length, &cells);
+
+	scan_arena_reserve(arena, n * sizeof(struct scan_entry));
+	for (i = 0; i < n; i++) {
+		*tailp = we_cell_entry(buf, cells + i, arena);
+		if (*tailp)
+			tailp = &(*tailp)->next;
+	}
+	free(cells);
+
+	if (head)
+		*raw = buf;
+	else
+		free(buf);
+	errno = 0;
 	return head;
 }
 
 /*
- * Simple sort routine.
- * FIXME: use hash or tree to store entries, a list to display them.
+ *	Storage of scan entries.
+ *
+ * The entries of a scan all live exactly as long as its snapshot. Rather than
+ * allocating them one by one, they are carved out of chunks of doubling size,
+ * so that a scan needs a handful of allocations at most, and its entries are
+ * released by freeing the chunks.
  */
-void sort_scan_list(struct scan_entry **headp)
+#define SCAN_ARENA_MIN		4096
+#define SCAN_ARENA_ALIGN	__alignof__(struct scan_entry)
+
+/**
+ * struct scan_arena_chunk  -  one contiguous region of a scan_arena
+ * @prev:	previously allocated chunk (or NULL)
+ * @size:	capacity of @data in bytes
+ * @used:	number of bytes of @data handed out
+ * @data:	storage
+ */
+struct scan_arena_chunk {
+	struct scan_arena_chunk	*prev;
+	size_t			size,
+				used;
+	max_align_t		data[];
+};
+
+/** Make sure that the next @size bytes can be allocated from one chunk. */
+void scan_arena_reserve(struct scan_arena *arena, size_t size)
 {
-	struct scan_entry *head = NULL, *cur, *new = *headp, **prev;
+	struct scan_arena_chunk *c = arena->chunk;
+	size_t cap = c ? c->size * 2 : SCAN_ARENA_MIN;
 
-	while (new) {
-		for (cur = head, prev = &head; cur &&
-		     conf.scan_sort_asc == scan_cmp[conf.scan_sort_order](cur, new);
-		     prev = &cur->next, cur = cur->next)
-			;
-		*prev = new;
-		new = new->next;
-		(*prev)->next = cur;
+	if (c && c->size - c->used >= size)
+		return;
+	if (cap < size)
+		cap = size;
+
+	c = malloc(sizeof(*c) + cap);
+	if (!c)
+		err_sys("can not allocate scan entries");
+	c->prev = arena->chunk;
+	c->size = cap;
+	c->used = 0;
+	arena->chunk = c;
+	arena->allocs++;
+}
+
+/** Allocate @size zeroed bytes which remain valid until scan_arena_reset(). */
+void *scan_arena_alloc(struct scan_arena *arena, size_t size)
+{
+	void *p;
+
+	size = (size + SCAN_ARENA_ALIGN - 1) & ~(SCAN_ARENA_ALIGN - 1);
+	scan_arena_reserve(arena, size);
+
+	p = (char *)arena->chunk->data + arena->chunk->used;
+	arena->chunk->used += size;
+	arena->used	   += size;
+	return memset(p, 0, size);
+}
+
+/** Release everything allocated from @arena at once. */
+void scan_arena_reset(struct scan_arena *arena)
+{
+	struct scan_arena_chunk *c, *prev;
+
+	for (c = arena->chunk; c; c = prev) {
+		prev = c->prev;
+		free(c);
 	}
-	*headp = head;
+	memset(arena, 0, sizeof(*arena));
+}
+
+/*
+ * 	Channel statistics shown by the scan screen.
+ */
+
+/* Signal levels (dBm) at which a station adds nothing/fully to the load. */
+#define CHAN_LOAD_MIN_DBM	-95
+#define CHAN_LOAD_MAX_DBM	-35
+
+/* Account for @e in @h. */
+static void chan_hist_add(struct chan_hist *h, const struct scan_entry *e)
+{
+	const int slot = chan_hist_slot(e->freq, e->chan);
+	float weight = 1;
+
+	if (slot < 0)
+		return;
+	if (!(e->qual.updated & IW_QUAL_LEVEL_INVALID))
+		weight = (e->dbm.signal - CHAN_LOAD_MIN_DBM) /
+			 (CHAN_LOAD_MAX_DBM - CHAN_LOAD_MIN_DBM);
+
+	h->used += h->ch[slot].count++ == 0;
+	h->ch[slot].load += weight < 0 ? 0 : weight > 1 ? 1 : weight;
+}
+
+/* Whether channel slot @a is more crowded than @b, by count and then load. */
+static bool chan_busier(const struct chan_hist *h, int a, int b)
+{
+	if (h->ch[a].count != h->ch[b].count)
+		return h->ch[a].count > h->ch[b].count;
+	return h->ch[a].load > h->ch[b].load;
 }
 
-static void free_scan_list(struct scan_entry *head)
+/* Select the MAX_CH_STATS most (or least) crowded of the used channels. */
+static void chan_hist_top(struct chan_hist *h)
 {
-	if (head) {
-		free_scan_list(head->next);
-		free(head);
+	const bool least = conf.scan_sort_order == SO_CHAN && !conf.scan_sort_asc;
+	int slot, i, k;
+
+	for (slot = 0; slot < CHAN_HIST_SLOTS; slot++) {
+		if (!h->ch[slot].count)
+			continue;
+		/* Insert into the (short) sorted list of candidates */
+		for (i = h->num_top; i > 0; i--)
+			if (least ? !chan_busier(h, h->top[i - 1], slot) :
+				    !chan_busier(h, slot, h->top[i - 1]))
+				break;
+		if (i == MAX_CH_STATS)
+			continue;
+		k = h->num_top < MAX_CH_STATS ? h->num_top++ : MAX_CH_STATS - 1;
+		for (; k > i; k--)
+			h->top[k] = h->top[k - 1];
+		h->top[i] = slot;
 	}
 }
 
 /*
- * 	Channel statistics shown at the bottom of scan screen.
+ * Ranks of the ESSIDs and BSSIDs, used by the sort keys of scan_order_sort().
+ * The arrays to sort point into ss->entry, which tells the entry's index.
  */
+static int cmp_essid(const void *a, const void *b)
+{
+	return strcmp((**(struct scan_entry ***)a)->essid,
+		      (**(struct scan_entry ***)b)->essid);
+}
+
+static int cmp_ap_addr(const void *a, const void *b)
+{
+	return memcmp(&(**(struct scan_entry ***)a)->ap_addr,
+		      &(**(struct scan_entry ***)b)->ap_addr, sizeof(struct ether_addr));
+}
+
+/* Fill in ss->entry and ss->rank, after ss->num.entries has been counted. */
+static void rank_entries(struct scan_snapshot *ss)
+{
+	const size_t n = ss->num.entries;
+	struct scan_entry *cur, ***sorted;
+	size_t i, idx;
+	uint16_t rank;
+
+	if (!n)
+		return;
+	ss->entry = scan_arena_alloc(&ss->arena, n * sizeof(*ss->entry));
+	ss->rank  = scan_arena_alloc(&ss->arena, n * sizeof(*ss->rank));
+	sorted	  = malloc(n * sizeof(*sorted));
+	if (!sorted)
+		err_sys("can not rank scan entries");
+
+	for (i = 0, cur = ss->head; cur; cur = cur->next, i++) {
+		ss->entry[i] = cur;
+		sorted[i]    = ss->entry + i;
+	}
+
+	qsort(sorted, n, sizeof(*sorted), cmp_essid);
+	for (i = rank = 0; i < n; i++) {
+		rank += i && cmp_essid(sorted + i - 1, sorted + i);
+		idx   = sorted[i] - ss->entry;
+		ss->rank[idx].essid = rank;
+	}
+
+	qsort(sorted, n, sizeof(*sorted), cmp_ap_addr);
+	for (i = rank = 0; i < n; i++) {
+		rank += i && cmp_ap_addr(sorted + i - 1, sorted + i);
+		idx   = sorted[i] - ss->entry;
+		ss->rank[idx].bssid = rank;
+	}
+	free(sorted);
+}
 
 /*
- * For lsearch, it compares key value with array member, needs to
- * return 0 if they are the same, non-0 otherwise.
+ *	Publication of scan results.
+ *
+ * Each scan is collected into a new snapshot, invisible to the reader until
+ * it is complete; it then replaces the current one with an atomic pointer
+ * exchange. Hence the reader never waits for a running scan.
+ *
+ * Replaced snapshots are reclaimed RCU-style: the reader increments
+ * @reader_epoch when it starts and again when it stops using a snapshot, so
+ * that the epoch is odd while a snapshot is in use. A replaced snapshot is
+ * freed once the reader is seen outside the read-side section it was in at
+ * the time of the exchange - any later section sees the new snapshot.
  */
-static int cmp_key(const void *a, const void *b)
+static void free_snapshot(struct scan_snapshot *ss)
 {
-	return ((struct cnt *)a)->val - ((struct cnt *)b)->val;
+	scan_arena_reset(&ss->arena);
+	free(ss->raw);
+	free(ss);
 }
 
-/* For quick-sorting the array in descending order of counts */
-static int cmp_cnt(const void *a, const void *b)
+/* Cleanup handler for a snapshot under construction. */
+static void discard_snapshot(void *ss)
 {
-	if (conf.scan_sort_order == SO_CHAN && !conf.scan_sort_asc)
-		return ((struct cnt *)a)->count - ((struct cnt *)b)->count;
-	return ((struct cnt *)b)->count - ((struct cnt *)a)->count;
+	free_snapshot(ss);
 }
 
 /**
- * Fill in sr->channel_stats (must not have been allocated yet).
+ * Begin using the current snapshot (NULL if there is none yet).
+ * The reader must call scan_snapshot_put() when done with it.
  */
-static void compute_channel_stats(struct scan_result *sr)
+const struct scan_snapshot *scan_snapshot_get(struct scan_result *sr)
 {
-	struct scan_entry *cur;
-	struct cnt *bin, key = {0, 0};
-	size_t n = 0;
+	__atomic_add_fetch(&sr->reader_epoch, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&sr->current, __ATOMIC_SEQ_CST);
+}
 
-	if (!sr->num.entries)
-		return;
+void scan_snapshot_put(struct scan_result *sr)
+{
+	__atomic_add_fetch(&sr->reader_epoch, 1, __ATOMIC_RELEASE);
+}
+
+/* Free those retired snapshots which the reader can no longer be using. */
+static void reclaim_snapshots(struct scan_result *sr)
+{
+	unsigned long epoch = __atomic_load_n(&sr->reader_epoch, __ATOMIC_SEQ_CST);
+	struct scan_snapshot **prev = &sr->retired, *cur;
 
-	sr->channel_stats = calloc(sr->num.entries, sizeof(key));
-	for (cur = sr->head; cur; cur = cur->next) {
-		if (cur->chan >= 0) {
-			key.val = cur->chan;
-			bin = lsearch(&key, sr->channel_stats, &n, sizeof(key), cmp_key);
-			if (bin)
-				bin->count++;
+	while ((cur = *prev)) {
+		if (!(cur->retire_epoch & 1) || cur->retire_epoch != epoch) {
+			*prev = cur->next_retired;
+			free_snapshot(cur);
+		} else {
+			prev = &cur->next_retired;
 		}
 	}
+}
 
-	if (n > 0) {
-		qsort(sr->channel_stats, n, sizeof(key), cmp_cnt);
-	} else {
-		free(sr->channel_stats);
-		sr->channel_stats = NULL;
+/* Make @ss the current snapshot, and notify the reader. */
+static void publish_snapshot(struct scan_result *sr, struct scan_snapshot *ss)
+{
+	struct scan_snapshot *old;
+	uint64_t one = 1;
+
+	ss->gen = sr->current ? sr->current->gen + 1 : 1;
+	old = __atomic_exchange_n(&sr->current, ss, __ATOMIC_SEQ_CST);
+	if (old) {
+		old->retire_epoch = __atomic_load_n(&sr->reader_epoch,
+						    __ATOMIC_SEQ_CST);
+		old->next_retired = sr->retired;
+		sr->retired	  = old;
 	}
-	sr->num.ch_stats = n < MAX_CH_STATS ? n : MAX_CH_STATS;
+	reclaim_snapshots(sr);
+
+	if (write(sr->notify_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		err_sys("can not signal new scan results");
 }
 
 /*
@@ -800,97 +1068,477 @@ void scan_result_init(struct scan_result *sr)
 {
 	memset(sr, 0, sizeof(*sr));
 	iw_getinf_range(conf_ifname(), &sr->range);
-	pthread_mutex_init(&sr->mutex, NULL);
+	sr->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (sr->notify_fd < 0)
+		err_sys("can not create scan notification descriptor");
 }
 
+/* Must only be called after the scan thread has terminated. */
 void scan_result_fini(struct scan_result *sr)
 {
-	free_scan_list(sr->head);
-	free(sr->channel_stats);
-	pthread_mutex_destroy(&sr->mutex);
+	struct scan_snapshot *cur;
+
+	while ((cur = sr->retired)) {
+		sr->retired = cur->next_retired;
+		free_snapshot(cur);
+	}
+	if (sr->current)
+		free_snapshot(sr->current);
+	ap_table_fini(&sr->aps);
+	scan_filter_free(sr->filter);
+	scan_filter_free(sr->filter_next);
+	close(sr->notify_fd);
 }
 
-/** The actual scan thread. */
-void *do_scan(void *sr_ptr)
+/**
+ * scan_result_set_filter  -  hand a new filter over to the scan thread
+ * @sr:	scan results
+ * @f:	compiled filter, owned by @sr from now on
+ * The filter applies from the next scan on; snapshots made with it carry its
+ * @gen, which equals @sr->filter_gen after this call.
+ */
+void scan_result_set_filter(struct scan_result *sr, struct scan_filter *f)
 {
-	struct scan_result *sr = (struct scan_result *)sr_ptr;
-	struct scan_entry *cur;
+	f->gen = ++sr->filter_gen;
+	scan_filter_free(__atomic_exchange_n(&sr->filter_next, f, __ATOMIC_ACQ_REL));
+}
 
-	pthread_detach(pthread_self());
+/* Drop the entries of @ss which do not pass the current filter. */
+static void filter_entries(struct scan_result *sr, struct scan_snapshot *ss)
+{
+	struct scan_filter *f = __atomic_exchange_n(&sr->filter_next, NULL,
+						    __ATOMIC_ACQ_REL);
+	struct scan_entry **tailp = &ss->head;
 
-	do {
-		pthread_mutex_lock(&sr->mutex);
-
-		free_scan_list(sr->head);
-		free(sr->channel_stats);
-
-		sr->head          = NULL;
-		sr->channel_stats = NULL;
-		sr->msg[0]        = '\0';
-		sr->max_essid_len = MAX_ESSID_LEN;
-		memset(&(sr->num), 0, sizeof(sr->num));
-
-		sr->head = get_scan_list(conf_ifname(), sr->range.we_version_compiled);
-		if (!sr->head) {
-			switch(errno) {
-			case EPERM:
-				/* Don't try to read leftover results, it does not work reliably. */
-				if (!has_net_admin_capability())
-					snprintf(sr->msg, sizeof(sr->msg),
-						 "This screen requires CAP_NET_ADMIN permissions");
-				break;
-			case EFAULT:
-				/*
-				 * EFAULT can occur after a window resizing event and is temporary.
-				 * It may also occur when the interface is down, hence defer handling.
-				 */
-				break;
-			case EINTR:
-			case EBUSY:
-			case EAGAIN:
-				/* Temporary errors. */
-				snprintf(sr->msg, sizeof(sr->msg), "Waiting for scan data on %s ...", conf_ifname());
-				break;
-			case ENETDOWN:
-				snprintf(sr->msg, sizeof(sr->msg), "Interface %s is down - setting it up ...", conf_ifname());
-				if (if_set_up(conf_ifname()) < 0)
-					err_sys("Can not bring up interface '%s'", conf_ifname());
-				break;
-			case E2BIG:
-				/*
-				 * This is a driver issue, since already using the largest possible
-				 * scan buffer. See comments in iwlist.c of wireless tools.
-				 */
-				snprintf(sr->msg, sizeof(sr->msg),
-					 "No scan on %s: Driver returned too much data", conf_ifname());
-				break;
-			case 0:
-				snprintf(sr->msg, sizeof(sr->msg), "Empty scan results on %s", conf_ifname());
-				break;
-			default:
-				snprintf(sr->msg, sizeof(sr->msg),
-					 "Scan failed on %s: %s", conf_ifname(), strerror(errno));
-			}
+	if (f) {
+		scan_filter_free(sr->filter);
+		sr->filter = f;
+	}
+	if (!sr->filter)
+		return;
+
+	ss->filter_gen = sr->filter->gen;
+	while (*tailp) {
+		if (scan_filter_match(sr->filter, *tailp)) {
+			tailp = &(*tailp)->next;
+		} else {
+			*tailp = (*tailp)->next;
+			ss->num.filtered++;
 		}
+	}
+	if (!ss->head && ss->num.filtered)
+		snprintf(ss->msg, sizeof(ss->msg),
+			 "None of %d scan results matches the filter",
+			 ss->num.filtered);
+}
+
+/*
+ *	Watch list
+ *
+ * The scan_watch setting is a comma-separated list of ESSIDs, BSSIDs, and
+ * channels (written as "ch" followed by the number). Between full sweeps,
+ * the scan thread only scans for these: it probes for the ESSIDs, on the
+ * listed channels and on those where watched stations were last seen. Such
+ * directed scans take a fraction of the time of a full sweep, so watched
+ * stations can be refreshed much more often at less time off channel.
+ */
 
-		for (cur = sr->head; cur; cur = cur->next) {
+/**
+ * struct scan_watch  -  parsed watch list
+ * @target:	ESSIDs and channels to scan; @target.freq starts with the
+ *		@num_fixed channels from the list, followed by learned ones
+ * @num_fixed:	number of channels given explicitly
+ * @bssid:	BSSIDs to watch
+ * @num_bssid:	number of entries in @bssid
+ */
+struct scan_watch {
+	struct scan_target	target;
+	int			num_fixed;
+	struct ether_addr	bssid[MAX_SCAN_TARGETS];
+	int			num_bssid;
+};
+
+static void watch_add_freq(struct scan_target *target, uint32_t mhz)
+{
+	int i;
+
+	for (i = 0; i < target->num_freq; i++)
+		if (target->freq[i] == mhz)
+			return;
+	if (mhz && target->num_freq < IW_MAX_FREQUENCIES)
+		target->freq[target->num_freq++] = mhz;
+}
+
+static void watch_parse(struct scan_watch *watch, const char *list,
+			const struct iw_range *range)
+{
+	char *buf = strdup(list), *tok, *save = NULL;
+	struct ether_addr *mac;
+	unsigned int chan, mhz;
+	int n;
+
+	memset(watch, 0, sizeof(*watch));
+	for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if ((mac = ether_aton(tok))) {
+			if (watch->num_bssid < MAX_SCAN_TARGETS)
+				watch->bssid[watch->num_bssid++] = *mac;
+		} else if (sscanf(tok, "ch%u%n", &chan, &n) == 1 && !tok[n]) {
+			mhz = channel_to_freq(chan, range) / 1e6;
+			watch_add_freq(&watch->target,
+				       mhz ? : ieee80211_channel_to_freq(chan));
+		} else if (watch->target.num_essid < MAX_SCAN_TARGETS) {
+			strncpy(watch->target.essid[watch->target.num_essid++],
+				tok, IW_ESSID_MAX_SIZE);
+		}
+	}
+	watch->num_fixed = watch->target.num_freq;
+	free(buf);
+}
+
+static bool watch_match(const struct scan_watch *watch,
+			const struct scan_entry *cur)
+{
+	int i;
+
+	for (i = 0; i < watch->num_bssid; i++)
+		if (memcmp(&cur->ap_addr, &watch->bssid[i], sizeof(cur->ap_addr)) == 0)
+			return true;
+	for (i = 0; i < watch->target.num_essid; i++)
+		if (strncmp(cur->essid, watch->target.essid[i], IW_ESSID_MAX_SIZE) == 0)
+			return true;
+	return false;
+}
+
+/* Learn on which channels the watched stations currently are. */
+static void watch_update(struct scan_watch *watch, const struct scan_snapshot *ss)
+{
+	const struct scan_entry *cur;
+
+	watch->target.num_freq = watch->num_fixed;
+	for (cur = ss->head; cur; cur = cur->next)
+		if (watch_match(watch, cur))
+			watch_add_freq(&watch->target, cur->freq ? :
+				       ieee80211_channel_to_freq(cur->chan));
+}
+
+/* Whether a directed scan would cover something. */
+static bool watch_active(const struct scan_watch *watch)
+{
+	return watch->target.num_essid || watch->target.num_freq;
+}
+
+/*
+ *	Scan scheduling
+ *
+ * An active scan takes the radio off its operating channel, which disturbs
+ * the data traffic. Hence scans are not repeated back-to-back: the interval
+ * starts at scan_iv and doubles after each scan that finds the same set of
+ * stations, up to SCAN_BACKOFF_MAX times scan_iv. It is halved when some
+ * stations appeared or disappeared, and reset to scan_iv when more than
+ * SCAN_CHURN_PCT percent did. Independent of that, the time spent scanning
+ * does not exceed SCAN_DUTY_MAX_PCT percent, measured over the durations of
+ * the last SCAN_DUTY_WINDOW scans, so that one quick scan does not lift it.
+ *
+ * With a watch list, full sweeps still follow this interval. In between,
+ * directed scans are made every scan_iv, subject to the same duty cycle cap.
+ */
+#define SCAN_BACKOFF_MAX	8
+#define SCAN_CHURN_PCT		25
+#define SCAN_DUTY_MAX_PCT	10
+#define SCAN_DUTY_WINDOW	8
+
+/**
+ * struct scan_sched  -  scan scheduler state, private to the scan thread
+ * @interval_ms: time between the end of one scan and the start of the next
+ * @recent_ms:	 durations of the last SCAN_DUTY_WINDOW scans (ring buffer)
+ * @recent_sum:	 sum of @recent_ms
+ * @bss:	 sorted BSSIDs found by the most recent scan
+ * @num_bss:	 number of entries in @bss
+ * @start:	 CLOCK_MONOTONIC time at which scanning began
+ * @scans:	 number of scans performed since @start
+ * @busy_ms:	 total duration of these scans
+ * @last_full:	 CLOCK_MONOTONIC start of the most recent full sweep
+ * @watch:	 stations to scan for between full sweeps
+ */
+struct scan_sched {
+	unsigned int		interval_ms,
+				recent_ms[SCAN_DUTY_WINDOW],
+				recent_sum;
+	struct ether_addr	*bss;
+	size_t			num_bss;
+	struct timespec		start;
+	unsigned long		scans;
+	uint64_t		busy_ms;
+	struct timespec		last_full;
+	struct scan_watch	watch;
+};
+
+static uint64_t ms_since(const struct timespec *then)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - then->tv_sec) * 1000 +
+	       (now.tv_nsec - then->tv_nsec) / 1000000;
+}
+
+static int cmp_bssid(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(struct ether_addr));
+}
+
+/* Replace the BSSID set of @sched by that of @ss, return how many changed. */
+static size_t bss_churn(struct scan_sched *sched, const struct scan_snapshot *ss)
+{
+	struct ether_addr *bss;
+	const struct scan_entry *cur;
+	size_t i = 0, j = 0, n = 0, changed = 0;
+	int cmp;
+
+	for (cur = ss->head; cur; cur = cur->next)
+		n++;
+	bss = calloc(n + 1, sizeof(*bss));
+	if (!bss)
+		err_sys("can not allocate BSSID set");
+	for (cur = ss->head, n = 0; cur; cur = cur->next)
+		bss[n++] = cur->ap_addr;
+	qsort(bss, n, sizeof(*bss), cmp_bssid);
+
+	/* Merge the two sorted sets, counting the entries not in both. */
+	while (i < sched->num_bss || j < n) {
+		if (i == sched->num_bss)
+			cmp = 1;
+		else if (j == n)
+			cmp = -1;
+		else
+			cmp = cmp_bssid(sched->bss + i, bss + j);
+
+		changed += cmp != 0;
+		i	+= cmp <= 0;
+		j	+= cmp >= 0;
+	}
+
+	free(sched->bss);
+	sched->bss	= bss;
+	sched->num_bss	= n;
+	return changed;
+}
+
+/* Account for a completed scan of @duration_ms that produced @ss. */
+static void scan_sched_update(struct scan_sched *sched,
+			      const struct scan_snapshot *ss,
+			      unsigned int duration_ms)
+{
+	const unsigned int min_iv = conf.scan_iv * 1000,
+			   max_iv = min_iv * SCAN_BACKOFF_MAX;
+	unsigned int *slot = sched->recent_ms + sched->scans % SCAN_DUTY_WINDOW;
+	size_t changed, total;
+
+	sched->recent_sum += duration_ms - *slot;
+	*slot		   = duration_ms;
+	sched->scans++;
+	sched->busy_ms += duration_ms;
+
+	/* Only full sweeps show whether the set of stations is stable */
+	if (ss->directed)
+		return;
+	sched->last_full = ss->triggered;
+	changed = bss_churn(sched, ss);
+	total	= max(sched->num_bss, 1);
+
+	if (changed == 0)
+		sched->interval_ms *= 2;
+	else if (changed * 100 > total * SCAN_CHURN_PCT)
+		sched->interval_ms = min_iv;
+	else
+		sched->interval_ms /= 2;
+	sched->interval_ms = clamp(sched->interval_ms, min_iv, max_iv);
+}
+
+/* Milliseconds to wait before the next scan. */
+static unsigned int scan_sched_delay(const struct scan_sched *sched)
+{
+	unsigned int num = min(sched->scans, SCAN_DUTY_WINDOW),
+		     avg_ms = num ? sched->recent_sum / num : 0,
+		     duty_min = avg_ms * (100 - SCAN_DUTY_MAX_PCT) / SCAN_DUTY_MAX_PCT;
+
+	if (conf.scan_passive)		/* reading the cache is cheap */
+		return conf.stat_iv;
+	if (watch_active(&sched->watch))
+		return max(conf.scan_iv * 1000, duty_min);
+	return max(sched->interval_ms, duty_min);
+}
+
+/* Whether the next scan can be a directed one rather than a full sweep. */
+static bool scan_sched_directed(const struct scan_sched *sched)
+{
+	return watch_active(&sched->watch) && sched->num_bss &&
+	       ms_since(&sched->last_full) < sched->interval_ms;
+}
+
+static void scan_sched_stats(const struct scan_sched *sched,
+			     struct scan_sched_stats *stats)
+{
+	uint64_t elapsed = ms_since(&sched->start);
+
+	stats->interval_ms = scan_sched_delay(sched);
+	stats->period_ms   = sched->scans > 1 ? elapsed / sched->scans : 0;
+	stats->offchan_pct = elapsed ? 1e2 * sched->busy_ms / elapsed : 0;
+}
+
+static void scan_sched_fini(void *arg)
+{
+	free(((struct scan_sched *)arg)->bss);
+}
+
+/**
+ * scan_once  -  collect and publish one set of scan results
+ * @sr:      where to publish the results
+ * @trigger: whether to scan, or only to read results cached by the kernel
+ * @sched:   scheduler to inform about the scan, which also decides whether
+ *	     a triggered scan is directed at the watch list
+ * A cache read that finds nothing is not published unless in passive mode,
+ * so that the 'waiting' message stays up until the scan has completed.
+ */
+static void scan_once(struct scan_result *sr, bool trigger,
+		      struct scan_sched *sched)
+{
+	struct scan_snapshot *ss;
+	struct scan_entry *cur;
+	int old_state;
+
+	ss = calloc(1, sizeof(*ss));
+	if (!ss)
+		err_sys("can not allocate scan results");
+	pthread_cleanup_push(discard_snapshot, ss);
+
+	ss->max_essid_len = MAX_ESSID_LEN;
+	ss->cached	  = !trigger;
+	ss->directed	  = trigger && scan_sched_directed(sched);
+
+	clock_gettime(CLOCK_MONOTONIC, &ss->triggered);
+	ss->head = get_scan_list(conf_ifname(), &sr->range, trigger,
+				 ss->directed ? &sched->watch.target : NULL,
+				 &ss->raw, &ss->arena);
+	if (!ss->head) {
+		switch(errno) {
+		case EPERM:
+			/* Don't try to read leftover results, it does not work reliably. */
+			if (!has_net_admin_capability())
+				snprintf(ss->msg, sizeof(ss->msg),
+					 "This screen requires CAP_NET_ADMIN permissions");
+			break;
+		case EFAULT:
+			/*
+			 * EFAULT can occur after a window resizing event and is temporary.
+			 * It may also occur when the interface is down, hence defer handling.
+			 */
+			break;
+		case EINTR:
+		case EBUSY:
+		case EAGAIN:
+			/* Temporary errors. */
+			snprintf(ss->msg, sizeof(ss->msg), "Waiting for scan data on %s ...", conf_ifname());
+			break;
+		case ENETDOWN:
+			snprintf(ss->msg, sizeof(ss->msg), "Interface %s is down - setting it up ...", conf_ifname());
+			if (if_set_up(conf_ifname()) < 0)
+				err_sys("Can not bring up interface '%s'", conf_ifname());
+			break;
+		case E2BIG:
+			/*
+			 * This is a driver issue, since already using the largest possible
+			 * scan buffer. See comments in iwlist.c of wireless tools.
+			 */
+			snprintf(ss->msg, sizeof(ss->msg),
+				 "No scan on %s: Driver returned too much data", conf_ifname());
+			break;
+		case 0:
+			snprintf(ss->msg, sizeof(ss->msg), "%s scan results on %s",
+				 ss->cached ? "No cached" : "Empty", conf_ifname());
+			break;
+		default:
+			snprintf(ss->msg, sizeof(ss->msg),
+				 "Scan failed on %s: %s", conf_ifname(), strerror(errno));
+		}
+	}
+	pthread_cleanup_pop(0);
+
+	/* Once complete, the snapshot must not be lost to cancellation. */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+	if (!ss->head && ss->cached && !conf.scan_passive) {
+		free_snapshot(ss);
+	} else {
+		for (cur = ss->head; cur; cur = cur->next) {
+			iw_sanitize(&sr->range, &cur->qual, &cur->dbm);
+			if (cur->freq)
+				cur->chan = max(freq_to_channel(cur->freq * 1e6,
+								&sr->range), 0);
+		}
+		/* Before carrying over missed stations, which would hide churn */
+		if (trigger)
+			scan_sched_update(sched, ss, ms_since(&ss->triggered));
+		ap_table_update(&sr->aps, ss);
+		/* The watch list is about stations regardless of the filter */
+		watch_update(&sched->watch, ss);
+		filter_entries(sr, ss);
+
+		for (cur = ss->head; cur; cur = cur->next) {
 			if (str_is_ascii(cur->essid))
-				sr->max_essid_len = clamp(strlen(cur->essid),
-							  sr->max_essid_len,
+				ss->max_essid_len = clamp(strlen(cur->essid),
+							  ss->max_essid_len,
 							  IW_ESSID_MAX_SIZE);
-			iw_sanitize(&sr->range, &cur->qual, &cur->dbm);
-			cur->chan = freq_to_channel(cur->freq, &sr->range);
-			if (cur->freq >= 5e9)
-				sr->num.five_gig++;
-			else if (cur->freq >= 2e9)
-				sr->num.two_gig++;
-			sr->num.entries += 1;
-			sr->num.open    += !cur->has_key;
+			if (cur->freq >= 5000)
+				ss->num.five_gig++;
+			else if (cur->freq >= 2000)
+				ss->num.two_gig++;
+			ss->num.entries += 1;
+			ss->num.open    += !cur->has_key;
+			chan_hist_add(&ss->chan, cur);
+		}
+		chan_hist_top(&ss->chan);
+		rank_entries(ss);
+		ap_table_spark(&sr->aps, ss);
+		scan_sched_stats(sched, &ss->sched);
+		publish_snapshot(sr, ss);
+	}
+	pthread_setcancelstate(old_state, NULL);
+}
+
+/** The actual scan thread. */
+void *do_scan(void *sr_ptr)
+{
+	struct scan_result *sr = (struct scan_result *)sr_ptr;
+	struct scan_sched sched = { .interval_ms = conf.scan_iv * 1000 };
+	struct timespec wake;
+	unsigned int delay;
+
+	clock_gettime(CLOCK_MONOTONIC, &sched.start);
+	watch_parse(&sched.watch, conf.scan_watch, &sr->range);
+	pthread_cleanup_push(scan_sched_fini, &sched);
+
+	/* The kernel often has recent results already, e.g. from the supplicant. */
+	if (!conf.scan_passive)
+		scan_once(sr, false, &sched);
+
+	for (;;) {
+		scan_once(sr, !conf.scan_passive, &sched);
+
+		clock_gettime(CLOCK_MONOTONIC, &wake);
+		delay	      = scan_sched_delay(&sched);
+		wake.tv_sec  += delay / 1000;
+		wake.tv_nsec += delay % 1000 * 1000000;
+		if (wake.tv_nsec >= 1000000000) {
+			wake.tv_sec++;
+			wake.tv_nsec -= 1000000000;
 		}
-		compute_channel_stats(sr);
 
-		pthread_mutex_unlock(&sr->mutex);
-	} while (usleep(conf.stat_iv * 1000) == 0);
+		/* As in sampling.c: signals neither end nor extend the wait. */
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &wake, NULL) == EINTR)
+			;
+	}
 
+	pthread_cleanup_pop(1);
 	return NULL;
 }
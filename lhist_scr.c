@@ -19,8 +19,8 @@
  */
 #include "iw_if.h"
 
-/* Number of lines in the key window at the bottom */
-#define KEY_WIN_HEIGHT	3
+/* Number of lines in the key window at the bottom (legend + sampling) */
+#define KEY_WIN_HEIGHT	4
 
 /* Total number of lines in the histogram window */
 #define HIST_WIN_HEIGHT	(WAV_HEIGHT - KEY_WIN_HEIGHT)
@@ -117,11 +117,24 @@ static struct iw_levelstat iw_cache_get(const uint32_t index)
 	return iw_stats_cache[(count - index) % IW_STACKSIZE];
 }
 
-void iw_cache_update(struct iw_stat *iw)
+/* Averaging of samples into the current slot */
+static struct iw_levelstat prev, avg = IW_LSTAT_INIT;
+static int slot;
+
+/** Start a new history, e.g. when sampling a different interface. */
+void iw_cache_reset(void)
 {
-	static struct iw_levelstat prev, avg = IW_LSTAT_INIT;
-	static int slot;
+	struct iw_levelstat init = IW_LSTAT_INIT;
+
+	count = slot = 0;
+	prev  = avg = init;
+	init_extrema(&e_signal);
+	init_extrema(&e_noise);
+	init_extrema(&e_snr);
+}
 
+void iw_cache_update(const struct iw_sample *iw)
+{
 	if (! (iw->stat.qual.updated & IW_QUAL_LEVEL_INVALID)) {
 		avg.flags  &= ~IW_QUAL_LEVEL_INVALID;
 		avg.signal += iw->dbm.signal / conf.slotsize;
@@ -275,6 +288,37 @@ static void display_lhist(void)
 	wrefresh(w_lhist);
 }
 
+static const char *fmt_usecs(unsigned long usecs)
+{
+	static char buf[4][16];
+	static int i;
+
+	i = (i + 1) % ARRAY_SIZE(buf);
+	if (usecs < 1000)
+		snprintf(buf[i], sizeof(buf[i]), "%luus", usecs);
+	else
+		snprintf(buf[i], sizeof(buf[i]), "%.1fms", usecs / 1e3);
+	return buf[i];
+}
+
+/* Timing quality of the samples the histogram is built from */
+static void display_sampling(WINDOW *w_key)
+{
+	struct sampling_stats st;
+
+	sampling_get_stats(&st);
+
+	wmove(w_key, 2, 1);
+	wclrtoborder(w_key);
+	wprintw(w_key, "sampling every %dms%s, lateness p50 <%s p99 <%s max %s",
+		conf.stat_iv, st.realtime ? " (rt)" : "",
+		fmt_usecs(sampling_late_percentile(&st, 50)),
+		fmt_usecs(sampling_late_percentile(&st, 99)),
+		fmt_usecs(st.late_max_us));
+	if (st.missed || st.dropped)
+		wprintw(w_key, ", missed %lu, dropped %lu", st.missed, st.dropped);
+}
+
 static void display_key(WINDOW *w_key)
 {
 	/* Clear the (one-line) screen) */
@@ -301,16 +345,17 @@ static void display_key(WINDOW *w_key)
 	wattrset(w_key, COLOR_PAIR(CP_STANDARD));
 	wprintw(w_key, "] S-N ratio (%s)", fmt_extrema(&e_snr, "dB"));
 
+	display_sampling(w_key);
 	wrefresh(w_key);
 }
 
-static void redraw_lhist(int signum)
+/* Redraw only when a new histogram slot has been completed. */
+static void redraw_lhist(void)
 {
-	static int vcount = 1;
+	static uint32_t drawn;
 
-	sampling_do_poll();
-	if (!--vcount) {
-		vcount = conf.slotsize;
+	if (count != drawn) {
+		drawn = count;
 		display_lhist();
 		display_key(w_key);
 	}
@@ -321,12 +366,9 @@ void scr_lhist_init(void)
 	w_lhist = newwin_title(0, HIST_WIN_HEIGHT, "Level histogram", true);
 	w_key   = newwin_title(HIST_MAXYLEN + 1, KEY_WIN_HEIGHT, "Key", false);
 
-	init_extrema(&e_signal);
-	init_extrema(&e_noise);
-	init_extrema(&e_snr);
-	sampling_init(redraw_lhist);
-
+	display_lhist();
 	display_key(w_key);
+	sampling_set_view(redraw_lhist);
 }
 
 int scr_lhist_loop(WINDOW *w_menu)
@@ -336,7 +378,7 @@ int scr_lhist_loop(WINDOW *w_menu)
 
 void scr_lhist_fini(void)
 {
-	sampling_stop();
+	sampling_set_view(NULL);
 	delwin(w_lhist);
 	delwin(w_key);
 }
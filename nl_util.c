@@ -0,0 +1,310 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "wavemon.h"
+#include "nl_util.h"
+#include <poll.h>
+
+/** Open a netlink socket of @protocol. Return 0 if ok, -errno on error. */
+int nl_open(struct nl_sock *nl, int protocol)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	int one = 1;
+
+	memset(nl, 0, sizeof(*nl));
+	nl->protocol = protocol;
+	nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+	if (nl->fd < 0)
+		return -errno;
+
+	if (bind(nl->fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		goto fail;
+	/* Only report the error code, not the whole original request */
+	setsockopt(nl->fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+
+	nl->buf = malloc(NL_BUFSIZE);
+	if (nl->buf == NULL)
+		err_sys("malloc(netlink buffer)");
+	nl->seq = time(NULL);
+	return 0;
+fail:
+	one = -errno;
+	close(nl->fd);
+	nl->fd = -1;
+	return one;
+}
+
+void nl_close(struct nl_sock *nl)
+{
+	if (nl->fd >= 0)
+		close(nl->fd);
+	free(nl->buf);
+	nl->fd  = -1;
+	nl->buf = NULL;
+}
+
+/** Subscribe @nl to multicast @group. Return 0 if ok, -errno on error. */
+int nl_join_group(struct nl_sock *nl, uint32_t group)
+{
+	if (setsockopt(nl->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+		       &group, sizeof(group)) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * nl_parse  -  walk the netlink messages contained in @buf
+ * @buf:  one or more netlink messages as returned by recv(2)
+ * @len:  length of @buf in bytes
+ * @seq:  only pass on messages with this sequence number (0 = all)
+ * @cb:   called for each data message
+ * @arg:  passed on to @cb
+ * Returns 1 if more messages are expected (multipart, not yet done), 0 if the
+ * request completed, and a negative errno value on error.
+ */
+int nl_parse(const void *buf, size_t len, uint32_t seq,
+	     nl_msg_cb cb, void *arg)
+{
+	const struct nlmsghdr *nlh;
+	int ret, rem = len;
+
+	for (nlh = buf; NLMSG_OK(nlh, rem); nlh = NLMSG_NEXT(nlh, rem)) {
+		if (seq && nlh->nlmsg_seq != seq)
+			continue;
+
+		switch (nlh->nlmsg_type) {
+		case NLMSG_NOOP:
+		case NLMSG_OVERRUN:
+			continue;
+		case NLMSG_DONE:
+			return 0;
+		case NLMSG_ERROR:
+			if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+				return -EBADMSG;
+			/* error == 0 is the acknowledgment of a request */
+			return ((const struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+		}
+
+		if (cb && (ret = cb(nlh, arg)) < 0)
+			return ret;
+	}
+	/* Requests end in NLMSG_DONE (dumps) or an acknowledgment. */
+	return 1;
+}
+
+/**
+ * Receive into @nl->buf, waiting at most @timeout_ms (-1 = forever).
+ * Returns the number of bytes received, 0 on timeout, -errno on error.
+ */
+int nl_recv(struct nl_sock *nl, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = nl->fd, .events = POLLIN };
+	ssize_t len;
+
+	if (timeout_ms >= 0) {
+		int ret = poll(&pfd, 1, timeout_ms);
+
+		if (ret <= 0)
+			return ret < 0 ? -errno : 0;
+	}
+
+	do {
+		len = recv(nl->fd, nl->buf, NL_BUFSIZE, MSG_TRUNC);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -errno;
+	if (len > NL_BUFSIZE)
+		return -EMSGSIZE;
+	return len;
+}
+
+/**
+ * nl_talk  -  send @req on @nl and process the reply
+ * Non-dump requests are sent with NLM_F_ACK, so that each request has a well
+ * defined end. Returns 0 if ok, negative errno value otherwise.
+ */
+int nl_talk(struct nl_sock *nl, struct nlmsghdr *req, nl_msg_cb cb, void *arg)
+{
+	int len, ret;
+
+	req->nlmsg_flags |= NLM_F_REQUEST;
+	if (!(req->nlmsg_flags & NLM_F_DUMP))
+		req->nlmsg_flags |= NLM_F_ACK;
+	req->nlmsg_seq = ++nl->seq ? : ++nl->seq;
+	req->nlmsg_pid = 0;
+
+	while (send(nl->fd, req, req->nlmsg_len, 0) < 0)
+		if (errno != EINTR)
+			return -errno;
+	__sync_fetch_and_add(&nl->requests, 1);
+
+	do {
+		len = nl_recv(nl, -1);
+		if (len < 0)
+			return len;
+		ret = nl_parse(nl->buf, len, req->nlmsg_seq, cb, arg);
+	} while (ret > 0);
+
+	return ret;
+}
+
+/*
+ *	Message construction
+ */
+struct nlmsghdr *nl_msg_init(void *buf, uint16_t type, uint16_t flags)
+{
+	struct nlmsghdr *nlh = buf;
+
+	memset(buf, 0, NL_REQ_SIZE);
+	nlh->nlmsg_len	 = NLMSG_LENGTH(0);
+	nlh->nlmsg_type	 = type;
+	nlh->nlmsg_flags = flags;
+	return nlh;
+}
+
+/* Append @len zeroed bytes (e.g. a fixed protocol header) to @nlh. */
+void *nl_msg_reserve(struct nlmsghdr *nlh, size_t len)
+{
+	void *tail = (char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len);
+
+	assert(NLMSG_ALIGN(nlh->nlmsg_len) + NLMSG_ALIGN(len) <= NL_REQ_SIZE);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLMSG_ALIGN(len);
+	return tail;
+}
+
+void nl_attr_put(struct nlmsghdr *nlh, uint16_t type,
+		 const void *data, size_t len)
+{
+	struct nlattr *nla = nl_msg_reserve(nlh, NLA_HDRLEN + len);
+
+	nla->nla_type = type;
+	nla->nla_len  = NLA_HDRLEN + len;
+	if (len)
+		memcpy((char *)nla + NLA_HDRLEN, data, len);
+}
+
+struct nlattr *nl_attr_nest_start(struct nlmsghdr *nlh, uint16_t type)
+{
+	struct nlattr *nest = nl_msg_reserve(nlh, NLA_HDRLEN);
+
+	nest->nla_type = type | NLA_F_NESTED;
+	return nest;
+}
+
+void nl_attr_nest_end(struct nlmsghdr *nlh, struct nlattr *nest)
+{
+	nest->nla_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+}
+
+/*
+ *	Attribute parsing
+ */
+
+/**
+ * Index the attributes in @data by type into @tb[0..@maxtype]. Unknown
+ * attributes are skipped, later duplicates override earlier ones.
+ */
+void nl_attr_parse(const struct nlattr *tb[], int maxtype,
+		   const void *data, size_t len)
+{
+	const struct nlattr *nla;
+	int type;
+
+	memset(tb, 0, (maxtype + 1) * sizeof(*tb));
+	nl_attr_for_each(nla, data, len) {
+		type = nla->nla_type & NLA_TYPE_MASK;
+		if (type <= maxtype)
+			tb[type] = nla;
+	}
+}
+
+/*
+ *	Generic netlink
+ */
+struct nlmsghdr *genl_msg_init(void *buf, uint16_t family,
+			       uint8_t cmd, uint16_t flags)
+{
+	struct nlmsghdr *nlh = nl_msg_init(buf, family, flags);
+	struct genlmsghdr *genl = nl_msg_reserve(nlh, GENL_HDRLEN);
+
+	genl->cmd = cmd;
+	return nlh;
+}
+
+struct genl_family_info {
+	const char	*group;
+	uint16_t	id;
+	uint32_t	group_id;
+};
+
+static int genl_family_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	struct genl_family_info *info = arg;
+	const struct nlattr *tb[CTRL_ATTR_MAX + 1], *grp;
+
+	genl_attr_parse(tb, CTRL_ATTR_MAX, nlh);
+	if (tb[CTRL_ATTR_FAMILY_ID])
+		info->id = nl_attr_u16(tb[CTRL_ATTR_FAMILY_ID]);
+
+	if (!info->group || !tb[CTRL_ATTR_MCAST_GROUPS])
+		return 0;
+
+	nl_attr_for_each(grp, nl_attr_data(tb[CTRL_ATTR_MCAST_GROUPS]),
+			 nl_attr_len(tb[CTRL_ATTR_MCAST_GROUPS])) {
+		const struct nlattr *gb[CTRL_ATTR_MCAST_GRP_MAX + 1];
+
+		nl_attr_parse(gb, CTRL_ATTR_MCAST_GRP_MAX,
+			      nl_attr_data(grp), nl_attr_len(grp));
+		if (gb[CTRL_ATTR_MCAST_GRP_NAME] && gb[CTRL_ATTR_MCAST_GRP_ID] &&
+		    strcmp(nl_attr_data(gb[CTRL_ATTR_MCAST_GRP_NAME]),
+			   info->group) == 0)
+			info->group_id = nl_attr_u32(gb[CTRL_ATTR_MCAST_GRP_ID]);
+	}
+	return 0;
+}
+
+/**
+ * genl_resolve  -  look up a generic netlink family by name
+ * @nl:		NETLINK_GENERIC socket
+ * @family:	name of the family
+ * @id:		set to the numeric family id
+ * @group:	name of a multicast group of @family, or NULL
+ * @group_id:	set to the numeric id of @group, 0 if not found
+ * Returns 0 if ok, negative errno value otherwise.
+ */
+int genl_resolve(struct nl_sock *nl, const char *family, uint16_t *id,
+		 const char *group, uint32_t *group_id)
+{
+	struct genl_family_info info = { .group = group };
+	char req[NL_REQ_SIZE];
+	struct nlmsghdr *nlh = genl_msg_init(req, GENL_ID_CTRL,
+					     CTRL_CMD_GETFAMILY, 0);
+	int ret;
+
+	nl_attr_put(nlh, CTRL_ATTR_FAMILY_NAME, family, strlen(family) + 1);
+	ret = nl_talk(nl, nlh, genl_family_cb, &info);
+	if (ret < 0)
+		return ret;
+	if (info.id == 0)
+		return -ENOENT;
+
+	*id = info.id;
+	if (group_id)
+		*group_id = info.group_id;
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef NL_UTIL_H
+#define NL_UTIL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+
+/*
+ * Minimal netlink(7) plumbing, without depending on libnl.
+ *
+ * Requests are built in a caller-provided buffer of NL_REQ_SIZE bytes; replies
+ * are received into the per-socket buffer and handed message by message to a
+ * callback. Message parsing (nl_parse()) is independent of the socket, so that
+ * the attribute decoders can be fed from any buffer holding netlink messages.
+ */
+#define NL_REQ_SIZE	1024
+/* Large enough for the biggest message the kernel puts into a dump skb. */
+#define NL_BUFSIZE	0x8000
+
+/**
+ * struct nl_sock  -  netlink socket with its own sequence numbering
+ * @fd:		socket file descriptor, -1 if not open
+ * @protocol:	NETLINK_xxx protocol family of @fd
+ * @seq:	sequence number of the last request sent
+ * @buf:	receive buffer of NL_BUFSIZE bytes
+ * @requests:	number of request/reply round trips performed on @fd
+ */
+struct nl_sock {
+	int		fd;
+	int		protocol;
+	uint32_t	seq;
+	char		*buf;
+	unsigned long	requests;
+};
+
+/* Per-message callback: return 0 to continue, negative errno to abort. */
+typedef int (*nl_msg_cb)(const struct nlmsghdr *nlh, void *arg);
+
+extern int  nl_open(struct nl_sock *nl, int protocol);
+extern void nl_close(struct nl_sock *nl);
+extern int  nl_join_group(struct nl_sock *nl, uint32_t group);
+extern int  nl_talk(struct nl_sock *nl, struct nlmsghdr *req,
+		    nl_msg_cb cb, void *arg);
+extern int  nl_recv(struct nl_sock *nl, int timeout_ms);
+extern int  nl_parse(const void *buf, size_t len, uint32_t seq,
+		     nl_msg_cb cb, void *arg);
+
+/*
+ *	Message construction
+ */
+extern struct nlmsghdr *nl_msg_init(void *buf, uint16_t type, uint16_t flags);
+extern void *nl_msg_reserve(struct nlmsghdr *nlh, size_t len);
+extern void  nl_attr_put(struct nlmsghdr *nlh, uint16_t type,
+			 const void *data, size_t len);
+extern struct nlattr *nl_attr_nest_start(struct nlmsghdr *nlh, uint16_t type);
+extern void  nl_attr_nest_end(struct nlmsghdr *nlh, struct nlattr *nest);
+
+static inline void nl_attr_put_u32(struct nlmsghdr *nlh, uint16_t type,
+				   uint32_t val)
+{
+	nl_attr_put(nlh, type, &val, sizeof(val));
+}
+
+/*
+ *	Attribute parsing
+ */
+extern void nl_attr_parse(const struct nlattr *tb[], int maxtype,
+			  const void *data, size_t len);
+
+#define nl_attr_for_each(nla, data, len)				\
+	for (nla = (const struct nlattr *)(data);			\
+	     (const char *)(nla) + NLA_HDRLEN <= (const char *)(data) + (len) && \
+	     (nla)->nla_len >= NLA_HDRLEN &&				\
+	     (const char *)(nla) + (nla)->nla_len <= (const char *)(data) + (len); \
+	     nla = (const struct nlattr *)((const char *)(nla) + NLA_ALIGN((nla)->nla_len)))
+
+static inline const void *nl_attr_data(const struct nlattr *nla)
+{
+	return (const char *)nla + NLA_HDRLEN;
+}
+
+static inline uint16_t nl_attr_len(const struct nlattr *nla)
+{
+	return nla->nla_len - NLA_HDRLEN;
+}
+
+/*
+ * Attribute payloads are only 4-byte aligned, hence copy wider values.
+ * Payloads too short for the type (malformed or truncated messages) read as 0.
+ */
+static inline uint8_t nl_attr_u8(const struct nlattr *nla)
+{
+	if (nl_attr_len(nla) < sizeof(uint8_t))
+		return 0;
+	return *(const uint8_t *)nl_attr_data(nla);
+}
+
+static inline uint16_t nl_attr_u16(const struct nlattr *nla)
+{
+	if (nl_attr_len(nla) < sizeof(uint16_t))
+		return 0;
+	return *(const uint16_t *)nl_attr_data(nla);
+}
+
+static inline uint32_t nl_attr_u32(const struct nlattr *nla)
+{
+	if (nl_attr_len(nla) < sizeof(uint32_t))
+		return 0;
+	return *(const uint32_t *)nl_attr_data(nla);
+}
+
+static inline uint64_t nl_attr_u64(const struct nlattr *nla)
+{
+	uint64_t val;
+
+	if (nl_attr_len(nla) < sizeof(val))
+		return 0;
+	memcpy(&val, nl_attr_data(nla), sizeof(val));
+	return val;
+}
+
+/* Payload of a message, following the fixed header of @hdrlen bytes. */
+static inline const void *nl_msg_payload(const struct nlmsghdr *nlh,
+					 size_t hdrlen)
+{
+	return (const char *)NLMSG_DATA(nlh) + NLMSG_ALIGN(hdrlen);
+}
+
+static inline size_t nl_msg_payload_len(const struct nlmsghdr *nlh,
+					size_t hdrlen)
+{
+	return nlh->nlmsg_len < NLMSG_LENGTH(NLMSG_ALIGN(hdrlen)) ? 0 :
+	       nlh->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(hdrlen));
+}
+
+/*
+ *	Generic netlink
+ */
+extern struct nlmsghdr *genl_msg_init(void *buf, uint16_t family,
+				      uint8_t cmd, uint16_t flags);
+extern int  genl_resolve(struct nl_sock *nl, const char *family, uint16_t *id,
+			 const char *group, uint32_t *group_id);
+
+static inline uint8_t genl_cmd(const struct nlmsghdr *nlh)
+{
+	return ((const struct genlmsghdr *)NLMSG_DATA(nlh))->cmd;
+}
+
+static inline void genl_attr_parse(const struct nlattr *tb[], int maxtype,
+				   const struct nlmsghdr *nlh)
+{
+	nl_attr_parse(tb, maxtype, nl_msg_payload(nlh, GENL_HDRLEN),
+		      nl_msg_payload_len(nlh, GENL_HDRLEN));
+}
+#endif /* NL_UTIL_H */
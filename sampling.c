@@ -0,0 +1,321 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "iw_if.h"
+#include <sched.h>
+#include <sys/mman.h>
+
+/*
+ * Periodic sampling
+ *
+ * Statistics are acquired by a separate thread at the statistics interval,
+ * so that the time base of the samples does not depend on how long drawing
+ * takes. Samples are passed to the main loop through a single-producer,
+ * single-consumer ring; the main loop drains it at its own frame rate into
+ * the level history, and then lets the current screen (if interested) redraw.
+ * Sampling runs for the lifetime of the program, independent of which screen
+ * is shown; it is only restarted when the interface or settings change.
+ *
+ * The sampler sleeps until absolute CLOCK_MONOTONIC deadlines, spaced exactly
+ * stat_iv apart, so that wake-up latency does not accumulate. How late each
+ * wake-up is gets recorded; deadlines that have passed entirely are skipped
+ * and counted rather than caught up with in a burst.
+ */
+
+/* Number of ring slots, a power of 2. Holds >= 2.5s of samples at 10ms. */
+#define SAMPLE_RING_SIZE	256
+/* Shortest interval between redraws (40ms = 25 frames per second). */
+#define SAMPLE_FRAME_MS		40
+
+/**
+ * struct sample_ring  -  lock-free SPSC queue of samples
+ * @head:	number of samples written (only modified by the sampler thread)
+ * @tail:	number of samples read (only modified by the main loop)
+ * @dropped:	number of samples lost because the ring was full
+ * @slot:	sample storage, indexed modulo SAMPLE_RING_SIZE
+ */
+static struct sample_ring {
+	unsigned long		head;
+	unsigned long		tail;
+	unsigned long		dropped;
+	struct iw_sample	slot[SAMPLE_RING_SIZE];
+} ring;
+
+static pthread_t sampler_thread;
+static bool	 sampler_running;
+static int	 render_timer = -1;
+
+/* Main loop side: newest sample and the screen to notify about it. */
+static struct iw_sample	latest;
+static void		(*view_handler)(void);
+
+/* Written by the sampler thread, read by the main loop. */
+static struct sampling_stats timing;
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void record_lateness(uint64_t late_ns)
+{
+	unsigned long late_us = late_ns / 1000;
+	int i;
+
+	for (i = 0; i < SAMPLE_LATE_BUCKETS - 1; i++)
+		if (late_us < SAMPLE_LATE_MIN_US << i)
+			break;
+	__atomic_fetch_add(&timing.late[i], 1, __ATOMIC_RELAXED);
+
+	if (late_us > __atomic_load_n(&timing.late_max_us, __ATOMIC_RELAXED))
+		__atomic_store_n(&timing.late_max_us, late_us, __ATOMIC_RELAXED);
+}
+
+/* Producer side: returns false if the ring is full. */
+static bool ring_put(const struct iw_sample *sample)
+{
+	unsigned long head = ring.head,
+		      tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= SAMPLE_RING_SIZE) {
+		__atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	ring.slot[head % SAMPLE_RING_SIZE] = *sample;
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/* Consumer side: take the oldest sample, returns false if there is none. */
+static bool ring_get(struct iw_sample *sample)
+{
+	unsigned long tail = ring.tail,
+		      head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+
+	if (tail == head)
+		return false;
+	*sample = ring.slot[tail % SAMPLE_RING_SIZE];
+	__atomic_store_n(&ring.tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/** Number of samples lost since sampling started because the main loop lagged. */
+unsigned long sampling_dropped(void)
+{
+	return __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+}
+
+void sampling_get_stats(struct sampling_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < SAMPLE_LATE_BUCKETS; i++)
+		stats->late[i] = __atomic_load_n(&timing.late[i], __ATOMIC_RELAXED);
+	stats->late_max_us = __atomic_load_n(&timing.late_max_us, __ATOMIC_RELAXED);
+	stats->missed	   = __atomic_load_n(&timing.missed, __ATOMIC_RELAXED);
+	stats->dropped	   = sampling_dropped();
+	stats->realtime	   = timing.realtime;
+}
+
+/**
+ * Upper bound (in microseconds) of the lateness of @pct percent of all
+ * samples, as resolved by the histogram buckets. Returns 0 if there are none.
+ */
+unsigned long sampling_late_percentile(const struct sampling_stats *stats,
+				       unsigned int pct)
+{
+	unsigned long total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < SAMPLE_LATE_BUCKETS; i++)
+		total += stats->late[i];
+	if (total == 0)
+		return 0;
+
+	for (i = 0; i < SAMPLE_LATE_BUCKETS - 1; i++) {
+		sum += stats->late[i];
+		if (sum * 100 >= total * pct)
+			return SAMPLE_LATE_MIN_US << i;
+	}
+	return stats->late_max_us;
+}
+
+/**
+ * struct sampler_ctx  -  private state of the sampler thread
+ * @ifname:	copy of the interface name, conf_ifname() may change under us
+ * @stat_iv:	sampling interval in milliseconds
+ * @realtime:	whether to run with SCHED_FIFO priority
+ * @iw:		range information and scratch space for iw_getstat()
+ * The settings are copied, so that editing preferences does not race.
+ */
+static struct sampler_ctx {
+	char		ifname[IFNAMSIZ];
+	int		stat_iv;
+	bool		realtime;
+	struct iw_stat	iw;
+} ctx;
+
+static void sample_once(struct sampler_ctx *ctx, uint64_t now)
+{
+	struct iw_sample sample;
+
+	sample.ts.tv_sec  = now / 1000000000ULL;
+	sample.ts.tv_nsec = now % 1000000000ULL;
+	iw_getstat(ctx->ifname, &ctx->iw);
+	if_getstat(ctx->ifname, &sample.net);
+	sample.stat = ctx->iw.stat;
+	sample.dbm  = ctx->iw.dbm;
+
+	ring_put(&sample);
+}
+
+/* Opt-in: raise the sampler above ordinary load. Needs CAP_SYS_NICE. */
+static void sampler_set_realtime(void)
+{
+	struct sched_param sp = {
+		.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1
+	};
+
+	timing.realtime = pthread_setschedparam(pthread_self(),
+						SCHED_FIFO, &sp) == 0;
+}
+
+static void *sampler(void *arg)
+{
+	struct sampler_ctx *ctx = arg;
+	const uint64_t period = ctx->stat_iv * 1000000ULL;
+	uint64_t next = mono_ns(), now, late;
+	struct timespec deadline;
+	int old_state;
+
+	if (ctx->realtime)
+		sampler_set_realtime();
+
+	for (;;) {
+		next += period;
+		deadline.tv_sec	 = next / 1000000000ULL;
+		deadline.tv_nsec = next % 1000000000ULL;
+
+		/* The only cancellation point: not while holding resources. */
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &deadline, NULL) == EINTR)
+			;
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+		now  = mono_ns();
+		late = now > next ? now - next : 0;
+		if (late >= period) {
+			/* Stay on the original time grid. */
+			__atomic_fetch_add(&timing.missed, late / period,
+					   __ATOMIC_RELAXED);
+			next += late / period * period;
+			late %= period;
+		}
+		record_lateness(late);
+		sample_once(ctx, now);
+		pthread_setcancelstate(old_state, NULL);
+	}
+	return NULL;
+}
+
+/* Feed all pending samples into the history, then update the view. */
+static void sampling_drain(int fd)
+{
+	struct iw_sample sample;
+	bool updated = false;
+
+	while (ring_get(&sample)) {
+		iw_cache_update(&sample);
+		latest	= sample;
+		updated = true;
+	}
+	if (updated && view_handler)
+		view_handler();
+}
+
+/** Return the newest sample. Valid once sampling_init() has been called. */
+const struct iw_sample *sampling_latest(void)
+{
+	return &latest;
+}
+
+/** Set the function called after new samples have arrived (NULL = none). */
+void sampling_set_view(void (*handler)(void))
+{
+	view_handler = handler;
+}
+
+/**
+ * sampling_init  -  make sure that the current interface is being sampled
+ * Starts the sampler if it is not running yet, and restarts it when the
+ * interface or the sampling settings have changed; otherwise does nothing.
+ * When (re)started, the level history is cleared and the first sample is
+ * taken synchronously, so that there is data to draw right away.
+ */
+void sampling_init(void)
+{
+	sigset_t blockmask, oldmask;
+
+	if (sampler_running && strncmp(ctx.ifname, conf_ifname(), IFNAMSIZ) == 0 &&
+	    ctx.stat_iv == conf.stat_iv && ctx.realtime == conf.realtime)
+		return;
+	sampling_stop();
+
+	memset(&ctx, 0, sizeof(ctx));
+	strncpy(ctx.ifname, conf_ifname(), IFNAMSIZ - 1);
+	ctx.stat_iv  = conf.stat_iv;
+	ctx.realtime = conf.realtime;
+	iw_getinf_range(ctx.ifname, &ctx.iw.range);
+
+	ring.head = ring.tail = ring.dropped = 0;
+	memset(&timing, 0, sizeof(timing));
+	iw_cache_reset();
+	sample_once(&ctx, mono_ns());
+	sampling_drain(-1);
+
+	/* Page faults would defeat the point of real-time priority. */
+	if (ctx.realtime)
+		mlockall(MCL_CURRENT | MCL_FUTURE);
+	else
+		munlockall();
+
+	/* Signals are received by the main loop only. */
+	sigfillset(&blockmask);
+	pthread_sigmask(SIG_BLOCK, &blockmask, &oldmask);
+	if (pthread_create(&sampler_thread, NULL, sampler, &ctx))
+		err_sys("can not start sampler thread");
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	sampler_running = true;
+
+	render_timer = timer_start(max(ctx.stat_iv, SAMPLE_FRAME_MS),
+				   sampling_drain);
+}
+
+void sampling_stop(void)
+{
+	timer_stop(render_timer);
+	render_timer = -1;
+
+	if (sampler_running) {
+		pthread_cancel(sampler_thread);
+		pthread_join(sampler_thread, NULL);
+		sampler_running = false;
+	}
+}
@@ -0,0 +1,466 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "iw_if.h"
+#include <fnmatch.h>
+
+/*
+ * Filter expressions for scan results
+ *
+ * A filter such as 'sig > -70 && !open && chan in 36..48 && essid ~ "corp*"'
+ * is compiled once into a sequence of operations. These act on a single
+ * truth value: tests set it, '!' inverts it, and '&&' ('||') skips the
+ * right-hand side if it is false (true), which makes evaluation short-circuit
+ * without a stack. The grammar is
+ *
+ *	expr	:= and { '||' and }
+ *	and	:= unary { '&&' unary }
+ *	unary	:= '!' unary | '(' expr ')' | test
+ *	test	:= flag
+ *		 | number ( '<' | '<=' | '>' | '>=' | '==' | '!=' ) integer
+ *		 | number 'in' integer '..' integer
+ *		 | string ( '~' | '==' | '!=' ) word
+ *
+ * where a word is either quoted, or ends at a blank, '&', '|' or ')'. Strings
+ * are compared regardless of case, '~' matches a shell wildcard pattern.
+ */
+#define FILTER_MAX_DEPTH	16
+
+enum filter_field {
+	FF_SIG,		/* signal level in dBm */
+	FF_CHAN,	/* channel number */
+	FF_FREQ,	/* frequency in MHz */
+	FF_SEEN,	/* number of times seen */
+	FF_AGE,		/* seconds since last seen */
+	FF_OPEN,	/* not encrypted */
+	FF_AP,		/* access point */
+	FF_STALE,	/* missed by the latest scan */
+	FF_HIDDEN,	/* hidden ESSID */
+	FF_ESSID,
+	FF_BSSID,
+};
+
+enum filter_type { FT_NUM, FT_FLAG, FT_STR };
+
+static const struct filter_field_name {
+	const char		*name;
+	enum filter_field	field;
+	enum filter_type	type;
+} filter_fields[] = {
+	{ "sig",	FF_SIG,		FT_NUM  },
+	{ "chan",	FF_CHAN,	FT_NUM  },
+	{ "freq",	FF_FREQ,	FT_NUM  },
+	{ "seen",	FF_SEEN,	FT_NUM  },
+	{ "age",	FF_AGE,		FT_NUM  },
+	{ "open",	FF_OPEN,	FT_FLAG },
+	{ "ap",		FF_AP,		FT_FLAG },
+	{ "stale",	FF_STALE,	FT_FLAG },
+	{ "hidden",	FF_HIDDEN,	FT_FLAG },
+	{ "essid",	FF_ESSID,	FT_STR  },
+	{ "bssid",	FF_BSSID,	FT_STR  },
+};
+
+enum filter_opcode {
+	FOP_CMP,	/* compare number with @lo by @rel */
+	FOP_RANGE,	/* number within @lo..@hi */
+	FOP_FLAG,	/* flag is set */
+	FOP_STR,	/* compare string with @str by @rel */
+	FOP_NOT,
+	FOP_AND,	/* if false, continue at @jump */
+	FOP_OR,		/* if true, continue at @jump */
+};
+
+enum filter_rel { FR_LT, FR_LE, FR_GT, FR_GE, FR_EQ, FR_NE, FR_GLOB };
+
+/* Longer operators first, so that '<=' is not taken for '<' */
+static const struct filter_rel_name {
+	const char	*name;
+	enum filter_rel	rel;
+} filter_rels[] = {
+	{ "<=", FR_LE }, { ">=", FR_GE }, { "==", FR_EQ }, { "!=", FR_NE },
+	{ "<",	FR_LT }, { ">",	 FR_GT }, { "~",  FR_GLOB }
+};
+
+/**
+ * struct filter_op  -  one operation of a compiled filter
+ * @code:	FOP_xxx
+ * @field:	FF_xxx tested by FOP_CMP, FOP_RANGE, FOP_FLAG and FOP_STR
+ * @rel:	FR_xxx of FOP_CMP and FOP_STR
+ * @jump:	index of the operation following the right-hand side of FOP_AND/OR
+ * @lo:		value compared with, lower bound of FOP_RANGE
+ * @hi:		upper bound of FOP_RANGE
+ * @str:	string or pattern of FOP_STR
+ */
+struct filter_op {
+	uint8_t		code,
+			field,
+			rel;
+	uint16_t	jump;
+	int32_t		lo,
+			hi;
+	char		*str;
+};
+
+struct filter_parser {
+	const char		*start,
+				*pos;
+	struct scan_filter	*f;
+	int			depth;
+	char			*err;
+	size_t			errlen;
+};
+
+static bool filter_failed(const struct filter_parser *p)
+{
+	return *p->err != '\0';
+}
+
+static void filter_error(struct filter_parser *p, const char *what)
+{
+	if (!filter_failed(p))
+		snprintf(p->err, p->errlen, "%s at column %d",
+			 what, (int)(p->pos - p->start) + 1);
+}
+
+static void skip_blanks(struct filter_parser *p)
+{
+	p->pos += strspn(p->pos, " \t");
+}
+
+/* Consume @token if it comes next. */
+static bool next_is(struct filter_parser *p, const char *token)
+{
+	skip_blanks(p);
+	if (strncmp(p->pos, token, strlen(token)))
+		return false;
+	p->pos += strlen(token);
+	return true;
+}
+
+/* Append an operation, returning its index. */
+static size_t emit(struct filter_parser *p, enum filter_opcode code)
+{
+	struct scan_filter *f = p->f;
+
+	if (f->num_ops == f->max_ops) {
+		f->max_ops = f->max_ops ? f->max_ops * 2 : 8;
+		f->op = realloc(f->op, f->max_ops * sizeof(*f->op));
+		if (!f->op)
+			err_sys("can not allocate scan filter");
+	}
+	memset(f->op + f->num_ops, 0, sizeof(*f->op));
+	f->op[f->num_ops].code = code;
+	return f->num_ops++;
+}
+
+static int32_t parse_int(struct filter_parser *p)
+{
+	char *end;
+	long val;
+
+	skip_blanks(p);
+	val = strtol(p->pos, &end, 10);
+	if (end == p->pos || val < INT32_MIN || val > INT32_MAX)
+		filter_error(p, "number expected");
+	p->pos = end;
+	return val;
+}
+
+static char *parse_word(struct filter_parser *p)
+{
+	const char *word;
+	size_t i, len;
+	char *str;
+
+	skip_blanks(p);
+	if (*p->pos == '"') {
+		word = ++p->pos;
+		len  = strcspn(word, "\"");
+		if (word[len] != '"') {
+			filter_error(p, "unterminated string");
+			return NULL;
+		}
+		p->pos += len + 1;
+	} else {
+		word = p->pos;
+		len  = strcspn(word, " \t&|)");
+		if (!len) {
+			filter_error(p, "string expected");
+			return NULL;
+		}
+		p->pos += len;
+	}
+	str = malloc(len + 1);
+	if (!str)
+		err_sys("can not allocate scan filter");
+	for (i = 0; i < len; i++)
+		str[i] = tolower(word[i]);
+	str[len] = '\0';
+	return str;
+}
+
+static void parse_test(struct filter_parser *p)
+{
+	const struct filter_field_name *ff = NULL;
+	size_t i, len, op;
+
+	skip_blanks(p);
+	len = strspn(p->pos, "abcdefghijklmnopqrstuvwxyz");
+	for (i = 0; len && i < ARRAY_SIZE(filter_fields); i++)
+		if (strlen(filter_fields[i].name) == len &&
+		    strncmp(filter_fields[i].name, p->pos, len) == 0)
+			ff = filter_fields + i;
+	if (!ff) {
+		filter_error(p, len ? "unknown field" : "field expected");
+		return;
+	}
+	p->pos += len;
+
+	if (ff->type == FT_FLAG) {
+		op = emit(p, FOP_FLAG);
+		p->f->op[op].field = ff->field;
+		return;
+	}
+
+	if (ff->type == FT_NUM && next_is(p, "in")) {
+		op = emit(p, FOP_RANGE);
+		p->f->op[op].field = ff->field;
+		p->f->op[op].lo	   = parse_int(p);
+		if (!next_is(p, ".."))
+			filter_error(p, "'..' expected");
+		p->f->op[op].hi	   = parse_int(p);
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(filter_rels); i++)
+		if ((ff->type == FT_NUM ? filter_rels[i].rel != FR_GLOB :
+					  filter_rels[i].rel >= FR_EQ) &&
+		    next_is(p, filter_rels[i].name))
+			break;
+	if (i == ARRAY_SIZE(filter_rels)) {
+		filter_error(p, "operator expected");
+		return;
+	}
+
+	op = emit(p, ff->type == FT_NUM ? FOP_CMP : FOP_STR);
+	p->f->op[op].field = ff->field;
+	p->f->op[op].rel   = filter_rels[i].rel;
+	if (ff->type == FT_NUM)
+		p->f->op[op].lo	 = parse_int(p);
+	else
+		p->f->op[op].str = parse_word(p);
+}
+
+static void parse_or(struct filter_parser *p);
+
+static void parse_unary(struct filter_parser *p)
+{
+	if (p->depth++ == FILTER_MAX_DEPTH) {
+		filter_error(p, "nested too deeply");
+	} else if (next_is(p, "!")) {
+		parse_unary(p);
+		emit(p, FOP_NOT);
+	} else if (next_is(p, "(")) {
+		parse_or(p);
+		if (!next_is(p, ")"))
+			filter_error(p, "')' expected");
+	} else {
+		parse_test(p);
+	}
+	p->depth--;
+}
+
+static void parse_and(struct filter_parser *p)
+{
+	size_t op;
+
+	parse_unary(p);
+	while (!filter_failed(p) && next_is(p, "&&")) {
+		op = emit(p, FOP_AND);
+		parse_unary(p);
+		p->f->op[op].jump = p->f->num_ops;
+	}
+}
+
+static void parse_or(struct filter_parser *p)
+{
+	size_t op;
+
+	parse_and(p);
+	while (!filter_failed(p) && next_is(p, "||")) {
+		op = emit(p, FOP_OR);
+		parse_and(p);
+		p->f->op[op].jump = p->f->num_ops;
+	}
+}
+
+/**
+ * scan_filter_compile  -  translate a filter expression
+ * @expr:   expression to compile; an empty one matches all entries
+ * @err:    buffer for the error message
+ * @errlen: size of @err
+ * Returns NULL, with the reason in @err, if @expr is not valid.
+ */
+struct scan_filter *scan_filter_compile(const char *expr, char *err, size_t errlen)
+{
+	struct filter_parser p = {
+		.start	= expr,
+		.pos	= expr,
+		.err	= err,
+		.errlen = errlen,
+	};
+
+	p.f = calloc(1, sizeof(*p.f));
+	if (!p.f)
+		err_sys("can not allocate scan filter");
+	*err = '\0';
+
+	skip_blanks(&p);
+	if (*p.pos) {
+		parse_or(&p);
+		skip_blanks(&p);
+		if (*p.pos)
+			filter_error(&p, "unexpected input");
+	}
+	if (p.f->num_ops > UINT16_MAX)
+		filter_error(&p, "expression too long");
+
+	if (filter_failed(&p)) {
+		scan_filter_free(p.f);
+		return NULL;
+	}
+	return p.f;
+}
+
+void scan_filter_free(struct scan_filter *f)
+{
+	size_t i;
+
+	if (!f)
+		return;
+	for (i = 0; i < f->num_ops; i++)
+		free(f->op[i].str);
+	free(f->op);
+	free(f);
+}
+
+static int32_t field_num(enum filter_field field, const struct scan_entry *e)
+{
+	switch (field) {
+	case FF_SIG:
+		return lrintf(e->dbm.signal);
+	case FF_CHAN:
+		return e->chan;
+	case FF_FREQ:
+		return e->freq;
+	case FF_SEEN:
+		return e->stats.seen;
+	case FF_AGE:
+		return e->age_ms > 0 ? e->age_ms / 1000 : 0;
+	case FF_OPEN:
+		return !e->has_key;
+	case FF_AP:
+		return e->mode == IW_MODE_MASTER;
+	case FF_STALE:
+		return e->stats.stale;
+	case FF_HIDDEN:
+		return !*e->essid;
+	default:
+		return 0;
+	}
+}
+
+static bool match_str(const struct filter_op *op, const struct scan_entry *e)
+{
+	const uint8_t *b = e->ap_addr.ether_addr_octet;
+	char str[sizeof(e->essid)];
+	size_t i;
+
+	/* Not ether_addr(), whose buffer the screen uses at the same time */
+	if (op->field == FF_BSSID)
+		sprintf(str, "%02x:%02x:%02x:%02x:%02x:%02x",
+			b[0], b[1], b[2], b[3], b[4], b[5]);
+	else
+		for (i = 0; i < sizeof(str); i++)
+			str[i] = tolower(e->essid[i]);
+
+	switch (op->rel) {
+	case FR_EQ:
+		return strcmp(str, op->str) == 0;
+	case FR_NE:
+		return strcmp(str, op->str) != 0;
+	default:
+		return fnmatch(op->str, str, 0) == 0;
+	}
+}
+
+static bool match_num(const struct filter_op *op, int32_t val)
+{
+	switch (op->rel) {
+	case FR_LT:
+		return val < op->lo;
+	case FR_LE:
+		return val <= op->lo;
+	case FR_GT:
+		return val > op->lo;
+	case FR_GE:
+		return val >= op->lo;
+	case FR_EQ:
+		return val == op->lo;
+	default:
+		return val != op->lo;
+	}
+}
+
+/** scan_filter_match  -  whether @e passes the filter @f */
+bool scan_filter_match(const struct scan_filter *f, const struct scan_entry *e)
+{
+	const struct filter_op *op;
+	bool val = true;
+	size_t pc = 0;
+
+	while (pc < f->num_ops) {
+		op = f->op + pc++;
+		switch (op->code) {
+		case FOP_CMP:
+			val = match_num(op, field_num(op->field, e));
+			break;
+		case FOP_RANGE:
+			val = op->lo <= field_num(op->field, e) &&
+			      field_num(op->field, e) <= op->hi;
+			break;
+		case FOP_FLAG:
+			val = field_num(op->field, e);
+			break;
+		case FOP_STR:
+			val = match_str(op, e);
+			break;
+		case FOP_NOT:
+			val = !val;
+			break;
+		case FOP_AND:
+			if (!val)
+				pc = op->jump;
+			break;
+		case FOP_OR:
+			if (val)
+				pc = op->jump;
+			break;
+		}
+	}
+	return val;
+}
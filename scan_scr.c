@@ -20,20 +20,125 @@
 #include "iw_if.h"
 
 #define START_LINE	2	/* where to begin the screen */
+#define PAGE_LINES	(MAXYLEN - START_LINE)	/* entries per screen */
 
 /* GLOBALS */
 static struct scan_result sr;
 static pthread_t scan_thread;
 static WINDOW *w_aplst;
+/* Time from starting the last scan until its results were first drawn. */
+static unsigned long shown_gen;
+static unsigned int scan_latency_ms;
+/* Sorted view of the latest snapshot, redone when it or the order changes. */
+static struct scan_order order = { .sort_order = -1 };
+/* Whether to show the distribution over channels instead of the stations. */
+static bool show_channels;
+/* Position in the sorted list of the first station shown. */
+static size_t first;
+
+/**
+ * struct scan_jump  -  jumping to a station by its BSSID
+ * @prompt:	whether the BSSID is being typed in
+ * @go:		whether to jump once the next results are shown
+ * @hex:	hex digits of the BSSID typed so far
+ * @marked:	whether @mark is set
+ * @mark:	BSSID of the station jumped to, which is highlighted
+ */
+static struct scan_jump {
+	bool			prompt,
+				go;
+	char			hex[13];
+	bool			marked;
+	struct ether_addr	mark;
+} jump;
+
+/**
+ * struct scan_filter_edit  -  filter expression of the scan window
+ * @prompt:	whether the expression is being edited
+ * @expr:	the expression being edited
+ * @applied:	the expression in force, kept when leaving the screen
+ * @err:	why @expr could not be compiled, if it could not
+ */
+static struct scan_filter_edit {
+	bool	prompt;
+	char	expr[128],
+		applied[128];
+	char	err[64];
+} filter_edit;
+
+/**
+ * struct scan_row  -  formatted line of the station list
+ * @done:	whether the other members have been filled in
+ * @bold:	whether @essid is an actual ESSID (shown in bold)
+ * @col:	colour pair of the MAC address
+ * @spark:	sparkline of the latest signal levels
+ * @trend:	arrow showing the direction of the signal level, or blank
+ * @essid:	ESSID column, padded to the width of the longest ESSID
+ * @addr:	MAC address
+ * @info:	signal, channel and encryption information
+ */
+struct scan_row {
+	bool	done,
+		bold;
+	int	col;
+	chtype	spark[SPARK_LEN],
+		trend;
+	char	essid[IW_ESSID_MAX_SIZE + 4];
+	char	addr[20];
+	char	info[0x100];
+};
+
+/*
+ * Rows are formatted when first shown, and kept for the generation of
+ * results they were made from, indexed like the entry array of the snapshot.
+ */
+static struct scan_rows {
+	unsigned long	gen;
+	struct scan_row	*row;
+	size_t		max;
+} rows;
+
+/**
+ * struct scan_view  -  what the window currently shows
+ * @gen:	generation of the results shown (0 = none)
+ * @sort_order:	sort order of the list
+ * @asc:	sort direction of the list
+ * @channels:	whether channels rather than stations are shown
+ * @first:	position of the first station shown
+ * @lines:	screen height
+ * @cols:	screen width
+ * @drawn:	number of times the window was redrawn
+ * @skipped:	number of times redrawing was not necessary
+ * @count_y:	line of the redraw counters in the summary (0 = not shown)
+ * @count_x:	column of the redraw counters in the summary
+ */
+static struct scan_view {
+	unsigned long	gen;
+	int		sort_order;
+	bool		asc,
+			channels;
+	size_t		first;
+	int		lines,
+			cols;
+	unsigned long	drawn,
+			skipped;
+	int		count_y,
+			count_x;
+} view;
 
 /**
  * Sanitize and format single scan entry as a string.
  * @cur: entry to format
+ * @cached: whether @cur comes from the kernel cache rather than our own scan
  * @buf: buffer to put results into
  * @buflen: length of @buf
+ * Entries missed by the latest scan show how long ago they were last seen.
+ * The result is kept in the row cache, so that IEs are decoded once per scan.
  */
-static void fmt_scan_entry(struct scan_entry *cur, char buf[], size_t buflen)
+static void fmt_scan_entry(const struct scan_entry *cur, bool cached,
+			   char buf[], size_t buflen)
 {
+	uint32_t flags = scan_entry_flags(cur);
 	size_t len = 0;
 
 	if (!(cur->qual.updated & (IW_QUAL_QUAL_INVALID|IW_QUAL_LEVEL_INVALID)))
@@ -49,24 +154,181 @@ static void fmt_scan_entry(struct scan_entry *cur, char buf[], size_t buflen)
 	else
 		len += snprintf(buf + len, buflen - len, "? dBm");
 
-	if (cur->freq < 1e3)
-		len += snprintf(buf + len, buflen - len, ", Chan %2.0f",
-				cur->freq);
-	else if (cur->chan >= 0)
-		len += snprintf(buf + len, buflen - len, ", %s %3d, %g MHz",
-				cur->freq < 5e9 ? "ch" : "CH",
-				cur->chan, cur->freq / 1e6);
+	if (!cur->freq)
+		len += snprintf(buf + len, buflen - len, ", Chan %2d",
+				cur->chan);
+	else if (cur->chan)
+		len += snprintf(buf + len, buflen - len, ", %s %3d, %u MHz",
+				cur->freq < 5000 ? "ch" : "CH",
+				cur->chan, cur->freq);
 	else
 		len += snprintf(buf + len, buflen - len, ", %g GHz",
-				cur->freq / 1e9);
+				cur->freq / 1e3);
 
 	/* Access Points are marked by CP_SCAN_CRYPT/CP_SCAN_UNENC already */
 	if (cur->mode != IW_MODE_MASTER)
 		len += snprintf(buf + len, buflen - len, " %s",
 				iw_opmode(cur->mode));
-	if (cur->flags)
+	if (flags)
 		len += snprintf(buf + len, buflen - len, ", %s",
-				 format_enc_capab(cur->flags, "/"));
+				 format_enc_capab(flags, "/"));
+	if ((cached || cur->stats.stale) && cur->age_ms >= 0)
+		len += snprintf(buf + len, buflen - len, ", %.0fs old",
+				cur->age_ms / 1e3);
+	else if (cached)
+		len += snprintf(buf + len, buflen - len, ", cached");
+}
+
+/* Show @dbm as one of five heights, from -90 dBm and below to -50 dBm and above. */
+static chtype spark_char(int8_t dbm)
+{
+	const chtype level[] = { ACS_S9, ACS_S7, ACS_HLINE, ACS_S3, ACS_S1 };
+
+	if (dbm == SPARK_NONE)
+		return ' ';
+	return level[clamp((dbm + 90) / 10, 0, ARRAY_SIZE(level) - 1)];
+}
+
+/* Return the row of entry @idx of @ss, formatting it if necessary. */
+static const struct scan_row *scan_row_get(const struct scan_snapshot *ss,
+					   size_t idx)
+{
+	const struct scan_entry *cur = ss->entry[idx];
+	struct scan_row *r;
+	size_t i;
+
+	if (rows.gen != ss->gen) {
+		if (ss->num.entries > rows.max) {
+			rows.max = ss->num.entries;
+			rows.row = realloc(rows.row, rows.max * sizeof(*rows.row));
+			if (!rows.row)
+				err_sys("can not allocate scan rows");
+		}
+		for (i = 0; i < ss->num.entries; i++)
+			rows.row[i].done = false;
+		rows.gen = ss->gen;
+	}
+
+	r = rows.row + idx;
+	if (r->done)
+		return r;
+
+	r->col = CP_SCAN_NON_AP;
+	if (cur->mode == IW_MODE_MASTER)
+		r->col = cur->has_key ? CP_SCAN_CRYPT : CP_SCAN_UNENC;
+
+	r->bold = *cur->essid && str_is_ascii(cur->essid);
+	snprintf(r->essid, sizeof(r->essid), "%-*s ",
+		 min(ss->max_essid_len, IW_ESSID_MAX_SIZE),
+		 r->bold     ? cur->essid :
+		 *cur->essid ? "<cryptic ESSID>" : "<hidden ESSID>");
+	snprintf(r->addr, sizeof(r->addr), "%s", ether_addr(&cur->ap_addr));
+
+	for (i = 0; i < SPARK_LEN; i++)
+		r->spark[i] = spark_char(ss->spark[idx * SPARK_LEN + i]);
+
+	/* Direction in which the signal level last moved */
+	r->trend = cur->stats.trend > 0 ? ACS_UARROW :
+		   cur->stats.trend < 0 ? ACS_DARROW : ' ';
+
+	fmt_scan_entry(cur, ss->cached, r->info, sizeof(r->info));
+	r->done = true;
+	return r;
+}
+
+/* Whether the window already shows @ss as currently configured. */
+static bool view_is_current(const struct scan_snapshot *ss)
+{
+	if (view.gen == ss->gen && view.sort_order == conf.scan_sort_order &&
+	    view.asc == conf.scan_sort_asc && view.channels == show_channels &&
+	    view.first == first && view.lines == LINES && view.cols == COLS)
+		return true;
+
+	view.gen	= ss->gen;
+	view.sort_order = conf.scan_sort_order;
+	view.asc	= conf.scan_sort_asc;
+	view.channels	= show_channels;
+	view.first	= first;
+	view.lines	= LINES;
+	view.cols	= COLS;
+	return false;
+}
+
+/* Show the redraw counters, the only part of the summary that a skip changes. */
+static void view_show_counts(WINDOW *w)
+{
+	char s[64];
+
+	if (!view.count_y)
+		return;
+	sprintf(s, ", redrawn %lu skipped %lu", view.drawn, view.skipped);
+	mvwaddstr(w, view.count_y, view.count_x, s);
+}
+
+/* Force the next call of display_aplist() to redraw the window. */
+static void view_invalidate(void)
+{
+	view.gen = 0;
+}
+
+/* Whether the BSSID of @e starts with the hex digits @arg. */
+static bool bssid_match(const struct scan_entry *e, const void *arg)
+{
+	const uint8_t *b = e->ap_addr.ether_addr_octet;
+	char hex[13];
+
+	sprintf(hex, "%02x%02x%02x%02x%02x%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+	return strncasecmp(hex, arg, strlen(arg)) == 0;
+}
+
+/* Move the station matching jump.hex to the top, if there is one. */
+static void jump_to_bssid(const struct scan_snapshot *ss)
+{
+	const uint16_t *idx;
+	int pos;
+
+	jump.go = false;
+	scan_order_sort(&order, ss, 0);
+	pos = scan_order_find(&order, ss, bssid_match, jump.hex);
+	if (pos < 0) {
+		flash();
+		return;
+	}
+	idx	    = scan_order_sort(&order, ss, pos + 1);
+	jump.mark   = ss->entry[idx[pos]]->ap_addr;
+	jump.marked = true;
+	first	    = pos;
+}
+
+/* Show one line per used channel, starting at @line. Returns the next line. */
+static int display_channels(WINDOW *w_aplst, const struct chan_hist *h, int line)
+{
+	static const char *band[NUM_BANDS] = {
+		[BAND_2GHZ] = "2.4GHz",
+		[BAND_5GHZ] = "5GHz",
+		[BAND_6GHZ] = "6GHz"
+	};
+	int slot, max_count = 1, width = MAXXLEN - 40;
+	char s[0x40];
+
+	for (slot = 0; slot < CHAN_HIST_SLOTS; slot++)
+		max_count = max(max_count, h->ch[slot].count);
+
+	for (slot = 0; slot < CHAN_HIST_SLOTS && line < MAXYLEN; slot++) {
+		if (!h->ch[slot].count)
+			continue;
+		wmove(w_aplst, line++, 1);
+		sprintf(s, "%-6s ch %3d ", band[chan_hist_band(slot)],
+			chan_hist_chan(slot));
+		waddstr_b(w_aplst, s);
+
+		sprintf(s, "%3d AP%s, load %5.1f ", h->ch[slot].count,
+			h->ch[slot].count == 1 ? " " : "s", h->ch[slot].load);
+		waddstr(w_aplst, s);
+
+		whline(w_aplst, '=' | A_BOLD, width * h->ch[slot].count / max_count);
+	}
+	return line;
 }
 
 static void display_aplist(WINDOW *w_aplst)
@@ -78,102 +340,195 @@ static void display_aplist(WINDOW *w_aplst)
 		[SO_ESSID]	= "Essid",
 		[SO_OPEN]	= "Open",
 		[SO_CHAN_SIG]	= "Ch/Sg",
-		[SO_OPEN_SIG]	= "Op/Sg"
+		[SO_OPEN_SIG]	= "Op/Sg",
+		[SO_CUSTOM]	= "Custom"
 	};
-	int i, col, line = START_LINE;
-	struct scan_entry *cur;
+	int i, slot, hidden, line = START_LINE;
+	const struct scan_row *r;
+	const struct scan_snapshot *ss;
+	const uint16_t *idx;
+	size_t k = 0;
 
-	/* Scanning can take several seconds - do not refresh if locked. */
-	if (pthread_mutex_trylock(&sr.mutex))
-		return;
+	/* Always show the latest complete scan, even while the next one runs. */
+	ss = scan_snapshot_get(&sr);
+	if (!ss)
+		goto done;
+
+	if (ss->gen != shown_gen) {
+		struct timespec now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		shown_gen	= ss->gen;
+		scan_latency_ms = (now.tv_sec - ss->triggered.tv_sec) * 1000 +
+				  (now.tv_nsec - ss->triggered.tv_nsec) / 1000000;
+	}
+
+	if (jump.go && !show_channels)
+		jump_to_bssid(ss);
+
+	/* Keep the last page full when scrolling past the end */
+	if (first + PAGE_LINES > ss->num.entries)
+		first = ss->num.entries > PAGE_LINES ? ss->num.entries - PAGE_LINES : 0;
+
+	/* Called on each key press and timeout, but the results change rarely */
+	if (view_is_current(ss)) {
+		view.skipped++;
+		view_show_counts(w_aplst);
+		goto done;
+	}
+	view.drawn++;
+	view.count_y = 0;
 
-	if (sr.head || *sr.msg)
+	if (ss->head || *ss->msg)
 		for (i = 1; i <= MAXYLEN; i++)
 			mvwclrtoborder(w_aplst, i, 1);
 
-	if (!sr.head)
-		waddstr_center(w_aplst, WAV_HEIGHT/2 - 1, sr.msg);
+	if (!ss->head)
+		waddstr_center(w_aplst, WAV_HEIGHT/2 - 1, ss->msg);
 
-	sort_scan_list(&sr.head);
+	if (show_channels) {
+		line   = display_channels(w_aplst, &ss->chan, line);
+		hidden = ss->chan.used - (line - START_LINE);
+		goto summary;
+	}
 
-	/* Truncate overly long access point lists to match screen height. */
-	for (cur = sr.head; cur && line < MAXYLEN; line++, cur = cur->next) {
-		col = CP_SCAN_NON_AP;
+	/* Only the entries on the screen need to be in order. */
+	idx = scan_order_sort(&order, ss, first + PAGE_LINES);
 
-		if (cur->mode == IW_MODE_MASTER)
-			col = cur->has_key ? CP_SCAN_CRYPT : CP_SCAN_UNENC;
+	for (k = first; k < ss->num.entries && line < MAXYLEN; line++, k++) {
+		r = scan_row_get(ss, idx[k]);
 
 		wmove(w_aplst, line, 1);
-		if (!*cur->essid) {
-			sprintf(s, "%-*s ", sr.max_essid_len, "<hidden ESSID>");
-			wattron(w_aplst, COLOR_PAIR(col));
-			waddstr(w_aplst, s);
-		} else if (str_is_ascii(cur->essid)) {
-			sprintf(s, "%-*s ", sr.max_essid_len, cur->essid);
-			waddstr_b(w_aplst, s);
-			wattron(w_aplst, COLOR_PAIR(col));
+		if (r->bold) {
+			waddstr_b(w_aplst, r->essid);
+			wattron(w_aplst, COLOR_PAIR(r->col));
 		} else {
-			sprintf(s, "%-*s ", sr.max_essid_len, "<cryptic ESSID>");
-			wattron(w_aplst, COLOR_PAIR(col));
-			waddstr(w_aplst, s);
+			wattron(w_aplst, COLOR_PAIR(r->col));
+			waddstr(w_aplst, r->essid);
 		}
-		waddstr(w_aplst, ether_addr(&cur->ap_addr));
-
-		wattroff(w_aplst, COLOR_PAIR(col));
+		if (jump.marked && !memcmp(&ss->entry[idx[k]]->ap_addr,
+					   &jump.mark, sizeof(jump.mark)))
+			wadd_attr_str(w_aplst, A_REVERSE, r->addr);
+		else
+			waddstr(w_aplst, r->addr);
+		wattroff(w_aplst, COLOR_PAIR(r->col));
 
-		fmt_scan_entry(cur, s, sizeof(s));
-		waddstr(w_aplst, " ");
-		waddstr(w_aplst, s);
+		waddch(w_aplst, ' ');
+		for (i = 0; i < SPARK_LEN; i++)
+			waddch(w_aplst, r->spark[i]);
+		waddch(w_aplst, r->trend);
+		waddstr(w_aplst, r->info);
 	}
-
-	if (sr.num.entries < MAX_CH_STATS)
+	hidden = ss->num.entries - k;
+summary:
+	if (jump.prompt) {
+		wmove(w_aplst, MAXYLEN, 1);
+		wadd_attr_str(w_aplst, A_REVERSE, "jump to BSSID:");
+		waddch(w_aplst, ' ');
+		for (i = 0; jump.hex[i]; i++) {
+			if (i && i % 2 == 0)
+				waddch(w_aplst, ':');
+			waddch(w_aplst, jump.hex[i]);
+		}
+		goto done;
+	}
+	if (filter_edit.prompt) {
+		wmove(w_aplst, MAXYLEN, 1);
+		wadd_attr_str(w_aplst, A_REVERSE, "filter:");
+		waddch(w_aplst, ' ');
+		waddstr(w_aplst, filter_edit.expr);
+		if (*filter_edit.err) {
+			sprintf(s, " (%s)", filter_edit.err);
+			waddstr(w_aplst, s);
+		}
+		goto done;
+	}
+	if (ss->num.entries + ss->num.filtered < MAX_CH_STATS)
 		goto done;
 
 	wmove(w_aplst, MAXYLEN, 1);
 	wadd_attr_str(w_aplst, A_REVERSE, "total:");
-	sprintf(s, " %d ", sr.num.entries);
+	sprintf(s, " %d ", ss->num.entries);
 	waddstr(w_aplst, s);
 
 	sprintf(s, "%s %ssc", sort_type[conf.scan_sort_order], conf.scan_sort_asc ? "a" : "de");
 	wadd_attr_str(w_aplst, A_REVERSE, s);
+	if (order.spec_err)
+		waddstr(w_aplst, " (invalid sort_spec)");
+
+	if (ss->cached) {
+		waddstr(w_aplst, ", cached");
+	} else {
+		sprintf(s, ", %sscan %.1fs", ss->directed ? "watch " : "",
+			scan_latency_ms / 1e3);
+		waddstr(w_aplst, s);
+		if (ss->sched.period_ms) {
+			sprintf(s, " every %.0fs, %.1f%% off-channel",
+				ss->sched.period_ms / 1e3, ss->sched.offchan_pct);
+			waddstr(w_aplst, s);
+		}
+	}
 
-	if (sr.num.entries + START_LINE > line) {
-		sprintf(s, ", %d not shown", sr.num.entries + START_LINE - line);
+	if (show_channels && hidden > 0) {
+		sprintf(s, ", %d not shown", hidden);
+		waddstr(w_aplst, s);
+	} else if (!show_channels && (first || hidden > 0)) {
+		sprintf(s, ", showing %zu-%zu", first + 1, k);
 		waddstr(w_aplst, s);
 	}
-	if (sr.num.open) {
-		sprintf(s, ", %d open", sr.num.open);
+	if (ss->num.filtered) {
+		sprintf(s, ", %d filtered", ss->num.filtered);
+		waddstr(w_aplst, s);
+	}
+	if (ss->filter_gen != sr.filter_gen)
+		waddstr(w_aplst, ", filter pending");
+	if (ss->num.open) {
+		sprintf(s, ", %d open", ss->num.open);
 		waddstr(w_aplst, s);
 	}
 
-	if (sr.num.two_gig && sr.num.five_gig) {
+	if (ss->num.two_gig && ss->num.five_gig) {
 		waddch(w_aplst, ' ');
 		wadd_attr_str(w_aplst, A_REVERSE, "5/2GHz:");
-		sprintf(s, " %d/%d", sr.num.five_gig, sr.num.two_gig);
+		sprintf(s, " %d/%d", ss->num.five_gig, ss->num.two_gig);
 		waddstr(w_aplst, s);
 	}
 
-	if (sr.channel_stats) {
+	if (ss->chan.num_top) {
 		waddch(w_aplst, ' ');
 		if (conf.scan_sort_order == SO_CHAN && !conf.scan_sort_asc)
-			sprintf(s, "bottom-%d:", (int)sr.num.ch_stats);
+			sprintf(s, "bottom-%d:", ss->chan.num_top);
 		else
-			sprintf(s, "top-%d:", (int)sr.num.ch_stats);
+			sprintf(s, "top-%d:", ss->chan.num_top);
 		wadd_attr_str(w_aplst, A_REVERSE, s);
 
-		for (i = 0; i < sr.num.ch_stats; i++) {
+		for (i = 0; i < ss->chan.num_top; i++) {
+			slot = ss->chan.top[i];
 			waddstr(w_aplst, i ? ", " : " ");
-			sprintf(s, "ch#%d", sr.channel_stats[i].val);
+			sprintf(s, "%s#%d", chan_hist_band(slot) == BAND_6GHZ ?
+				"6g" : "ch", chan_hist_chan(slot));
 			wadd_attr_str(w_aplst, A_BOLD, s);
-			sprintf(s, " (%d)", sr.channel_stats[i].count);
+			sprintf(s, " (%d)", ss->chan.ch[slot].count);
 			waddstr(w_aplst, s);
 		}
 	}
+
+	getyx(w_aplst, view.count_y, view.count_x);
+	view_show_counts(w_aplst);
 done:
-	pthread_mutex_unlock(&sr.mutex);
+	scan_snapshot_put(&sr);
 	wrefresh(w_aplst);
 }
 
+/* The scan thread signals each newly published set of results. */
+static void redraw_aplist(int fd)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) == sizeof(count))
+		display_aplist(w_aplst);
+}
+
 void scr_aplst_init(void)
 {
 	w_aplst = newwin_title(0, WAV_HEIGHT, "Scan window", false);
@@ -183,7 +538,78 @@ void scr_aplst_init(void)
 	wrefresh(w_aplst);
 
 	scan_result_init(&sr);
-	pthread_create(&scan_thread, NULL, do_scan, &sr);
+	if (*filter_edit.applied)
+		scan_result_set_filter(&sr, scan_filter_compile(filter_edit.applied,
+								filter_edit.err,
+								sizeof(filter_edit.err)));
+	filter_edit.prompt = false;
+	shown_gen = 0;
+	memset(&view, 0, sizeof(view));
+	memset(&jump, 0, sizeof(jump));
+	first	  = 0;
+	rows.gen  = 0;
+	if (pthread_create(&scan_thread, NULL, do_scan, &sr))
+		err_sys("can not start scan thread");
+	ev_add(sr.notify_fd, redraw_aplist);
+}
+
+/* Edit the BSSID to jump to. Returns the key for the main menu, if any. */
+static int jump_key(int key)
+{
+	size_t len = strlen(jump.hex);
+
+	if (key == ERR || (key >= KEY_F(1) && key <= KEY_F(12)))
+		return key;
+
+	if (isxdigit(key) && len < sizeof(jump.hex) - 1) {
+		jump.hex[len] = tolower(key);
+	} else if ((key == KEY_BACKSPACE || key == 0177 || key == '\b') && len) {
+		jump.hex[len - 1] = '\0';
+	} else if (key == '\r' || key == '\n' || key == KEY_ENTER) {
+		jump.prompt = false;
+		jump.go	    = len > 0;
+	} else if (key == 033) {
+		jump.prompt = false;
+	} else if (key != ':') {
+		flash();
+	}
+	view_invalidate();
+	return -1;
+}
+
+/* Edit the filter expression. Returns the key for the main menu, if any. */
+static int filter_key(int key)
+{
+	size_t len = strlen(filter_edit.expr);
+	struct scan_filter *f;
+
+	if (key == ERR || (key >= KEY_F(1) && key <= KEY_F(12)))
+		return key;
+
+	*filter_edit.err = '\0';
+	if (isprint(key) && len < sizeof(filter_edit.expr) - 1) {
+		filter_edit.expr[len]	  = key;
+		filter_edit.expr[len + 1] = '\0';
+	} else if ((key == KEY_BACKSPACE || key == 0177 || key == '\b') && len) {
+		filter_edit.expr[len - 1] = '\0';
+	} else if (key == '\r' || key == '\n' || key == KEY_ENTER) {
+		f = scan_filter_compile(filter_edit.expr, filter_edit.err,
+					sizeof(filter_edit.err));
+		if (f) {
+			scan_result_set_filter(&sr, f);
+			strcpy(filter_edit.applied, filter_edit.expr);
+			filter_edit.prompt = false;
+		} else {
+			flash();
+		}
+	} else if (key == 033) {
+		strcpy(filter_edit.expr, filter_edit.applied);
+		filter_edit.prompt = false;
+	} else {
+		flash();
+	}
+	view_invalidate();
+	return -1;
 }
 
 int scr_aplst_loop(WINDOW *w_menu)
@@ -193,7 +619,40 @@ int scr_aplst_loop(WINDOW *w_menu)
 	display_aplist(w_aplst);
 
 	key = wgetch(w_menu);
+	if (jump.prompt)
+		return jump_key(key);
+	if (filter_edit.prompt)
+		return filter_key(key);
+
 	switch (key) {
+	case KEY_UP:
+		first -= first > 0;
+		return -1;
+	case KEY_DOWN:
+		first++;
+		return -1;
+	case KEY_PPAGE:
+		first -= first > PAGE_LINES ? PAGE_LINES : first;
+		return -1;
+	case KEY_NPAGE:
+		first += PAGE_LINES;
+		return -1;
+	case KEY_HOME:
+		first = 0;
+		return -1;
+	case KEY_END:
+		first = SIZE_MAX - PAGE_LINES;
+		return -1;
+	case '/':	/* jump to BSSID */
+		memset(&jump, 0, sizeof(jump));
+		jump.prompt = true;
+		view_invalidate();
+		return -1;
+	case 'f':	/* filter */
+		strcpy(filter_edit.expr, filter_edit.applied);
+		filter_edit.prompt = true;
+		view_invalidate();
+		return -1;
 	case 'a':	/* ascending */
 		conf.scan_sort_asc = true;
 		return -1;
@@ -220,13 +679,21 @@ int scr_aplst_loop(WINDOW *w_menu)
 	case 's':	/* signal */
 		conf.scan_sort_order = SO_SIGNAL;
 		return -1;
+	case 'v':	/* stations or channels */
+		show_channels = !show_channels;
+		return -1;
 	}
 	return key;
 }
 
 void scr_aplst_fini(void)
 {
+	ev_del(sr.notify_fd);
 	pthread_cancel(scan_thread);
+	pthread_join(scan_thread, NULL);
 	scan_result_fini(&sr);
+	scan_order_fini(&order);
+	free(rows.row);
+	memset(&rows, 0, sizeof(rows));
 	delwin(w_aplst);
 }
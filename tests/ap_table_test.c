@@ -0,0 +1,119 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test of the statistics and signal history kept per station
+ *
+ * Records scans of a single station, one at a time, as the scan thread does.
+ * Samples whose level the driver marked as invalid (e.g. SIGNAL_UNSPEC only,
+ * sanitized by iw_sanitize()) must count as observations, but must not enter
+ * the signal statistics or the history.
+ */
+#include "ap_table.c"
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+/* Record one scan of the test station, returning its entry as filled in. */
+static struct scan_entry record(struct ap_table *t, int dbm, bool invalid,
+				int8_t spark[SPARK_LEN])
+{
+	const struct timespec tick = { .tv_nsec = 2000000 };
+	struct scan_snapshot ss = { 0 };
+	struct scan_entry e = { 0 }, *ep = &e;
+
+	/* Observations within the same millisecond count as repeated ones */
+	nanosleep(&tick, NULL);
+
+	e.ap_addr.ether_addr_octet[5] = 1;
+	e.dbm.signal   = dbm;
+	e.qual.updated = IW_QUAL_DBM | (invalid ? IW_QUAL_LEVEL_INVALID : 0);
+	e.freq	       = 2412;
+	strcpy(e.essid, "test");
+
+	ss.head	       = &e;
+	ss.entry       = &ep;
+	ss.num.entries = 1;
+	ap_table_update(t, &ss);
+	ap_table_spark(t, &ss);
+	memcpy(spark, ss.spark, SPARK_LEN);
+	scan_arena_reset(&ss.arena);
+	return e;
+}
+
+static void test_invalid_level(void)
+{
+	struct ap_table t = { 0 };
+	struct scan_entry e;
+	struct bss_stats valid;
+	int8_t spark[SPARK_LEN], valid_spark[SPARK_LEN];
+	int k;
+
+	/* Unknown from the start: no statistics, no history */
+	e = record(&t, 0, true, spark);
+	CHECK(e.stats.seen == 1);
+	CHECK(e.stats.sig_avg == 0 && e.stats.sig_min == 0 && e.stats.sig_max == 0);
+	for (k = 0; k < SPARK_LEN; k++)
+		CHECK(spark[k] == SPARK_NONE);
+
+	record(&t, -60, false, spark);
+	e = record(&t, -50, false, valid_spark);
+	valid = e.stats;
+	CHECK(valid.seen == 3);
+	CHECK(valid.sig_min == -60 && valid.sig_max == -50);
+	CHECK(valid.sig_avg == -57.5f);
+	CHECK(valid.trend == 1);
+	CHECK(valid_spark[SPARK_LEN - 1] == -50 && valid_spark[SPARK_LEN - 2] == -60);
+	CHECK(valid_spark[SPARK_LEN - 3] == SPARK_NONE);
+
+	/* Invalid levels (here 0 dBm, as left by iw_sanitize()) change nothing */
+	for (k = 0; k < 3; k++) {
+		e = record(&t, 0, true, spark);
+		CHECK(e.stats.seen == valid.seen + k + 1);
+		CHECK(e.stats.sig_avg == valid.sig_avg);
+		CHECK(e.stats.sig_min == valid.sig_min);
+		CHECK(e.stats.sig_max == valid.sig_max);
+		CHECK(e.stats.trend == valid.trend);
+		CHECK(memcmp(spark, valid_spark, SPARK_LEN) == 0);
+	}
+
+	/* ... and the next valid level continues where the last one left off */
+	e = record(&t, -50, false, spark);
+	CHECK(e.stats.sig_avg == -55.625f && e.stats.sig_max == -50);
+	CHECK(spark[SPARK_LEN - 1] == -50 && spark[SPARK_LEN - 2] == -50 &&
+	      spark[SPARK_LEN - 3] == -60);
+
+	ap_table_fini(&t);
+}
+
+int main(void)
+{
+	test_invalid_level();
+
+	if (failures)
+		fprintf(stderr, "ap_table_test: %d checks failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
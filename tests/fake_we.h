@@ -0,0 +1,131 @@
+/*
+ * Fake wireless-extensions driver, for the tests and benchmarks of iw_scan.c
+ *
+ * Include in place of iw_scan.c: the interface, netlink and ioctl calls made
+ * by iw_scan.c are redirected to the fakes below, which answer SIOCGIWSCAN
+ * from a synthetic event stream of any number of cells.
+ */
+#define if_ioctl		fake_if_ioctl
+#define if_handle_get		fake_if_handle_get
+#define rtnl_scan_events_init	fake_scan_events_init
+#define rtnl_scan_events_wait	fake_scan_events_wait
+#define iw_nl80211_active	fake_nl80211_active
+#define iw_nl80211_supported	fake_nl80211_supported
+#include "iw_scan.c"
+
+/*
+ * Fake driver
+ */
+static struct {
+	uint8_t		*data;		/* event stream of the current scan */
+	size_t		len;
+	bool		hint;		/* report the length needed on E2BIG */
+	int		gets;		/* number of SIOCGIWSCAN calls */
+	int		waits;		/* number of scan event waits */
+	struct if_handle h;
+} drv;
+
+int fake_if_ioctl(struct if_handle *h, unsigned long request, void *req)
+{
+	struct iwreq *wrq = req;
+
+	if (request != SIOCGIWSCAN)
+		return 0;
+
+	drv.gets++;
+	if (wrq->u.data.length < drv.len) {
+		/* The length is 16 bits wide, larger streams can not be hinted */
+		if (drv.hint)
+			wrq->u.data.length = drv.len < 0xffff ? drv.len : 0xffff;
+		errno = E2BIG;
+		return -1;
+	}
+	memcpy(wrq->u.data.pointer, drv.data, drv.len);
+	wrq->u.data.length = drv.len;
+	return 0;
+}
+
+struct if_handle *fake_if_handle_get(const char *ifname)
+{
+	return &drv.h;
+}
+
+int fake_scan_events_init(void)
+{
+	return 0;
+}
+
+/* Report a completion event, as a driver does once per scan. */
+int fake_scan_events_wait(int ifindex, const struct timespec *deadline)
+{
+	return ++drv.waits <= 3;
+}
+
+bool fake_nl80211_active(const char *ifname)
+{
+	return false;
+}
+
+bool fake_nl80211_supported(const char *ifname)
+{
+	return false;
+}
+
+/*
+ * Synthetic event streams, in the WE-19 layout
+ */
+static uint8_t *put_event(uint8_t *p, uint16_t cmd, const void *data, uint16_t len)
+{
+	uint16_t ev_len = IW_EV_LCP_PK_LEN + len;
+
+	memcpy(p, &ev_len, sizeof(ev_len));
+	memcpy(p + 2, &cmd, sizeof(cmd));
+	memcpy(p + IW_EV_LCP_PK_LEN, data, len);
+	return p + ev_len;
+}
+
+static uint8_t *put_point(uint8_t *p, uint16_t cmd, uint16_t flags,
+			  const void *data, uint16_t len)
+{
+	uint8_t payload[4 + IW_GENERIC_IE_MAX];
+
+	memcpy(payload, &len, sizeof(len));
+	memcpy(payload + 2, &flags, sizeof(flags));
+	if (len)
+		memcpy(payload + 4, data, len);
+	return put_event(p, cmd, payload, 4 + len);
+}
+
+/* Generate a scan of @n cells into drv, each with a distinct BSSID. */
+static void make_scan(size_t n)
+{
+	const uint8_t rsn[] = { 0x30, 0x04, 0x01, 0x00, 0x00, 0x0f };
+	struct sockaddr ap = { .sa_family = ARPHRD_ETHER };
+	struct iw_quality qual = { .qual = 50, .level = 200, .updated = 0x0b };
+	struct iw_freq freq = { .m = 2412, .e = 6 };
+	char essid[IW_ESSID_MAX_SIZE];
+	__u32 mode = IW_MODE_MASTER;
+	uint8_t *p;
+	size_t i;
+
+	free(drv.data);
+	drv.data = p = malloc(n * 128);
+	if (!p)
+		err_sys("can not allocate synthetic scan");
+
+	for (i = 0; i < n; i++) {
+		ap.sa_data[4] = i >> 8;
+		ap.sa_data[5] = i;
+		freq.m	      = 2412 + 5 * (i % 13);
+		snprintf(essid, sizeof(essid), "net-%zu", i % 300);
+
+		p = put_event(p, SIOCGIWAP, &ap, sizeof(ap));
+		p = put_point(p, SIOCGIWESSID, 1, essid, strlen(essid));
+		p = put_event(p, SIOCGIWMODE, &mode, sizeof(mode));
+		p = put_event(p, SIOCGIWFREQ, &freq, sizeof(freq));
+		p = put_point(p, SIOCGIWENCODE, 0, NULL, 0);
+		p = put_event(p, IWEVQUAL, &qual, sizeof(qual));
+		p = put_point(p, IWEVGENIE, 0, rsn, sizeof(rsn));
+	}
+	drv.len = p - drv.data;
+}
@@ -0,0 +1,101 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Cost of one refresh of the interface information and counters
+ *
+ * Compares if_getinf() and if_getstat() via rtnetlink against their fallback
+ * via ioctls and /proc/net/dev, on the loopback interface (or the interface
+ * given as argument). iw_if.c is compiled into this program with the rtnetlink
+ * calls going through switchable wrappers.
+ */
+#define rtnl_getinf	bench_rtnl_getinf
+#define rtnl_getstat	bench_rtnl_getstat
+#include "iw_if.c"
+#undef rtnl_getinf
+#undef rtnl_getstat
+
+extern int rtnl_getinf(const char *ifname, struct if_info *info);
+extern int rtnl_getstat(const char *ifname, struct if_stat *stat);
+
+#define BENCH_ROUNDS	20000
+
+static bool use_rtnl;
+
+int bench_rtnl_getinf(const char *ifname, struct if_info *info)
+{
+	return use_rtnl ? rtnl_getinf(ifname, info) : -EOPNOTSUPP;
+}
+
+int bench_rtnl_getstat(const char *ifname, struct if_stat *stat)
+{
+	return use_rtnl ? rtnl_getstat(ifname, stat) : -EOPNOTSUPP;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Time BENCH_ROUNDS refreshes of @ifname, as the info screen does them. */
+static void bench(const char *ifname, bool rtnl, struct if_info *info)
+{
+	struct if_handle *h = if_handle_get(ifname);
+	unsigned long ioctls = h->ioctls;
+	struct if_stat stat;
+	uint64_t start;
+	int i;
+
+	use_rtnl = rtnl;
+	if_getinf(ifname, info);		/* warm up, open the sockets */
+	if_getstat(ifname, &stat);
+
+	ioctls = h->ioctls;
+	start  = now_ns();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if_getinf(ifname, info);
+		if_getstat(ifname, &stat);
+	}
+	printf("%-14s %8.2f us/refresh %6.1f ioctls/refresh\n",
+	       rtnl ? "rtnetlink" : "ioctl + /proc",
+	       (now_ns() - start) / 1e3 / BENCH_ROUNDS,
+	       (double)(h->ioctls - ioctls) / BENCH_ROUNDS);
+}
+
+int main(int argc, char **argv)
+{
+	const char *ifname = argc > 1 ? argv[1] : "lo";
+	struct if_info nl, io;
+
+	if (rtnl_getinf(ifname, &nl) < 0)
+		err_quit("%s: rtnetlink not available", ifname);
+
+	printf("if_getinf() + if_getstat() on %s, %d rounds:\n",
+	       ifname, BENCH_ROUNDS);
+	bench(ifname, false, &io);
+	bench(ifname, true, &nl);
+
+	/* Both paths must agree (ifr_flags is a short, without IFF_LOWER_UP) */
+	if (nl.mtu != io.mtu || (uint16_t)nl.flags != (uint16_t)io.flags ||
+	    nl.addr.s_addr != io.addr.s_addr)
+		err_quit("%s: results of both paths differ", ifname);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test of the batch sampler on a copy of /proc/net/wireless
+ *
+ * iw_if.c is compiled into this program, so that the descriptor which the
+ * sampler keeps open can be pointed at a temporary file listing several
+ * interfaces, in another order than they are requested in.
+ */
+#include "iw_if.c"
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+static const char proc_wireless[] =
+"Inter-| sta-|   Quality        |   Discarded packets               | Missed | WE\n"
+" face | tus | link level noise |  nwid  crypt   frag  retry   misc | beacon | 22\n"
+"  wlan0: 0000   54.  -56.  -256        0      0      0      0      0        0\n"
+"  wlan1: 001a   70.  160.   40.        1      2      3      4      5        6\n"
+" wlan10: 0000   99.  -10.   -20.       0      0      0      0      0        0\n"
+"  wlan2: 0000   30   -70    -95        0      0      0      0      0        7\n"
+"  wlan3: 0000   30   -70";
+
+static void test_batch(void)
+{
+	const char *const ifnames[] = { "wlan2", "wlan0", "wlan1" };
+	struct iw_stat iw[ARRAY_SIZE(ifnames)] = { 0 };
+	bool found[ARRAY_SIZE(ifnames)] = { 0 };
+	FILE *fp = tmpfile();
+
+	if (!fp || fputs(proc_wireless, fp) < 0 || fflush(fp))
+		err_sys("can not write statistics file");
+	proc_wireless_fd = fileno(fp);
+
+	/* wlan1 reports RCPI, as declared in its range only */
+	iw[2].range.max_qual.updated = IW_QUAL_RCPI;
+	conf.backend = BE_WEXT;
+
+	CHECK(iw_proc_getstat(ifnames, iw, found, ARRAY_SIZE(ifnames)) == 3);
+	CHECK(found[0] && found[1] && found[2]);
+	iw_getstat_batch(ifnames, iw, ARRAY_SIZE(ifnames));
+
+	CHECK(iw[0].stat.qual.qual == 30 && iw[0].dbm.signal == -70);
+	CHECK(iw[0].dbm.noise == -95 && !(iw[0].stat.qual.updated & IW_QUAL_NOISE_INVALID));
+	CHECK(!(iw[0].stat.qual.updated & IW_QUAL_ALL_UPDATED));
+	CHECK(iw[0].stat.miss.beacon == 7);
+
+	CHECK(iw[1].stat.qual.qual == 54 && iw[1].dbm.signal == -56);
+	CHECK(iw[1].stat.qual.updated & IW_QUAL_NOISE_INVALID);
+	CHECK(iw[1].stat.qual.updated & IW_QUAL_LEVEL_UPDATED);
+
+	CHECK(iw[2].stat.status == 0x1a && iw[2].stat.qual.qual == 70);
+	CHECK(iw[2].dbm.signal == -30 && iw[2].dbm.noise == -90);
+	CHECK(iw[2].stat.discard.nwid == 1 && iw[2].stat.discard.code == 2 &&
+	      iw[2].stat.discard.fragment == 3 && iw[2].stat.discard.retries == 4 &&
+	      iw[2].stat.discard.misc == 5 && iw[2].stat.miss.beacon == 6);
+
+	/* Only interfaces not yet found are looked for; the last line is cut */
+	found[0] = found[2] = false;
+	found[1] = true;
+	CHECK(iw_proc_getstat(ifnames, iw, found, ARRAY_SIZE(ifnames)) == 2);
+	memset(found, 0, sizeof(found));
+	CHECK(iw_proc_getstat((const char *const []){ "wlan3", "wlan" },
+			      iw, found, 2) == 0);
+
+	fclose(fp);
+	proc_wireless_fd = -1;
+}
+
+int main(void)
+{
+	test_batch();
+
+	if (failures)
+		fprintf(stderr, "iw_if_test: %d checks failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test of the nl80211 message decoders on GET_SCAN, GET_STATION and
+ * GET_INTERFACE replies
+ *
+ * The replies in nl80211_captures.h are decoded as received, and each message
+ * again after being cut short at every length. Build with -fsanitize=address
+ * to also catch reads beyond the end of a message.
+ */
+#include "iw_nl80211.c"
+#include "nl80211_captures.h"
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+#define TEST_SEQ_SCAN		11
+#define TEST_SEQ_IFACE		12
+#define TEST_SEQ_STATION	13
+
+static bool bssid_is(const struct scan_entry *e, uint8_t last)
+{
+	const uint8_t addr[ETH_ALEN] = { 0x02, 0, 0, 0, last, 0 };
+
+	return memcmp(&e->ap_addr, addr, ETH_ALEN) == 0;
+}
+
+/*
+ * Pass each data message of @dump to @cb, cut short at every length. @reset
+ * is called before each, and @check after each with the cut message.
+ */
+static void cut_each(const uint8_t *dump, size_t size, nl_msg_cb cb,
+		     void (*reset)(void *), void (*check)(void *), void *arg)
+{
+	const struct nlmsghdr *nlh;
+	size_t off, len;
+	uint8_t *buf;
+
+	for (off = 0; off < size; off += NLMSG_ALIGN(nlh->nlmsg_len)) {
+		nlh = (const struct nlmsghdr *)(dump + off);
+		if (nlh->nlmsg_type < NLMSG_MIN_TYPE)
+			continue;
+
+		for (len = NLMSG_HDRLEN; len < nlh->nlmsg_len; len++) {
+			buf = malloc(len);
+			if (!buf)
+				err_sys("can not allocate message");
+			memcpy(buf, nlh, len);
+			((struct nlmsghdr *)buf)->nlmsg_len = len;
+
+			reset(arg);
+			nl_parse(buf, len, 0, cb, arg);
+			check(arg);
+			free(buf);
+		}
+	}
+}
+
+/*
+ * NL80211_CMD_GET_SCAN
+ */
+static struct scan_arena scan_arena;
+
+static void scan_reset(void *arg)
+{
+	struct nl80211_scan_list *sl = arg;
+
+	scan_arena_reset(&scan_arena);
+	sl->head  = NULL;
+	sl->tailp = &sl->head;
+	sl->arena = &scan_arena;
+}
+
+/* A cut message yields at most one entry, with a complete BSSID. */
+static void scan_check(void *arg)
+{
+	struct nl80211_scan_list *sl = arg;
+
+	if (!sl->head)
+		return;
+	CHECK(sl->head->next == NULL);
+	CHECK(bssid_is(sl->head, 1) || bssid_is(sl->head, 2) ||
+	      bssid_is(sl->head, 3));
+	CHECK(strlen(sl->head->essid) <= IW_ESSID_MAX_SIZE);
+}
+
+/* The IEs of the "dmg" BSS, where nothing follows them. */
+static void test_ie_cut(void)
+{
+	const uint8_t dmg_ies[] = { 0, 3, 'd', 'm', 'g', 0xdd, 0x16, 0, 0x50, 0xf2 };
+	uint8_t *ies = malloc(sizeof(dmg_ies));
+
+	if (!ies)
+		err_sys("can not allocate IEs");
+	memcpy(ies, dmg_ies, sizeof(dmg_ies));
+	CHECK(iw_extract_ie(ies, sizeof(dmg_ies)) == 0);
+	free(ies);
+}
+
+static void test_scan(void)
+{
+	struct nl80211_scan_list sl;
+	struct iw_range range = { 0 };
+	struct scan_entry *e;
+
+	scan_reset(&sl);
+	CHECK(nl_parse(nl80211_scan_dump, sizeof(nl80211_scan_dump),
+		       TEST_SEQ_SCAN, nl80211_scan_cb, &sl) == 0);
+
+	/* Level in mBm */
+	e = sl.head;
+	CHECK(e && bssid_is(e, 1));
+	if (!e)
+		return;
+	CHECK(strcmp(e->essid, "wavemon-test") == 0);
+	CHECK(e->freq == 2437 && e->mode == IW_MODE_MASTER && e->has_key);
+	CHECK(e->age_ms == 120);
+	CHECK(e->flags & IW_ENC_CAPA_WPA2);
+	CHECK(e->qual.updated & IW_QUAL_DBM);
+	CHECK(!(e->qual.updated & IW_QUAL_LEVEL_INVALID));
+	CHECK(e->qual.qual == -54 + 110);
+	iw_sanitize(&range, &e->qual, &e->dbm);
+	CHECK(e->dbm.signal == -54);
+
+	/* SIGNAL_UNSPEC only: a quality, but no level */
+	e = e->next;
+	CHECK(e && bssid_is(e, 2));
+	if (!e)
+		return;
+	CHECK(strcmp(e->essid, "adhoc-5g") == 0);
+	CHECK(e->freq == 5180 && e->mode == IW_MODE_ADHOC);
+	CHECK(e->age_ms == 3000);
+	CHECK(e->flags == IW_ENC_CAPA_WPA);
+	CHECK(e->qual.qual == 60 * NL80211_QUAL_MAX / 100);
+	CHECK(e->qual.updated & IW_QUAL_LEVEL_INVALID);
+	iw_sanitize(&range, &e->qual, &e->dbm);
+	CHECK(e->qual.updated & IW_QUAL_LEVEL_INVALID);
+	CHECK(e->qual.updated & IW_QUAL_NOISE_INVALID);
+	CHECK(e->dbm.signal == 0);
+
+	/* 60 GHz, last IE cut short, age unknown */
+	e = e->next;
+	CHECK(e && bssid_is(e, 3));
+	if (!e)
+		return;
+	CHECK(strcmp(e->essid, "dmg") == 0);
+	CHECK(e->freq == 58320);
+	CHECK(e->age_ms == -1);
+	CHECK(e->flags == 0);
+	iw_sanitize(&range, &e->qual, &e->dbm);
+	CHECK(e->dbm.signal == -71);
+
+	/* The BSS with a short BSSID is left out */
+	CHECK(e->next == NULL);
+
+	cut_each(nl80211_scan_dump, sizeof(nl80211_scan_dump), nl80211_scan_cb,
+		 scan_reset, scan_check, &sl);
+	scan_arena_reset(&scan_arena);
+}
+
+/*
+ * NL80211_CMD_GET_INTERFACE
+ */
+static void iface_reset(void *arg)
+{
+	struct nl80211_iface *ifc = arg;
+
+	memset(ifc, 0, sizeof(*ifc));
+	ifc->ssid_len = -1;
+}
+
+static void iface_check(void *arg)
+{
+	struct nl80211_iface *ifc = arg;
+
+	CHECK(strlen(ifc->ifname) < IFNAMSIZ);
+	CHECK(ifc->ssid_len <= IW_ESSID_MAX_SIZE);
+	CHECK(ifc->ssid_len < 0 || strlen(ifc->ssid) <= (size_t)ifc->ssid_len);
+	CHECK(ifc->freq == 0 || ifc->freq == 5180);
+}
+
+static void test_iface(void)
+{
+	struct nl80211_iface ifc;
+
+	iface_reset(&ifc);
+	CHECK(nl_parse(nl80211_iface_wlp2s0, sizeof(nl80211_iface_wlp2s0),
+		       TEST_SEQ_IFACE, nl80211_iface_cb, &ifc) == 0);
+	CHECK(strcmp(ifc.ifname, "wlp2s0") == 0);
+	CHECK(ifc.iftype == NL80211_IFTYPE_STATION);
+	CHECK(iftype_to_mode[ifc.iftype] == IW_MODE_INFRA);
+	CHECK(ifc.freq == 5180);
+	CHECK(ifc.has_txpower && ifc.txpower == 2200);
+	CHECK(ifc.ssid_len == 12 && strcmp(ifc.ssid, "wavemon-test") == 0);
+
+	cut_each(nl80211_iface_wlp2s0, sizeof(nl80211_iface_wlp2s0),
+		 nl80211_iface_cb, iface_reset, iface_check, &ifc);
+}
+
+/*
+ * NL80211_CMD_GET_STATION
+ */
+static void station_reset(void *arg)
+{
+	memset(arg, 0, sizeof(struct nl80211_station));
+}
+
+static void station_check(void *arg)
+{
+	struct nl80211_station *sta = arg;
+
+	CHECK(!sta->has_signal || sta->signal == -50 || sta->signal == -52);
+	CHECK(sta->bitrate == 0 || sta->bitrate == 866);
+}
+
+static void test_station(void)
+{
+	const uint8_t ap[ETH_ALEN] = { 0x02, 0, 0, 0, 1, 0 };
+	const struct nlmsghdr *second;
+	struct nl80211_station sta = { 0 };
+
+	/* Only the first station counts, with its average signal level */
+	CHECK(nl_parse(nl80211_station_dump, sizeof(nl80211_station_dump),
+		       TEST_SEQ_STATION, nl80211_station_cb, &sta) == 0);
+	CHECK(sta.found && memcmp(&sta.addr, ap, ETH_ALEN) == 0);
+	CHECK(sta.has_signal && sta.signal == -50);
+	CHECK(sta.bitrate == 866);
+	CHECK(sta.tx_failed == 3 && sta.rx_drop == 19 && sta.beacon_loss == 2);
+
+	/* Without SIGNAL_AVG, the last signal level is used */
+	second = (const struct nlmsghdr *)(nl80211_station_dump +
+		 NLMSG_ALIGN(((const struct nlmsghdr *)nl80211_station_dump)->nlmsg_len));
+	station_reset(&sta);
+	nl_parse(second, second->nlmsg_len, TEST_SEQ_STATION, nl80211_station_cb, &sta);
+	CHECK(sta.found && sta.has_signal && sta.signal == -52);
+
+	cut_each(nl80211_station_dump, sizeof(nl80211_station_dump),
+		 nl80211_station_cb, station_reset, station_check, &sta);
+}
+
+int main(void)
+{
+	test_scan();
+	test_ie_cut();
+	test_iface();
+	test_station();
+
+	if (failures)
+		fprintf(stderr, "iw_nl80211_test: %d checks failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
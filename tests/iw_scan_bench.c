@@ -0,0 +1,139 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Allocations, memory and time per wireless-extensions scan
+ *
+ * Reads synthetic scans of increasing size through get_scan_list(), counting
+ * the heap allocations made and the arena space used per entry. For reference,
+ * the entry layout of wavemon 0.7.6 is reproduced below; it was allocated with
+ * one calloc() per entry.
+ */
+#include "fake_we.h"
+#include <malloc.h>
+
+#define BENCH_ROUNDS	200
+
+/* struct scan_entry as of wavemon 0.7.6 */
+struct scan_entry_0_7_6 {
+	struct ether_addr	ap_addr;
+	char			essid[IW_ESSID_MAX_SIZE + 2];
+	int			mode;
+	double			freq;
+	int			chan;
+	struct iw_quality	qual;
+	struct iw_levelstat	dbm;
+	int			has_key:1;
+	uint32_t		flags;
+	struct scan_entry_0_7_6	*next;
+};
+
+/*
+ * Allocation counting, by interposing on the glibc allocator
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool counting;
+static unsigned long allocs;
+
+void *malloc(size_t size)
+{
+	allocs += counting;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocs += counting;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocs += counting;
+	return __libc_realloc(ptr, size);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(size_t cells)
+{
+	struct iw_range range = { .we_version_compiled = 22 };
+	struct scan_arena arena = { 0 };
+	unsigned long chunks = 0;
+	size_t used = 0;
+	uint8_t *raw;
+	uint64_t start, ns = 0;
+	int i;
+
+	make_scan(cells);
+	drv.hint = true;
+
+	/* The first round grows scan_buf, which later scans reuse */
+	get_scan_list("test0", &range, false, NULL, &raw, &arena);
+	free(raw);
+	scan_arena_reset(&arena);
+
+	allocs = 0;
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		counting = true;
+		start	 = now_ns();
+		if (!get_scan_list("test0", &range, false, NULL, &raw, &arena))
+			err_quit("no results from %zu cells", cells);
+		ns	+= now_ns() - start;
+		counting = false;
+
+		chunks = arena.allocs;
+		used   = arena.used;
+		free(raw);
+		scan_arena_reset(&arena);
+	}
+	printf("%6zu %12.1f %12lu %12.1f %12.1f\n", cells,
+	       (double)allocs / BENCH_ROUNDS, chunks,
+	       (double)used / cells, ns / 1e3 / BENCH_ROUNDS / cells * 1e3);
+}
+
+int main(void)
+{
+	const size_t cells[] = { 10, 50, 200, 700 };
+	void *p = __libc_malloc(sizeof(struct scan_entry_0_7_6));
+	size_t i;
+
+	printf("sizeof(struct scan_entry): %zu bytes (0.7.6: %zu bytes, %zu on the heap)\n",
+	       sizeof(struct scan_entry), sizeof(struct scan_entry_0_7_6),
+	       malloc_usable_size(p) + sizeof(size_t));
+	printf("0.7.6 made one allocation per entry, plus the results buffer\n\n");
+	free(p);
+
+	printf("%6s %12s %12s %12s %12s\n",
+	       "cells", "allocs/scan", "arena chunks", "bytes/entry", "ns/entry");
+	for (i = 0; i < ARRAY_SIZE(cells); i++)
+		bench(cells[i]);
+
+	free(drv.data);
+	free(scan_buf.data);
+	return EXIT_SUCCESS;
+}
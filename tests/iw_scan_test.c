@@ -0,0 +1,140 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Stress test of the wireless-extensions scan path with synthetic scans
+ *
+ * A fake driver answers SIOCGIWSCAN from a generated event stream of any
+ * number of cells, so that the buffer growth, the E2BIG limit and the
+ * indexer can be exercised with scans far denser than real hardware gives.
+ */
+#include "fake_we.h"
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+static size_t list_len(const struct scan_entry *e)
+{
+	size_t n = 0;
+
+	for (; e; e = e->next)
+		n++;
+	return n;
+}
+
+/* Results that fit into 64 KiB, with and without a length hint. */
+static void test_grow(bool hint)
+{
+	struct iw_range range = { .we_version_compiled = 22 };
+	struct scan_arena arena = { 0 };
+	struct scan_entry *head, *e;
+	uint8_t *raw;
+	size_t n = 0;
+
+	make_scan(700);
+	CHECK(drv.len > IW_SCAN_MAX_DATA && drv.len <= SCAN_BUF_MAX);
+
+	drv.hint = hint;
+	drv.gets = 0;
+	head = get_scan_list("test0", &range, false, NULL, &raw, &arena);
+	CHECK(list_len(head) == 700);
+	CHECK(drv.gets <= (hint ? 2 : 6));
+	CHECK(arena.allocs == 1);
+
+	for (e = head; e; e = e->next, n++) {
+		CHECK(e->ap_addr.ether_addr_octet[5] == (n & 0xff));
+		CHECK(e->freq == 2412 + 5 * (n % 13));
+		CHECK(e->ie_len == 6);
+	}
+	CHECK(head && (scan_entry_flags(head) & IW_ENC_CAPA_WPA2));
+
+	free(raw);
+	scan_arena_reset(&arena);
+}
+
+/* Too dense for wireless extensions: E2BIG, without waiting out the scan. */
+static void test_e2big(int ifindex)
+{
+	struct iw_range range = { .we_version_compiled = 22 };
+	struct scan_arena arena = { 0 };
+	struct timespec start, end;
+	uint8_t *raw;
+
+	make_scan(1200);
+	CHECK(drv.len > SCAN_BUF_MAX);
+
+	drv.h.ifindex = ifindex;
+	drv.hint      = true;
+	drv.gets      = 0;
+	drv.waits     = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	CHECK(get_scan_list("test0", &range, true, NULL, &raw, &arena) == NULL);
+	CHECK(errno == E2BIG);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* With events, exactly one wait; without, one 250 ms poll interval */
+	if (ifindex)
+		CHECK(drv.waits == 1);
+	CHECK(end.tv_sec - start.tv_sec < 2);
+	CHECK(scan_buf.size == SCAN_BUF_MAX);
+	scan_arena_reset(&arena);
+}
+
+/* Index streams beyond the WE limit, and truncated ones. */
+static void test_index(void)
+{
+	struct we_cell *cells;
+	size_t n, cut, i, j;
+
+	make_scan(5000);
+	n = we_index_v19(drv.data, drv.len, &cells);
+	CHECK(n == 5000);
+	free(cells);
+
+	for (cut = 1; cut < 4000; cut += 37) {
+		n = we_index_v19(drv.data, cut, &cells);
+		for (i = 0; i < n; i++)
+			for (j = 0; j < WE_CELL_EVENTS; j++)
+				CHECK(cells[i].ev[j] <= cut);
+		free(cells);
+	}
+}
+
+int main(void)
+{
+	test_grow(true);
+	test_grow(false);
+	test_e2big(1);
+	test_e2big(0);
+	test_index();
+
+	free(drv.data);
+	free(scan_buf.data);
+	if (failures)
+		fprintf(stderr, "iw_scan_test: %d checks failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/*
+ * nl80211 replies for tests/iw_nl80211_test.c
+ *
+ * These are laid out as net/wireless/nl80211.c sends them for a station
+ * interface (wlp2s0, ifindex 3): the same attributes in the same order, with
+ * 64-bit values padded to 8 bytes. They were composed rather than recorded,
+ * as no wireless device was available to record them from.
+ *
+ * The scan dump contains:
+ * - 02:00:00:00:01:00 "wavemon-test", 2437 MHz, ESS with RSN, -54.00 dBm
+ *   (SIGNAL_MBM), seen 120 ms ago;
+ * - 02:00:00:00:02:00 "adhoc-5g", 5180 MHz, IBSS with WPA, only SIGNAL_UNSPEC
+ *   (60%), as reported by drivers without dBm levels;
+ * - 02:00:00:00:03:00 "dmg", 58320 MHz, whose last IE is cut short, and
+ *   without SEEN_MS_AGO;
+ * - a BSS whose BSSID attribute has only four bytes.
+ * The station dump lists the access point with SIGNAL_AVG, then another
+ * station with SIGNAL only.
+ */
+
+/* NL80211_CMD_GET_SCAN dump (seq 11): four BSSes, then NLMSG_DONE */
+static const unsigned char nl80211_scan_dump[] = {
+	0x08, 0x01, 0x00, 0x00, 0x1f, 0x00, 0x02, 0x00, 0x0b, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x22, 0x01, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00,
+	0x2e, 0x00, 0x00, 0x00, 0x08, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x0c, 0x00, 0x99, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xd8, 0x00, 0x2f, 0x00, 0x0a, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x0e, 0x00, 0x35, 0x00, 0x06, 0x00,
+	0x00, 0x0c, 0x77, 0x61, 0x76, 0x65, 0x6d, 0x6f, 0x6e, 0x2d, 0x74, 0x65,
+	0x73, 0x74, 0x01, 0x08, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24,
+	0x03, 0x01, 0x06, 0x30, 0x14, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01,
+	0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, 0x0c,
+	0x00, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x0d, 0x00, 0x4a, 0x3c, 0x2f, 0x1d,
+	0x00, 0x00, 0x00, 0x00, 0x35, 0x00, 0x0b, 0x00, 0x00, 0x0c, 0x77, 0x61,
+	0x76, 0x65, 0x6d, 0x6f, 0x6e, 0x2d, 0x74, 0x65, 0x73, 0x74, 0x01, 0x08,
+	0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24, 0x03, 0x01, 0x06, 0x30,
+	0x14, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac,
+	0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, 0x0c, 0x00, 0x00, 0x00, 0x00,
+	0x06, 0x00, 0x04, 0x00, 0x64, 0x00, 0x00, 0x00, 0x06, 0x00, 0x05, 0x00,
+	0x11, 0x04, 0x00, 0x00, 0x08, 0x00, 0x02, 0x00, 0x85, 0x09, 0x00, 0x00,
+	0x08, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x0a, 0x00,
+	0x78, 0x00, 0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x0c, 0x00, 0x0f, 0x00,
+	0xe0, 0x18, 0x2c, 0x3a, 0x5b, 0x00, 0x00, 0x00, 0x08, 0x00, 0x07, 0x00,
+	0xe8, 0xea, 0xff, 0xff, 0x08, 0x00, 0x09, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x98, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x02, 0x00, 0x0b, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x22, 0x01, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00,
+	0x2e, 0x00, 0x00, 0x00, 0x08, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x0c, 0x00, 0x99, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x68, 0x00, 0x2f, 0x00, 0x0a, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x02, 0x00, 0x00, 0x00, 0x26, 0x00, 0x06, 0x00, 0x00, 0x08, 0x61, 0x64,
+	0x68, 0x6f, 0x63, 0x2d, 0x35, 0x67, 0xdd, 0x16, 0x00, 0x50, 0xf2, 0x01,
+	0x01, 0x00, 0x00, 0x50, 0xf2, 0x02, 0x01, 0x00, 0x00, 0x50, 0xf2, 0x02,
+	0x01, 0x00, 0x00, 0x50, 0xf2, 0x02, 0x00, 0x00, 0x06, 0x00, 0x04, 0x00,
+	0x64, 0x00, 0x00, 0x00, 0x06, 0x00, 0x05, 0x00, 0x12, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x02, 0x00, 0x3c, 0x14, 0x00, 0x00, 0x08, 0x00, 0x14, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x0a, 0x00, 0xb8, 0x0b, 0x00, 0x00,
+	0x05, 0x00, 0x08, 0x00, 0x3c, 0x00, 0x00, 0x00, 0x78, 0x00, 0x00, 0x00,
+	0x1f, 0x00, 0x02, 0x00, 0x0b, 0x00, 0x00, 0x00, 0x1a, 0x2f, 0x00, 0x00,
+	0x22, 0x01, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00, 0x2e, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x99, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x00, 0x2f, 0x00,
+	0x0a, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x0e, 0x00, 0x06, 0x00, 0x00, 0x03, 0x64, 0x6d, 0x67, 0xdd, 0x16, 0x00,
+	0x50, 0xf2, 0x00, 0x00, 0x06, 0x00, 0x04, 0x00, 0x64, 0x00, 0x00, 0x00,
+	0x06, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x02, 0x00,
+	0xd0, 0xe3, 0x00, 0x00, 0x08, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x07, 0x00, 0x44, 0xe4, 0xff, 0xff, 0x4c, 0x00, 0x00, 0x00,
+	0x1f, 0x00, 0x02, 0x00, 0x0b, 0x00, 0x00, 0x00, 0x1a, 0x2f, 0x00, 0x00,
+	0x22, 0x01, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00, 0x2e, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x99, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1c, 0x00, 0x2f, 0x00,
+	0x08, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x08, 0x00, 0x02, 0x00,
+	0x6c, 0x09, 0x00, 0x00, 0x08, 0x00, 0x07, 0x00, 0x48, 0xf4, 0xff, 0xff,
+	0x14, 0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x0b, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* NL80211_CMD_GET_INTERFACE reply (seq 12) and its acknowledgment */
+static const unsigned char nl80211_iface_wlp2s0[] = {
+	0xa4, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x07, 0x01, 0x00, 0x00, 0x08, 0x00, 0x03, 0x00,
+	0x03, 0x00, 0x00, 0x00, 0x0b, 0x00, 0x04, 0x00, 0x77, 0x6c, 0x70, 0x32,
+	0x73, 0x30, 0x00, 0x00, 0x08, 0x00, 0x05, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0xe5, 0x00,
+	0x0c, 0x00, 0x99, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x0a, 0x00, 0x06, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00,
+	0x08, 0x00, 0x2e, 0x00, 0x2e, 0x00, 0x00, 0x00, 0x05, 0x00, 0x53, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x26, 0x00, 0x3c, 0x14, 0x00, 0x00,
+	0x08, 0x00, 0x22, 0x01, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x27, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x9f, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0xa0, 0x00, 0x5a, 0x14, 0x00, 0x00, 0x08, 0x00, 0x62, 0x00,
+	0x98, 0x08, 0x00, 0x00, 0x10, 0x00, 0x34, 0x00, 0x77, 0x61, 0x76, 0x65,
+	0x6d, 0x6f, 0x6e, 0x2d, 0x74, 0x65, 0x73, 0x74, 0x24, 0x00, 0x00, 0x00,
+	0x02, 0x00, 0x00, 0x01, 0x0c, 0x00, 0x00, 0x00, 0x1a, 0x2f, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x05, 0x00,
+	0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* NL80211_CMD_GET_STATION dump (seq 13): two stations, then NLMSG_DONE */
+static const unsigned char nl80211_station_dump[] = {
+	0xd0, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x02, 0x00, 0x0d, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x13, 0x01, 0x00, 0x00, 0x08, 0x00, 0x03, 0x00,
+	0x03, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x06, 0x00, 0x02, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00, 0x2e, 0x00, 0x00, 0x00,
+	0xa0, 0x00, 0x15, 0x00, 0x08, 0x00, 0x01, 0x00, 0x28, 0x00, 0x00, 0x00,
+	0x0c, 0x00, 0x17, 0x00, 0x01, 0x03, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x04, 0x00, 0x21, 0x00, 0x0c, 0x00, 0x18, 0x00, 0x40, 0xe2, 0x01, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x09, 0x00, 0xb0, 0x04, 0x00, 0x00,
+	0x08, 0x00, 0x0a, 0x00, 0x20, 0x03, 0x00, 0x00, 0x05, 0x00, 0x07, 0x00,
+	0xcc, 0x00, 0x00, 0x00, 0x05, 0x00, 0x0d, 0x00, 0xce, 0x00, 0x00, 0x00,
+	0x20, 0x00, 0x08, 0x00, 0x06, 0x00, 0x01, 0x00, 0x62, 0x03, 0x00, 0x00,
+	0x05, 0x00, 0x02, 0x00, 0x09, 0x00, 0x00, 0x00, 0x04, 0x00, 0x03, 0x00,
+	0x08, 0x00, 0x05, 0x00, 0x62, 0x03, 0x00, 0x00, 0x08, 0x00, 0x0b, 0x00,
+	0x11, 0x00, 0x00, 0x00, 0x08, 0x00, 0x0c, 0x00, 0x03, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x12, 0x00, 0x02, 0x00, 0x00, 0x00, 0x04, 0x00, 0x21, 0x00,
+	0x0c, 0x00, 0x1c, 0x00, 0x13, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x10, 0x00, 0x10, 0x0e, 0x00, 0x00, 0x05, 0x00, 0x1e, 0x00,
+	0xcf, 0x00, 0x00, 0x00, 0xc8, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x02, 0x00,
+	0x0d, 0x00, 0x00, 0x00, 0x1a, 0x2f, 0x00, 0x00, 0x13, 0x01, 0x00, 0x00,
+	0x08, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x06, 0x00,
+	0x02, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x08, 0x00, 0x2e, 0x00,
+	0x2e, 0x00, 0x00, 0x00, 0x98, 0x00, 0x15, 0x00, 0x08, 0x00, 0x01, 0x00,
+	0x28, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x17, 0x00, 0x01, 0x03, 0x0e, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x21, 0x00, 0x0c, 0x00, 0x18, 0x00,
+	0x40, 0xe2, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x09, 0x00,
+	0xb0, 0x04, 0x00, 0x00, 0x08, 0x00, 0x0a, 0x00, 0x20, 0x03, 0x00, 0x00,
+	0x05, 0x00, 0x07, 0x00, 0xcc, 0x00, 0x00, 0x00, 0x20, 0x00, 0x08, 0x00,
+	0x06, 0x00, 0x01, 0x00, 0x62, 0x03, 0x00, 0x00, 0x05, 0x00, 0x02, 0x00,
+	0x09, 0x00, 0x00, 0x00, 0x04, 0x00, 0x03, 0x00, 0x08, 0x00, 0x05, 0x00,
+	0x62, 0x03, 0x00, 0x00, 0x08, 0x00, 0x0b, 0x00, 0x11, 0x00, 0x00, 0x00,
+	0x08, 0x00, 0x0c, 0x00, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00, 0x12, 0x00,
+	0x02, 0x00, 0x00, 0x00, 0x04, 0x00, 0x21, 0x00, 0x0c, 0x00, 0x1c, 0x00,
+	0x13, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x10, 0x00,
+	0x10, 0x0e, 0x00, 0x00, 0x05, 0x00, 0x1e, 0x00, 0xcf, 0x00, 0x00, 0x00,
+	0x14, 0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x0d, 0x00, 0x00, 0x00,
+	0x1a, 0x2f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
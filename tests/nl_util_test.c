@@ -0,0 +1,157 @@
+/*
+ * wavemon - a wireless network monitoring aplication
+ *
+ * wavemon is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * wavemon is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with wavemon; see the file COPYING.  If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test of the netlink message and attribute parsers on recorded replies
+ *
+ * The replies in nl_captures.h are parsed as received, and again after being
+ * cut short at every length, so that attributes end up at the very end of the
+ * buffer. Build with -fsanitize=address to also catch reads beyond it.
+ */
+#include "nl_util.c"
+#include "nl_captures.h"
+#include <linux/rtnetlink.h>
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			failures++;					\
+		}							\
+	} while (0)
+
+/* Beyond IFLA_MAX of older headers, to cover the attributes of recent kernels */
+#define TEST_IFLA_MAX	100
+
+/* Read every attribute as each width: short payloads must read as 0. */
+static void read_all(const void *data, size_t len)
+{
+	const struct nlattr *nla;
+
+	nl_attr_for_each(nla, data, len) {
+		if (nl_attr_len(nla) < 8)
+			CHECK(nl_attr_u64(nla) == 0);
+		if (nl_attr_len(nla) < 4)
+			CHECK(nl_attr_u32(nla) == 0);
+		if (nl_attr_len(nla) < 2)
+			CHECK(nl_attr_u16(nla) == 0);
+		if (nl_attr_len(nla) < 1)
+			CHECK(nl_attr_u8(nla) == 0);
+	}
+}
+
+static int link_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+	const struct nlattr *tb[TEST_IFLA_MAX + 1];
+	const void *data = nl_msg_payload(nlh, sizeof(*ifi));
+	size_t len = nl_msg_payload_len(nlh, sizeof(*ifi));
+
+	(*(int *)arg)++;
+	read_all(data, len);
+
+	/* Only complete messages are checked for their content */
+	if (nlh->nlmsg_len != sizeof(rtm_newlink_lo))
+		return 0;
+
+	CHECK(nlh->nlmsg_type == RTM_NEWLINK);
+	CHECK(ifi->ifi_index == 1);
+
+	nl_attr_parse(tb, TEST_IFLA_MAX, data, len);
+	CHECK(tb[IFLA_IFNAME] && strcmp(nl_attr_data(tb[IFLA_IFNAME]), "lo") == 0);
+	CHECK(tb[IFLA_MTU] && nl_attr_u32(tb[IFLA_MTU]) == 65536);
+	CHECK(tb[IFLA_TXQLEN] && nl_attr_u32(tb[IFLA_TXQLEN]) == 1000);
+	CHECK(tb[IFLA_CARRIER] && nl_attr_u8(tb[IFLA_CARRIER]) == 1);
+	CHECK(tb[IFLA_STATS64] &&
+	      nl_attr_len(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64));
+
+	/* Recent kernels append nested attributes without payload */
+	CHECK(tb[62] && nl_attr_len(tb[62]) == 0 && nl_attr_u32(tb[62]) == 0);
+	return 0;
+}
+
+static void test_rtnl(void)
+{
+	uint8_t *buf;
+	int calls = 0;
+	size_t len;
+
+	CHECK(nl_parse(rtm_newlink_lo, sizeof(rtm_newlink_lo), 7, link_cb, &calls) == 1);
+	CHECK(calls == 1);
+
+	/* Replies to other requests are skipped */
+	calls = 0;
+	CHECK(nl_parse(rtm_newlink_lo, sizeof(rtm_newlink_lo), 8, link_cb, &calls) == 1);
+	CHECK(calls == 0);
+
+	/* Messages cut short, as if the attributes ended there */
+	for (len = NLMSG_HDRLEN; len < sizeof(rtm_newlink_lo); len++) {
+		buf = malloc(len);
+		if (!buf)
+			err_sys("can not allocate message");
+		memcpy(buf, rtm_newlink_lo, len);
+		((struct nlmsghdr *)buf)->nlmsg_len = len;
+
+		calls = 0;
+		nl_parse(buf, len, 7, link_cb, &calls);
+		CHECK(calls == 1);
+		free(buf);
+	}
+}
+
+static int family_cb(const struct nlmsghdr *nlh, void *arg)
+{
+	const struct nlattr *tb[CTRL_ATTR_MAX + 1];
+
+	(*(int *)arg)++;
+	CHECK(genl_cmd(nlh) == CTRL_CMD_NEWFAMILY);
+
+	genl_attr_parse(tb, CTRL_ATTR_MAX, nlh);
+	CHECK(tb[CTRL_ATTR_FAMILY_NAME] &&
+	      strcmp(nl_attr_data(tb[CTRL_ATTR_FAMILY_NAME]), "nlctrl") == 0);
+	CHECK(tb[CTRL_ATTR_FAMILY_ID] &&
+	      nl_attr_u16(tb[CTRL_ATTR_FAMILY_ID]) == GENL_ID_CTRL);
+	CHECK(tb[CTRL_ATTR_VERSION] && nl_attr_u32(tb[CTRL_ATTR_VERSION]) == 2);
+
+	/* The family ID is a u16: wider reads must not pick up the padding */
+	CHECK(tb[CTRL_ATTR_FAMILY_ID] && nl_attr_u32(tb[CTRL_ATTR_FAMILY_ID]) == 0);
+	CHECK(tb[CTRL_ATTR_VERSION] && nl_attr_u64(tb[CTRL_ATTR_VERSION]) == 0);
+	return 0;
+}
+
+static void test_genl(void)
+{
+	int calls = 0;
+
+	CHECK(nl_parse(ctrl_newfamily_nlctrl, sizeof(ctrl_newfamily_nlctrl), 9,
+		       family_cb, &calls) == 1);
+	CHECK(calls == 1);
+}
+
+int main(void)
+{
+	test_rtnl();
+	test_genl();
+
+	if (failures)
+		fprintf(stderr, "nl_util_test: %d checks failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
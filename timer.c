@@ -18,24 +18,150 @@
  * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include "wavemon.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
-static unsigned long get_usecs(void)
+/*
+ * Event loop
+ *
+ * All periodic activity (sampling, redrawing) and input is multiplexed over a
+ * single epoll instance, so that wavemon only wakes up when there is work.
+ * Handlers run in the context of the main loop, never in signal context.
+ */
+#define EV_MAX_SOURCES	16
+
+static int epfd = -1;
+
+/**
+ * struct ev_source  -  file descriptor watched by the event loop
+ * @fd:		file descriptor, -1 if the slot is unused
+ * @is_timer:	whether @fd is a timerfd created by timer_start()
+ * @handler:	called with @fd when @fd is readable (may be NULL)
+ */
+static struct ev_source {
+	int	fd;
+	bool	is_timer;
+	void	(*handler)(int fd);
+} ev_sources[EV_MAX_SOURCES];
+
+static struct ev_source *ev_find(int fd)
+{
+	int i;
+
+	for (i = 0; i < EV_MAX_SOURCES; i++)
+		if (ev_sources[i].fd == fd)
+			return ev_sources + i;
+	return NULL;
+}
+
+static void ev_init(void)
+{
+	int i;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		err_sys("epoll_create1");
+	for (i = 0; i < EV_MAX_SOURCES; i++)
+		ev_sources[i].fd = -1;
+}
+
+static void __ev_add(int fd, bool is_timer, void (*handler)(int fd))
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+	struct ev_source *src;
+
+	if (epfd < 0)
+		ev_init();
+
+	src = ev_find(-1);
+	if (src == NULL)
+		err_quit("can not watch more than %d event sources", EV_MAX_SOURCES);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		err_sys("epoll_ctl(ADD, %d)", fd);
+
+	src->fd	      = fd;
+	src->is_timer = is_timer;
+	src->handler  = handler;
+}
+
+/** Watch @fd for readability, calling @handler from ev_wait(). */
+void ev_add(int fd, void (*handler)(int fd))
+{
+	__ev_add(fd, false, handler);
+}
+
+void ev_del(int fd)
+{
+	struct ev_source *src = ev_find(fd);
+
+	if (src) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+		src->fd = -1;
+	}
+}
+
+/**
+ * ev_wait  -  wait for and dispatch events
+ * @timeout_ms:	maximum time to wait, -1 to wait until an event occurs
+ * Returns the number of events dispatched.
+ */
+int ev_wait(int timeout_ms)
 {
-	struct timeval tv;
-	struct timezone tz;
+	struct epoll_event evs[EV_MAX_SOURCES];
+	struct ev_source *src;
+	uint64_t expirations;
+	int i, n;
 
-	gettimeofday(&tv, &tz);
+	n = epoll_wait(epfd, evs, EV_MAX_SOURCES, timeout_ms);
+	if (n < 0 && errno != EINTR)
+		err_sys("epoll_wait");
 
-	return tv.tv_sec * 1000000 + tv.tv_usec;
+	for (i = 0; i < n; i++) {
+		/* A previous handler may have removed this source. */
+		src = ev_find(evs[i].data.fd);
+		if (src == NULL)
+			continue;
+		if (src->is_timer &&
+		    read(src->fd, &expirations, sizeof(expirations)) < 0)
+			continue;
+		if (src->handler)
+			src->handler(src->fd);
+	}
+	return n < 0 ? 0 : n;
 }
 
-void start_timer(struct timer *t, unsigned long duration)
+/*
+ * Timers
+ */
+
+/**
+ * timer_start  -  arm a periodic timer
+ * @interval_ms: period in milliseconds
+ * @handler:	 called from ev_wait() on each expiry
+ * Returns the timer descriptor, to be passed to timer_stop().
+ */
+int timer_start(unsigned long interval_ms, void (*handler)(int fd))
 {
-	t->stime    = get_usecs();
-	t->duration = duration;
+	struct itimerspec its;
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd < 0)
+		err_sys("timerfd_create");
+
+	its.it_interval.tv_sec	= interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+	its.it_value		= its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL) < 0)
+		err_sys("timerfd_settime");
+
+	__ev_add(fd, true, handler);
+	return fd;
 }
 
-bool end_timer(struct timer *t)
+void timer_stop(int fd)
 {
-	return get_usecs() >= t->stime + t->duration;
+	if (fd >= 0) {
+		ev_del(fd);
+		close(fd);
+	}
 }
@@ -17,9 +17,9 @@
  * with wavemon; see the file COPYING.  If not, write to the Free Software
  * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
-#include "wavemon.h"
+#include "iw_if.h"
 #include <locale.h>
-#include <setjmp.h>
+#include <sys/signalfd.h>
 
 /* GLOBALS */
 
@@ -87,19 +87,36 @@ static const struct {
 };
 
 /*
- * SIGWINCH handling with buffer synchronisation variable
+ * Events that end the current screen: these are set by the event handlers
+ * below and picked up by the main loop.
  */
-static sigjmp_buf		env_winch;
-static volatile sig_atomic_t	env_winch_ready;
+static bool resized, terminated, iface_changed;
 
-static void sig_winch(int signo)
+/* SIGWINCH and SIGTERM are blocked and received via a signalfd. */
+static void on_signal(int fd)
 {
-	if (env_winch_ready) {
-		env_winch_ready = false;
-		siglongjmp(env_winch, 1);
+	struct signalfd_siginfo si;
+
+	while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+		if (si.ssi_signo == SIGWINCH)
+			resized = true;
+		else
+			terminated = true;
 	}
 }
 
+/* Interface hotplug: re-initialize if the selected interface went away. */
+static void on_rtnl_event(int fd)
+{
+	if (rtnl_events_poll() && conf_update_interface_list())
+		iface_changed = true;
+}
+
+/* Keys are read by the screen loop functions. */
+static void on_input(int fd)
+{
+}
+
 static WINDOW *init_menubar(const enum wavemon_screen active)
 {
 	WINDOW *menu = newwin(1, WAV_WIDTH, WAV_HEIGHT, 0);
@@ -141,7 +158,8 @@ static void check_geometry(void)
 int main(int argc, char *argv[])
 {
 	enum wavemon_screen cur, next;
-	sigset_t blockmask, oldmask;
+	sigset_t blockmask;
+	int fd;
 
 	getconf(argc, argv);
 
@@ -184,97 +202,109 @@ int main(int argc, char *argv[])
 	init_pair(CP_SCAN_UNENC,  COLOR_GREEN,	COLOR_BLACK);
 	init_pair(CP_SCAN_NON_AP, COLOR_YELLOW, COLOR_BLACK);
 
-	/* Override signal handlers installed during ncurses initialisation. */
+	/*
+	 * Override signal handlers installed during ncurses initialisation.
+	 * Blocking happens before any threads are started, which inherit it.
+	 */
 	xsignal(SIGCHLD, SIG_IGN);
-	xsignal(SIGWINCH, sig_winch);	/* triggers only when env_winch_ready */
 	sigemptyset(&blockmask);
 	sigaddset(&blockmask, SIGWINCH);
+	sigaddset(&blockmask, SIGTERM);
+	if (sigprocmask(SIG_BLOCK, &blockmask, NULL) < 0)
+		err_sys("cannot block SIGWINCH/SIGTERM");
+	fd = signalfd(-1, &blockmask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0)
+		err_sys("signalfd");
+	ev_add(fd, on_signal);
+	ev_add(STDIN_FILENO, on_input);
+
+	fd = rtnl_events_init();
+	if (fd >= 0)
+		ev_add(fd, on_rtnl_event);
 
 	for (cur = conf.startup_scr; cur != SCR_QUIT; cur = next) {
 		WINDOW *w_menu;
-		int escape = 0;
-
-		if (sigprocmask(SIG_BLOCK, &blockmask, &oldmask) < 0)
-			err_sys("cannot block SIGWINCH");
+		int key, escape = 0;
 
 		next = cur;
 		w_menu = init_menubar(cur);
+		sampling_init();	/* no-op unless interface/settings changed */
 		(*screens[cur].init)();
 
-		if (sigprocmask(SIG_SETMASK, &oldmask, NULL) < 0)
-			err_sys("cannot unblock SIGWINCH");
-
-		if (sigsetjmp(env_winch, true) == 0) {
-			env_winch_ready = true;
-
-			do {
-				int key = (*screens[cur].loop)(w_menu);
-
-				if (key <= 0)
-					usleep(5000);
-				/*
-				 * Translate vt100 PF1..4 escape sequences sent
-				 * by some X terminals (e.g. aterm) into F1..F4.
-				 */
-				switch (key) {
-				case 033:
-					escape = 1;
-					break;
-				case 'O':
-					escape = 2;
-					break;
-				case 'P' ... 'S':
-					if (escape == 2)
-						key = KEY_F(key - 'P' + 1);
-					/* fall through */
-				default:
-					escape = 0;
-				}
-
-				/* Main menu */
-				switch (key) {
-				case 'i':
-				case KEY_F(1):
-					next = SCR_INFO;
-					break;
-				case 'l':
-				case KEY_F(2):
-					next = SCR_LHIST;
-					break;
-				case 's':
-				case KEY_F(3):
-					next = SCR_SCAN;
-					break;
-				case 'p':
-				case KEY_F(7):
-					next = SCR_PREFS;
-					break;
-				case 'h':
-				case KEY_F(8):
-					next = SCR_HELP;
-					break;
-				case 'a':
-				case KEY_F(9):
-					next = SCR_ABOUT;
-					break;
-				case 'q':
-				case KEY_F(10):
-					next = SCR_QUIT;
-				}
-			} while (next == cur);
-		}
+		do {
+			key = (*screens[cur].loop)(w_menu);
+
+			/*
+			 * Translate vt100 PF1..4 escape sequences sent
+			 * by some X terminals (e.g. aterm) into F1..F4.
+			 */
+			switch (key) {
+			case 033:
+				escape = 1;
+				break;
+			case 'O':
+				escape = 2;
+				break;
+			case 'P' ... 'S':
+				if (escape == 2)
+					key = KEY_F(key - 'P' + 1);
+				/* fall through */
+			default:
+				escape = 0;
+			}
+
+			/* Main menu */
+			switch (key) {
+			case 'i':
+			case KEY_F(1):
+				next = SCR_INFO;
+				break;
+			case 'l':
+			case KEY_F(2):
+				next = SCR_LHIST;
+				break;
+			case 's':
+			case KEY_F(3):
+				next = SCR_SCAN;
+				break;
+			case 'p':
+			case KEY_F(7):
+				next = SCR_PREFS;
+				break;
+			case 'h':
+			case KEY_F(8):
+				next = SCR_HELP;
+				break;
+			case 'a':
+			case KEY_F(9):
+				next = SCR_ABOUT;
+				break;
+			case 'q':
+			case KEY_F(10):
+				next = SCR_QUIT;
+			}
+			if (next != cur)
+				break;
+
+			/* Drain keys buffered by ncurses before waiting again. */
+			ev_wait(key > 0 ? 0 : -1);
+			if (terminated)
+				next = SCR_QUIT;
+		} while (next == cur && !resized && !iface_changed);
 
 		delwin(w_menu);
 		(*screens[cur].fini)();
 
 		/*
-		 * next = cur is set in the protected critical section before
-		 * sigsetjmp. Due to the loop condition, it can not occur when
-		 * no SIGWINCH occurred, hence it indicates a resizing event.
+		 * Leaving the loop with next == cur indicates a resizing event
+		 * or a change of interface; in both cases the screen is
+		 * re-initialized, and resizing to the same size is harmless.
 		 */
 		if (next == cur) {
 			struct winsize size;
 
+			resized = iface_changed = false;
+
 			if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) < 0)
 				err_sys("can not determine terminal size");
 			resizeterm(size.ws_row, size.ws_col);
@@ -283,6 +313,7 @@ int main(int argc, char *argv[])
 		clear();
 		refresh();
 	}
+	sampling_stop();
 	endwin();
 
 	return EXIT_SUCCESS;
@@ -52,7 +52,7 @@ enum info_screen_geometry {
 	WH_STATS    = 3,	/* WiFi statistics area */
 	WH_INFO_MIN = 6,	/* WiFi information area */
 	WH_NET_MIN  = 3,	/* Network interface information area */
-	WH_NET_MAX  = 5,	/* Network interface information area */
+	WH_NET_MAX  = 6,	/* Network interface information area */
 	WH_MENU	    = 1		/* Menu bar at the bottom */
 };
 #define WH_INFO_SCR_BASE	(WH_IFACE + WH_LEVEL + WH_STATS + WH_MENU)
@@ -111,7 +111,17 @@ enum scan_sort_order {
 	SO_ESSID,
 	SO_OPEN,
 	SO_CHAN_SIG,
-	SO_OPEN_SIG
+	SO_OPEN_SIG,
+	SO_CUSTOM	/* as given by scan_sort_spec */
+};
+
+/*
+ * Symbolic names of the methods to obtain wireless information.
+ */
+enum iw_backend {
+	BE_AUTO,		/* nl80211 if supported by the interface */
+	BE_WEXT,		/* wireless extensions */
+	BE_NL80211		/* nl80211 generic netlink */
 };
 
 /*
@@ -121,7 +131,9 @@ extern struct wavemon_conf {
 	int	if_idx;			/* Index into interface list */
 
 	int	stat_iv,
-		info_iv;
+		info_iv,
+		scan_iv,
+		scan_ageout;
 
 	int	sig_min, sig_max,
 		noise_min, noise_max;
@@ -136,14 +148,21 @@ extern struct wavemon_conf {
 	int	check_geometry,		/* ensure window is large enough */
 		cisco_mac,		/* Cisco-style MAC addresses */
 		random,			/* random signals */
+		realtime,		/* SCHED_FIFO/mlockall sampling */
 		override_bounds,	/* override autodetection */
-		scan_sort_asc;		/* direction of @scan_sort_order */
+		scan_sort_asc,		/* direction of @scan_sort_order */
+		scan_passive;		/* only read cached scan results */
 
 	/* Enumerated values */
 	int	scan_sort_order,	/* channel|signal|open|chan/sig ... */
 		lthreshold_action,	/* disabled|beep|flash|beep+flash */
 		hthreshold_action,	/* disabled|beep|flash|beep+flash */
-		startup_scr;		/* info|histogram|aplist */
+		startup_scr,		/* info|histogram|aplist */
+		backend;		/* auto|wext|nl80211 */
+
+	/* String values */
+	char	*scan_watch,		/* ESSIDs/BSSIDs/channels to scan for */
+		*scan_sort_spec;	/* compound order, e.g. "chan,-sig" */
 } conf;
 
 /*
@@ -160,11 +179,13 @@ struct conf_item {
 		t_int,		/* @v.i is interpreted as raw value */
 		t_list,		/* @v.i is an index into @list */
 		t_sep,		/* dummy, separator entry */
-		t_func		/* void (*fp) (void) */
+		t_func,		/* void (*fp) (void) */
+		t_str		/* @v.s, set in ~/.wavemonrc only */
 	} type;
 
 	union {			/* type-dependent container for value */
 		int	*i;	/* t_int and t_list index into @list  */
+		char	**s;	/* t_str: string value, never NULL */
 		void (*fp)();	/* t_func */
 	} v;
 
@@ -281,20 +302,23 @@ static inline int cp_from_scale(float value, const char *cscale, bool reverse)
  */
 extern const char *we_version(void);
 extern const char *conf_ifname(void);
+extern const char *const *conf_iflist(void);
 extern void conf_get_interface_list(bool init);
 extern void iw_get_interface_list(char** if_list, size_t max_entries);
+extern bool conf_update_interface_list(void);
+extern int  rtnl_events_init(void);
+extern bool rtnl_events_active(void);
+extern bool rtnl_events_poll(void);
 extern void dump_parameters(void);
 
 /*
- *	Timers
+ *	Event loop and timers
  */
-struct timer {
-	unsigned long long	stime;
-	unsigned long		duration;
-};
-
-extern void start_timer(struct timer *t, unsigned long d);
-extern bool end_timer(struct timer *t);
+extern void ev_add(int fd, void (*handler)(int fd));
+extern void ev_del(int fd);
+extern int  ev_wait(int timeout_ms);
+extern int  timer_start(unsigned long interval_ms, void (*handler)(int fd));
+extern void timer_stop(int fd);
 
 /*
  *	Error handling
@@ -346,7 +370,7 @@ static inline void str_tolower(char *s)
 }
 
 /* Check if @str is printable (compare iw_essid_escape()) */
-static inline bool str_is_ascii(char *s)
+static inline bool str_is_ascii(const char *s)
 {
 	if (!s || !*s)
 		return false;
@@ -367,6 +391,11 @@ static inline int max(const int a, const int b)
 	return a > b ? a : b;
 }
 
+static inline int min(const int a, const int b)
+{
+	return a < b ? a : b;
+}
+
 static inline bool in_range(int val, int min, int max)
 {
 	return min <= val && val <= max;